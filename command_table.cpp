@@ -0,0 +1,797 @@
+#include <vector>
+#include <unordered_map>
+#include <string>
+#include "token.h"
+#include "object.h"
+#include "module.h"
+#include "machine.h"
+#include "commands.h"
+
+namespace rps
+{
+
+/*
+ * Descriptors of the builtin commands. The table is constant data, it
+ * needs no initialization at startup. The Machine registers every
+ * entry once when it is constructed, and HELP reads the text back
+ * from here, so the commands themselves never have to check for a
+ * help request.
+ */
+const CommandInfo command_table[] =
+{
+    // Stack commands
+    { "CLRSTK", &CLRSTK, "Stack",
+        "CLRSTK: Clear the stack",
+        "obj1 obj2 obj3... CLRSTK =>",
+        "" },
+    { "DROP", &DROP, "Stack",
+        "DROP: Pop the item at L0",
+        "obj DROP => ",
+        "" },
+    { "DROPN", &DROPN, "Stack",
+        "DROPN: Pop n items from the stack",
+        "obj1 obj2 obj3... nitems DROPN =>",
+        "" },
+    { "SWAP", &SWAP, "Stack",
+        "SWAP: Swap the top two objects on the stack",
+        "obj1 obj2 SWAP => obj2 obj1",
+        "" },
+    { "DUP", &DUP, "Stack",
+        "DUP: Duplicate the toptwo objects on the stack",
+        "obj DUP => obj obj",
+        "" },
+    { "PICK", &PICK, "Stack",
+        "PICK: Copy the nth item from the stack and copy to L0",
+        "obj1 obj2 level PICK => obj",
+        "" },
+    { "ROLL", &ROLL, "Stack",
+        "ROLL: Move the nth item from the stack to L0",
+        "obj1 obj2 obj3... nitem ROLL => obj2 obj3 obj1",
+        "" },
+    { "ROLLD", &ROLLD, "Stack",
+        "ROLLD: Move L0 item from the stack to nth level",
+        "obj1 obj2 obj3... nitem ROLLD => obj3 obj2 obj1",
+        "" },
+    { "DEPTH", &DEPTH, "Stack",
+        "DEPTH: Pushes the number of items on the stack",
+        "obj1 obj2 ob3... DEPTH => obj1 obj2 obj3... int",
+        "" },
+    { "VIEW", &VIEW, "Stack",
+        "VIEW: View the items in the stack",
+        "obj1 obj2... VIEW => obj1 obj2...",
+        "" },
+
+    // Logical operators
+    { "EQ", &EQ, "Logical",
+        "EQ: Compare for equality",
+        "\"str1\" \"str2\" EQ => int\n"
+        "int1 int2 EQ => int",
+        "" },
+    { "NEQ", &NEQ, "Logical",
+        "NEQ: Compare for not equal",
+        "\"str1\" \"str2\" NEQ => int\n"
+        "int1 int2 NEQ => int",
+        "" },
+    { "LT", &LT, "Logical",
+        "LT: Compare for less than",
+        "\"str1\" \"str2\" LT => int\n"
+        "int1 int2 LT => int",
+        "" },
+    { "LTEQ", &LTEQ, "Logical",
+        "LTEQ: Compare for less than or equal",
+        "\"str1\" \"str2\" LTEQ => int\n"
+        "int1 int2 LTEQ => int",
+        "" },
+    { "GT", &GT, "Logical",
+        "GT: Compare for greater than",
+        "\"str1\" \"str2\" GT => int\n"
+        "int1 int2 GT => int",
+        "" },
+    { "GTEQ", &GTEQ, "Logical",
+        "GTEQ: Compare for greater than or equal",
+        "\"str1\" \"str2\" GTEQ => int\n"
+        "int1 int2 GTEQ => int",
+        "" },
+    { "AND", &AND, "Logical",
+        "AND: Logical AND",
+        "\"str1\" \"str2\" AND => int\n"
+        "int1 int2 AND => int",
+        "" },
+    { "OR", &OR, "Logical",
+        "OR: Logical OR",
+        "\"str1\" \"str2\" OR => int\n"
+        "int1 int2 OR => int",
+        "" },
+    { "NOT", &NOT, "Logical",
+        "NOT: Logical NOT",
+        "int NOT => int",
+        "" },
+
+    // Variable commands
+    { "STO", &STO, "Variable",
+        "STO: Store object",
+        "obj \"name\" STO =>\n"
+        "obj \"namespace.name\" STO =>",
+        "Store an object in the given variable name.\n"
+        "By default objects are stored in the current namespace which\n"
+        "is usually the module name or set by SETNS" },
+    { "RCL", &RCL, "Variable",
+        "RCL: Recall object",
+        "\"name\" RCL => obj\n"
+        "\"namespace.name\" RCL => obj",
+        "Recall an object from the given variable name.\n"
+        "By default objects are recalled from the current namespace which\n"
+        "is usually the module name or set by SETNS\n"
+        "See also RCLL, RCLA" },
+    { "STOL", &STOL, "Variable",
+        "STOL: Store object into local storage",
+        "obj \"name\" STOL =>\n"
+        "obj \"name\" STOL* => obj",
+        "Store an object in the given variable name in the local context.\n"
+        "Local variables are only available in the current program.\n"
+        "Programs defined within a program have access to local variables of the\n"
+        "enclosing program" },
+    { "RCLL", &RCLL, "Variable",
+        "RCLL: Recall a local object",
+        "\"name\" RCLL =>",
+        "Local variables can be recalled from the current program\n"
+        "or local variables of enclosing programs\n"
+        "See also RCL, RCLA" },
+    { "RCLA", &RCLA, "Variable",
+        "RCLA: Recall an object, first look in local storage, then global",
+        "\"name\" RCLA => obj",
+        "Local variables can be recalled from the current program\n"
+        "or local variables of enclosing programs\n"
+        "\'%\' is a synonym for RCLA" },
+    { "VARNAMES", &VARNAMES, "Variable",
+        "VARNAMES: List variables",
+        "\"namespace\" VARNAMES => [list]",
+        "" },
+    { "VARS", &VARS, "Variable",
+        "VARS: Print variables and thier contents",
+        "\"namespace\" VARS =>",
+        "" },
+    { "VARTYPES", &VARTYPES, "Variable",
+        "VARTYPES: List variable types",
+        "\"namespace\" VARTYPES => [list]",
+        "" },
+    { "REGISTER", &REGISTER, "Variable",
+        "REGISTER: Register a user defined program",
+        "<<prog>> \"name\" REGISTER => ",
+        "Registering a program allows the user invoke the program by name\n"
+        "rather than having to issue a CALL statement.\n"
+        "name should always be in quotes to force interpretation as a string,\n"
+        "otherwise calling REGISTER again could invoke the command rather then setting it." },
+    { "UNREGISTER", &UNREGISTER, "Variable",
+        "UNREGISTER: Unregister a user defined program",
+        "\"name\" UNREGISTER => ",
+        "Unregisters a previous registered program" },
+
+    // Math commands
+    { "ADD", &ADD, "Math",
+        "ADD: Addition",
+        "int1 int2 ADD => int",
+        "" },
+    { "SUB", &SUB, "Math",
+        "SUB: Subraction",
+        "int1 int2 SUB => int",
+        "" },
+    { "MUL", &MUL, "Math",
+        "MUL: Multilication",
+        "int1 int2 MUL => int",
+        "" },
+    { "DIV", &DIV, "Math",
+        "DIV: Division",
+        "int1 int2 DIV => int",
+        "" },
+    { "INC", &INC, "Math",
+        "INC: Increment",
+        "int INC => int",
+        "" },
+    { "DEC", &DEC, "Math",
+        "DEC: Decrement",
+        "int DEC => int",
+        "" },
+
+    // Control commands
+    { "IFT", &IFT, "Control",
+        "IFT: Evaluate then if cond is true",
+        "cond then IFT => ...",
+        "" },
+    { "IFTE", &IFTE, "Control",
+        "IFTE: Evaluate then if cond is true, otherwise else",
+        "cond then else IFTE => ...",
+        "" },
+    { "TRYCATCH", &TRYCATCH, "Control",
+        "TRYCATCH: Evaluate try, evaluate catch if it throws an error",
+        "catch try TRYCATCH => ...",
+        "" },
+
+    // List commands
+    { "GET", &GET, "List",
+        "GET: Get the object in a list at the given index",
+        "[list] idx GET => obj\n"
+        "[list] idx GET* => [list] obj",
+        "If idx < 0 it is taken from the end of the list" },
+    { "SUBLIST", &SUBLIST, "List",
+        "SUBLIST: Push a sublist",
+        "[list] startpos length SUBLIST => [list]\n"
+        "stream startpos length SUBLIST => stream",
+        "If startpos is < 0, it is taken from the end of the list\n"
+        "If length < 0 it is used as the index to copy to.\n"
+        "In all cases, if length exceeds the end of the list, copy\n"
+        "to the end of the list.\n"
+        "A Stream is not read, the items are skipped and counted as the\n"
+        "result is read. startpos must be >= 0 and length >= -1." },
+    { "APPEND", &APPEND, "List",
+        "APPEND: Append the object at L0 to the list on L1",
+        "[list] \"obj\" APPEND => [list]",
+        "" },
+    { "ERASE", &ERASE, "List",
+        "ERASE: Erase an item from a list or a map",
+        "[list] idx ERASE => [list]\n"
+        "{map} key ERASE => {map}",
+        "" },
+    { "CLEAR", &CLEAR, "List",
+        "CLEAR: Clear a list or map",
+        "[list] CLEAR => []\n"
+        "{map} CLEAR => {}\n"
+        "\"str\" CLEAR => \"\"",
+        "" },
+    { "LINSERT", &LINSERT, "List",
+        "LINSERT: Insert an item into a list",
+        "[list] idx obj => [list]",
+        "" },
+    { "INSERT", &INSERT, nullptr,
+        "INSERT: Insert into a list or a map",
+        "[list] idx obj INSERT => [list]\n"
+        "{map} [k,v] INSERT => {map}",
+        "" },
+    { "SIZE", &SIZE, "List",
+        "SIZE: Return the size of an object",
+        "[list] SIZE => int\n"
+        "{map} SIZE => int\n"
+        "\"str\" SIZE => int\n"
+        "table SIZE => int\n"
+        "<<prog>> SIZE => int",
+        "" },
+    { "FIRST", &FIRST, "List",
+        "FIRST: Get the fist element of a list",
+        "[list] FIRST => obj",
+        "" },
+    { "SECOND", &SECOND, "List",
+        "SECOND: Get the second element of a list",
+        "[list] SECOND => obj",
+        "" },
+    { "TOLIST", &TOLIST, "List",
+        "TOLIST: Take n items from the stack and create a list",
+        "obj1 obj2 obj3... nitems TOLIST => [list]",
+        "" },
+    { "FROMLIST", &FROMLIST, "List",
+        "FROMLIST: Push all items of a list to the stack",
+        "[list] FROMLIST => obj1, obj2, obj3...",
+        "" },
+    { "CREATELIST", &CREATELIST, "List",
+        "CREATELIST: Create a list",
+        "CREATELIST => []",
+        "" },
+    { "HEAD", &HEAD, "List",
+        "HEAD: Get head and tail of a list, or its first n items",
+        "[obj1 obj2...objn] HEAD => [ obj1 [obj2...objn] ]\n"
+        "[obj1 obj2...objn] n HEAD => [obj1...objn]\n"
+        "stream n HEAD => stream",
+        "Nothing more is read from a Stream after its first n items" },
+    { "UNIQUE", &UNIQUE, "List",
+        "UNIQUE: Returns a unique list of items from a List",
+        "[list] [\"--fingerprint\"] UNIQUE => [list]",
+        "The first of equal items is kept, in the order of the list.\n"
+        "Strings and Integers are equal if their values are, other\n"
+        "items only to themselves. With --fingerprint only a 64 bit\n"
+        "hash of each item is kept to find the repeats, items whose\n"
+        "hashes collide count as one. A Stream is read to the end." },
+    { "REVERSE", &REVERSE, "List",
+        "REVERSE: Reverse a list",
+        "[obj1 obj2...objn] REVERSE => [objn...obj2 obj1]",
+        "" },
+    { "SORT", &SORT, "List",
+        "SORT: Sort a list of Integers and Strings",
+        "[list] [\"--desc\"] SORT => [sorted list]",
+        "Integers sort before Strings. The sort is stable, long lists\n"
+        "are sorted on all cores. A Stream is read to the end." },
+    { "SORTBY", &SORTBY, "List",
+        "SORTBY: Sort a list by the key a program computes for each item",
+        "[list] <<prog>> [\"--desc\"] SORTBY => [sorted list] \n"
+        "[list] \"progname\" [\"--desc\"] SORTBY => [sorted list]",
+        "prog runs once for each item and must leave an Integer or a\n"
+        "String, the keys are sorted like SORT sorts a list." },
+    { "TOPK", &TOPK, "List",
+        "TOPK: The k largest items of a list",
+        "[list] k [\"--least\"] TOPK => [k items] \n"
+        "[list] <<prog>> k [\"--least\"] TOPK => [k items]",
+        "The items, or the keys prog computes for them, are ranked like\n"
+        "SORT ranks them, largest first, smallest first with --least.\n"
+        "Only the best k are kept while reading, so a Stream is never\n"
+        "held in memory." },
+    { "COLLECT", &COLLECT, "List",
+        "COLLECT: Read the remaining items of a Stream into a list",
+        "stream COLLECT => [obj1 obj2...objn]",
+        "A list is returned unchanged" },
+    { "LAZY", &LAZY, "List",
+        "LAZY: Read a list as a Stream",
+        "[obj1 obj2...objn] LAZY => stream",
+        "FILTER, APPLY, HEAD and SUBLIST on the Stream are run together\n"
+        "one item at a time when it is read, without intermediate lists.\n"
+        "A Stream is returned unchanged" },
+    { "ZIP", &ZIP, "List",
+        "ZIP: zip two lists together",
+        "[list1] [list] <<prog>> ZIP => [list]\n"
+        "[list1] [list] \"prog_name\" ZIP => [list]",
+        "prog receives two items, one from each list and should return\n"
+        "an object to be placed on the returned list.\n"
+        "If one list is shorter than the other, None will be passed." },
+    { "UNZIP", &UNZIP, "List",
+        "UNZIP: unzip a list into two lists",
+        "[list] <<prog>> UNZIP => [list1] [list]\n"
+        "[list] \"prog_name\" UNZIP => [list1] [list]",
+        "prog receives a list item and should return two items to be placed\n"
+        "on each list" },
+
+    // Map commands
+    { "MINSERT", &MINSERT, "Map",
+        "MINSERT: Insert into a map",
+        "{map} [k,v] => {map}",
+        "list: A tuple of a Key-Value pair" },
+    { "FIND", &FIND, "Map",
+        "FIND: Find an item in a map",
+        "{map} key onError FIND => obj",
+        "key: Either a string or integer key\n"
+        "onError: If the key is not found, this is the value placed on L0" },
+    { "TOMAP", &TOMAP, "Map",
+        "TOMAP: Take n tuples from the stack and create a map",
+        "[k,v] [k,v] [k,v]... nitems TOMAP => {map}",
+        "" },
+    { "FROMMAP", &FROMMAP, "Map",
+        "FROMMAP: Push all key/values of a map onto the stack",
+        "{map} FROMMAP => [k, v] [k, v] [k,v]...",
+        "" },
+    { "CREATEMAP", &CREATEMAP, "Map",
+        "CREATEMAP: Create a map",
+        "CREATEMAP => {}",
+        "" },
+    { "KEYS", &KEYS, "Map",
+        "KEYS: Get a list of keys",
+        "{map} KEYS => [list]",
+        "" },
+    { "VALUES", &VALUES, "Map",
+        "VALUES: Get a list of values",
+        "{map} VALUES => [list]",
+        "" },
+
+    // Table commands
+    { "TABLE", &TABLE, "Table",
+        "TABLE: Store a list of records by column",
+        "[[field1...fieldn]...] [\"name1\"...\"namen\"] TABLE => table",
+        "Each row is a list of fields, String, Integer or None. A column\n"
+        "of Integers is kept as integers, any other column as a dictionary\n"
+        "of its strings. Columns without a name are named by their number.\n"
+        "The rows may also come from a stream." },
+    { "TSELECT", &TSELECT, "Table",
+        "TSELECT: Select columns of a table",
+        "table [col1...coln] TSELECT => table",
+        "col: A column name or number" },
+    { "TEQ", &TEQ, "Table",
+        "TEQ: Keep the rows of a table where a column equals a value",
+        "table col value TEQ => table",
+        "Filters are run on whole columns and only mark the rows kept,\n"
+        "so they can be chained cheaply. A None cell only matches None." },
+    { "TNE", &TNE, "Table",
+        "TNE: Keep the rows of a table where a column is not a value",
+        "table col value TNE => table",
+        "" },
+    { "TLT", &TLT, "Table",
+        "TLT: Keep the rows of a table where a column is less than a value",
+        "table col value TLT => table",
+        "Integer columns compare as numbers, string columns as strings" },
+    { "TLE", &TLE, "Table",
+        "TLE: Keep the rows of a table where a column is at most a value",
+        "table col value TLE => table",
+        "" },
+    { "TGT", &TGT, "Table",
+        "TGT: Keep the rows of a table where a column is greater than a value",
+        "table col value TGT => table",
+        "" },
+    { "TGE", &TGE, "Table",
+        "TGE: Keep the rows of a table where a column is at least a value",
+        "table col value TGE => table",
+        "" },
+    { "TROWS", &TROWS, "Table",
+        "TROWS: The rows of a table",
+        "table TROWS => [[field1...fieldn]...]",
+        "" },
+    { "TCOLUMN", &TCOLUMN, "Table",
+        "TCOLUMN: The values of a column of a table",
+        "table col TCOLUMN => [list]",
+        "" },
+    { "TNAMES", &TNAMES, "Table",
+        "TNAMES: The column names of a table",
+        "table TNAMES => [list]",
+        "" },
+
+    // Functional
+    { "APPLY", &APPLY, "Functional",
+        "APPLY: Apply a program to each item in a list.",
+        "[srclist] <<prog>> APPLY => [dstlist]\n"
+        "[srclist] \"progname\" APPLY => [dstlist]",
+        "Returns a list the same size as the input.\n"
+        "srclist: List of items\n"
+        "prog: Program to execute. The program will have a list item at L0\n"
+        "      the program will return an object to be placed on the dstlist\n"
+        "Given a Stream, returns a Stream that applies prog as it is read" },
+    { "APPLY1", &APPLY1, "Functional",
+        "APPLY1: Apply a program to each item in a list with an argument.",
+        "[srclist] <<prog>> argObj APPLY1 => [dstlist]\n"
+        "[srclist] \"progname\" argObj APPLY1 => [dstlist]",
+        "Returns a list the same size as the input.\n"
+        "srclist: List of items\n"
+        "prog: Program to execute. The program will have a list item at L1 and argObj at L0\n"
+        "      the program will return an object to be placed on the dstlist\n"
+        "Given a Stream, returns a Stream that applies prog as it is read" },
+    { "FILTER", &FILTER, "Functional",
+        "FILTER Filter items from a list",
+        "[srclist] <<prog>> FILTER => [dstlist]",
+        "Returns a list of items removed from the input list.\n"
+        "srclist: List of items\n"
+        "prog: Program to execute. The program will have a list item at L0\n"
+        "      the program will return true or false to have the item removed\n"
+        "      on the dest list\n"
+        "Given a Stream, returns a Stream that filters items as it is read" },
+    { "FILTER1", &FILTER1, "Functional",
+        "FILTER1 Remove items from a list with an argument",
+        "[srclist] <<prog>> argObj FILTER1 => [dstlist]",
+        "Returns a list of items removed from the input list.\n"
+        "srclist: List of items\n"
+        "prog: Program to execute. The program will have a list item at L1 and argObj at L0\n"
+        "      the program will return true or false to have the item removed\n"
+        "      on the dest list\n"
+        "Given a Stream, returns a Stream that filters items as it is read" },
+    { "MAP", &MAP, "Functional",
+        "MAP a function over a list",
+        "[list] <<prog>> opt MAP => \n"
+        "[list] \"progname\" opt MAP => ",
+        "srclist: List of items\n"
+        "prog: Program to execute. The program will have a list item at L0\n"
+        "opt: Optional options.\n"
+        "     --query: Prompt the user to continue\n"
+        "MAP itself does not push anything on the stack, however the executed program may." },
+    { "MAP1", &MAP1, "Functional",
+        "MAP1 a function over a list with an argument",
+        "[list] <<prog>> argObj opt MAP => \n"
+        "[list] \"progname\" argObj opt MAP => ",
+        "srclist: List of items\n"
+        "prog: Program to execute. The program will have a list item at L1 and argObj at L0\n"
+        "opt: Optional options.\n"
+        "     --query: Prompt the user to continue\n"
+        "MAP1 itself does not push anything on the stack, however the executed program may." },
+    { "REDUCE", &REDUCE, "Functional",
+        "REDUCE a list to an object",
+        "[list] <<prog>> startobj REDUCE => obj \n"
+        "[list] \"progname\" startobj REDUCE => obj ",
+        "REDUCE calls prog with a list item and the startobj.\n"
+        "The program will then return an object to be provided\n"
+        "to the next invocation of the program\n"
+        "<<prog>> must have signiture:\n"
+        "   listitem obj => obj" },
+    { "PAPPLY", &PAPPLY, "Functional",
+        "PAPPLY: APPLY on all cores",
+        "[srclist] <<prog>> PAPPLY => [dstlist]\n"
+        "[srclist] \"progname\" PAPPLY => [dstlist]",
+        "Like APPLY, the list is split over worker threads and the results\n"
+        "are returned in the order of the input.\n"
+        "The program can recall global variables and the locals of the\n"
+        "calling program but not store them, STO, REGISTER, IMPORT and\n"
+        "SETPROPERTY throw. Locals of the program itself can be stored." },
+    { "PFILTER", &PFILTER, "Functional",
+        "PFILTER: FILTER on all cores",
+        "[srclist] <<prog>> PFILTER => [dstlist]",
+        "Like FILTER, the list is split over worker threads.\n"
+        "See PAPPLY for the restrictions on the program." },
+    { "PREDUCE", &PREDUCE, "Functional",
+        "PREDUCE: REDUCE on all cores",
+        "[list] <<prog>> startobj PREDUCE => obj \n"
+        "[list] \"progname\" startobj PREDUCE => obj ",
+        "The list is split over worker threads that each reduce a part,\n"
+        "then the partial results are combined pairwise by prog.\n"
+        "The result is the same as REDUCE when prog is associative, like\n"
+        "ADD, and startobj is only used once.\n"
+        "See PAPPLY for the restrictions on the program." },
+    { "GROUPBY", &GROUPBY, "Functional",
+        "GROUPBY: group items by key and aggregate each group",
+        "[list] <<prog>> [options] GROUPBY => {map} \n"
+        "[list] key [options] GROUPBY => {map} \n"
+        "table column [options] GROUPBY => {map} ",
+        "The key of an item is what prog leaves for it, its field at an\n"
+        "index of a list item or a key of a map item, or its cell in a\n"
+        "column of a table. Keys must be strings, integers or None, an\n"
+        "index past the end of a list item is an error and prog must\n"
+        "leave exactly one key.\n"
+        "The groups are made in a single pass.\n"
+        "The map holds the aggregate of each group, a list of them if\n"
+        "more than one option is given. Options: \"--count\",\n"
+        "\"--sum=field\", \"--min=field\", \"--max=field\",\n"
+        "\"--first[=field]\", \"--last[=field]\", \"--collect[=field]\".\n"
+        "Without a field the item itself is used, without options the\n"
+        "items of each group are collected. None values are skipped by\n"
+        "sum, min and max." },
+
+    // Execution commands
+    { "EVAL", &EVAL, "Execution",
+        "EVAL: Evaluate an object",
+        "obj EVAL => ...",
+        "" },
+    { "CALL", &CALL, "Execution",
+        "CALL: Call a program",
+        "\"name\" CALL => ...",
+        "Equivilent to name RCLA EVAL\n"
+        "() is a synonym for CALL" },
+    { "SYSTEM", &SYSTEM, "Execution",
+        "SYSTEM or !: Execute the command at L0",
+        "\"command line\" SYSTEM =>",
+        "No output is captured" },
+    { "INTERRUPT", &INTERRUPT, "Execution",
+        "INTERRUPT: Set the interrupt flag",
+        "INTERRUPT => ...",
+        "Interrupt performs the same action as CTRL-C.\n"
+        "It will stop loops and break out of a program execution" },
+    { "ALIAS", &ALIAS, "Execution",
+        "ALIAS: Set alias for a shell command",
+        "\"command\" \"name\" ALIAS => ",
+        "" },
+
+    // Environment
+    { "NAMESPACES", &NAMESPACES, "Environment",
+        "NAMESPACES: List namespaces",
+        "NAMESPACES => [list]",
+        "See also: SETNS GETNS =>" },
+    { "SETNS", &SETNS, "Environment",
+        "SETNS: Create or change namespace",
+        "\"namespace\" SETNS =>",
+        "See also: GETNS NAMESPACES =>" },
+    { "GETNS", &GETNS, "Environment",
+        "GETNS: Push current namespace",
+        "GETNS => \"namespace\"",
+        "See also: SETNS NAMESPACES =>" },
+    { "CD", &CD, "Environment",
+        "CD: Change current dir",
+        "\"dir\" CD =>",
+        "" },
+    { "PWD", &PWD, "Environment",
+        "PWD: Present wqorking directory",
+        "PWD => \"dir\"",
+        "" },
+    { "HELP", &HELP, "Environment",
+        "HELP: HELP system",
+        "HELP =>",
+        "" },
+    { "GETPROPERTY", &GETPROPERTY, "Environment",
+        "GETPROPERTY: Get a property",
+        "name GETPROPERTY => value",
+        "" },
+    { "SETPROPERTY", &SETPROPERTY, "Environment",
+        "SETPROPERTY: Set a property",
+        "name value SETPROPERTY => ",
+        "" },
+    { "LISTPROPERTIES", &LISTPROPERTIES, "Environment",
+        "LISTPROPERTIES: List properties",
+        "LISTPROPERTIES => [list]",
+        "" },
+    { "HEAPSTATS", &HEAPSTATS, "Environment",
+        "HEAPSTATS: Print object heap counters",
+        "HEAPSTATS =>",
+        "allocated and freed count objects created and destroyed, reused counts\n"
+        "allocations served from a free list and chunks the memory requested\n"
+        "from the system for the size classes. released counts chunks given\n"
+        "back once every block in them was free, which is checked after\n"
+        "PAPPLY, PFILTER and PREDUCE. The counters of all threads are added\n"
+        "up." },
+    { "IMPORT", &IMPORT, "Environment",
+        "IMPORT: Import and execute a file",
+        "name IMPORT => ",
+        "" },
+
+    // String
+    { "FORMAT", &FORMAT, "String",
+        "FORMAT: Format a string",
+        "\"str\" FORMAT => \"str\"",
+        "todo: Format description..." },
+    { "CAT", &CAT, "String",
+        "CAT: Concatenate two strings",
+        "\"str1\" \"str2\" CAT => \"str1str2\"",
+        "" },
+    { "JOIN", &JOIN, "String",
+        "JOIN: Joins a list into a string",
+        "[list] \"delim\" JOIN =>\"str\"",
+        "delim: The string to join with" },
+    { "SUBSTR", &SUBSTR, "String",
+        "SUBSTR: Return substring given startpos and length",
+        "\"str\" startpos length SUBSTR => \"str\"",
+        "If length is <= 0, return substr to end of string" },
+    { "SUBSTRPOS", &SUBSTRPOS, "String",
+        "SUBSTRPOS: Return substr given startpos and endpos",
+        "\"str\" startpos endpos SUBSTRPOS => \"str\"",
+        "If endpos is <= startpos, return substr to end of string" },
+    { "STRFIND", &STRFIND, "String",
+        "STRFIND: Find a string",
+        "\"str\" startpos \"str to find\" STRFIND => pos",
+        "Pushes -1 if the string is not found" },
+    { "STRFINDEND", &STRFINDEND, "String",
+        "STRFINDEND: Find the end of a string",
+        "\"str\" startpos \"str to find\" STRFINDEND => pos",
+        "Pushes -1 if the string is not found\n"
+        "This function returns the position of the end of the found string" },
+    { "STRCMP", &STRCMP, "String",
+        "STRCMP: Compare two strings",
+        "\"str1\" \"str2\" STRCMP => int",
+        "Pushes <0, 0 or >0" },
+    { "STRNCMP", &STRNCMP, "String",
+        "STRNCMP: Compare two strings for the given length",
+        "\"str1\" \"str2\" length STRNCMP => int",
+        "Pushes <0, 0 or >0" },
+    { "SPLIT", &SPLIT, "String",
+        "SPLIT: Split a string",
+        "\"str\" \"delim\" opts SPLIT => [list]",
+        "delims: Set of delimiter chars to split with\n"
+        "opts: Optional arguments\n"
+        "     --collapse: Merge empty strings\n"
+        "     --n: Max number of splits" },
+    { "STRBEGIN", &STRBEGIN, "String",
+        "STRBEGIN: Does string begin with the given str",
+        "\"str\" \"str\" STRBEGIN => int",
+        "" },
+    { "STREND", &STREND, "String",
+        "STREND: Does string end with the given str",
+        "\"str\" \"str\" STREND => int",
+        "" },
+    { "STRHAS", &STRHAS, "String",
+        "STRHAS: Does string contain the given str",
+        "\"str\" \"str\" STRHAS => int",
+        "" },
+    { "STRCSPN", &STRCSPN, "String",
+        "STRCSPN: Returns pos of delimiter",
+        "\"str\" startpos \"delims\" STRCSPN => int",
+        "" },
+    { "RMATCH", &RMATCH, "String",
+        "RMATCH: Does string contain a match for a regular expression",
+        "\"str\" \"pattern\" RMATCH => int",
+        "Use ^ and $ to match the whole string.\n"
+        "Syntax: . [a-z] [^a-z] \\d \\w \\s \\D \\W \\S \\b \\B ^ $ ( ) (?: ) |\n"
+        "        * + ? {n} {n,} {n,m} and the lazy forms *? +? ?? {n,m}?\n"
+        "Patterns run in linear time and are compiled once and cached.\n"
+        "A string literal keeps a backslash it has no escape for, so\n"
+        "\"\\d\" and \"\\\\d\" are both the pattern \\d." },
+    { "RSEARCH", &RSEARCH, "String",
+        "RSEARCH: Find a regular expression",
+        "\"str\" startpos \"pattern\" RSEARCH => pos",
+        "Pushes -1 if there is no match, see RMATCH for the syntax" },
+    { "RREPLACE", &RREPLACE, "String",
+        "RREPLACE: Replace all matches of a regular expression",
+        "\"str\" \"pattern\" \"replacement\" RREPLACE => \"str\"",
+        "\\0 in the replacement is the match and \\1 to \\9 its groups" },
+    { "RCAPTURE", &RCAPTURE, "String",
+        "RCAPTURE: The groups of the first match of a regular expression",
+        "\"str\" \"pattern\" RCAPTURE => [match group1...groupn]",
+        "Pushes an empty list if there is no match, a group that is not\n"
+        "part of the match is an empty string" },
+    { "PBPARSE", &PBPARSE, "String",
+        "PBPARSE: Parse a protobuf in text format into a map",
+        "\"pb\" PBPARSE => {map}",
+        "name: value fields map the name to the value as a string,\n"
+        "name { ... } and name < ... > to a map of the fields inside.\n"
+        "The values of a field seen more than once are put in a list.\n"
+        "Quoted values are unescaped. Field names are interned." },
+    { "PBFIELDS", &PBFIELDS, "String",
+        "PBFIELDS: Extract fields from a protobuf in text format",
+        "\"pb\" [\"path1\"...\"pathn\"] PBFIELDS => [value1...valuen]",
+        "A path names a field inside messages with dots, \"order.price\".\n"
+        "The first value of each path is returned, or None if there is\n"
+        "none. The text is read once and only as far as it is needed." },
+    { "KVPARSE", &KVPARSE, "String",
+        "KVPARSE: Parse the key=value pairs of a string into a map",
+        "\"str\" [\"--sep=chars\"] KVPARSE => {map}",
+        "Pairs are separated by blanks or by any of --sep. A value in\n"
+        "double quotes may hold separators. Words without = are skipped\n"
+        "and the values of a key seen more than once are put in a list." },
+    { "KVFIELDS", &KVFIELDS, "String",
+        "KVFIELDS: Extract the values of keys from key=value pairs",
+        "\"str\" [\"key1\"...\"keyn\"] [\"--sep=chars\"] KVFIELDS => [value1...valuen]",
+        "The first value of each key, or None if there is none" },
+
+    // Types
+    { "TOINT", &TOINT, "Types",
+        "TOINT: Convert to integer",
+        "obj TOINT => int",
+        "" },
+    { "TOSTR", &TOSTR, "Types",
+        "TOSTR: Convert to string",
+        "obj TOSTR => \"str\"",
+        "" },
+    { "TYPE", &TYPE, "Types",
+        "TYPE: Pushes the type of object at L0",
+        "obj TYPE => \"str\"",
+        "" },
+    { "CLONE", &CLONE, "Types",
+        "CLONE: Clone the object at L0",
+        "obj CLONE => obj obj",
+        "" },
+
+    // IO
+    { "PRINT", &PRINT, "IO",
+        "PRINT: Print the object at L0 according to the rules of TOSTR",
+        "\"str\" => ",
+        "" },
+    { "PROMPT", &PROMPT, "IO",
+        "PROMPT: Prompt for user input",
+        "\"prompt\" => \"response\"",
+        "" },
+    { "PREAD", &PREAD, "IO",
+        "PREAD: Capture process output into a list",
+        "\"command line\" opts PREAD => [dstlist]",
+        "opts: --limit=n  Read a maximum of n lines of data\n"
+        "      --lazy     Return a Stream that reads the lines as they are used" },
+    { "GREP", &GREP, "IO",
+        "GREP: Find the lines of files holding a string",
+        "\"filename\" \"string\" opts GREP => [[offset lineno line]...]\n"
+        "[filenames] \"string\" opts GREP => [[filename offset lineno line]...]",
+        "opts: --regex  The string is a regular expression, see RMATCH\n"
+        "Other strings starting with -- are searched for.\n"
+        "offset is the byte offset of the line in its file and lineno\n"
+        "counts from 1, like grep -b -n. The files are searched in parallel.\n"
+        "gzip files are searched while they are decompressed, offsets are\n"
+        "in the decompressed data." },
+    { "FREAD", &FREAD, "IO",
+        "FREAD: Capture a file into a list",
+        "\"filename\" opts FREAD => [list]",
+        "opts: --limit=n  Read a maximum of n lines of data\n"
+        "      --lazy     Return a Stream that reads the lines as they are used\n"
+        "gzip files are decompressed while the lines are read" },
+    { "PWRITE", &PWRITE, "IO",
+        "PWRITE: Write object at L1 to the commandline on L0",
+        "\"obj\" \"command line\" PWRITE =>",
+        "" },
+    { "FWRITE", &FWRITE, "IO",
+        "FWRITE: Write list at L1 to the file on L0",
+        "[list] \"filename\" FWRITE =>",
+        "" },
+    { "FSAVE", &FSAVE, "IO",
+        "FSAVE: Write obj at L1 to the file on L0",
+        "obj \"filename\" FSAVE =>",
+        "FSAVE/FRESTORE is suitable for writing any object to a file for editing or\n"
+        "archiving.\n"
+        "See also: FRESTORE" },
+    { "FRESTORE", &FRESTORE, "IO",
+        "FRESTORE: Restore a saved Object",
+        "\"filename\" FRESTORE => obj",
+        "Restore an object save with FSAVE" },
+};
+
+const size_t command_table_size = sizeof(command_table) / sizeof(command_table[0]);
+
+void RegisterCommands(Machine& machine)
+{
+    machine.commands.reserve(command_table_size + 2);
+    for (size_t i = 0; i < command_table_size; ++i)
+        AddCommand(machine, command_table[i]);
+
+    AddSynonym(machine, "%", "RCLA");
+    AddSynonym(machine, "()", "CALL");
+
+    // Commands that work on more than one type
+    Category(machine, "Map", "ERASE");
+    Category(machine, "Map", "CLEAR");
+    Category(machine, "Map", "SIZE");
+    Category(machine, "String", "SIZE");
+    Category(machine, "Table", "SIZE");
+    Category(machine, "String", "CLEAR");
+}
+
+} // namespace rps
+
@@ -37,10 +37,17 @@ void DEC(Machine& machine);
 void STO(Machine& machine);
 void RCL(Machine& machine);
 void RCL(Machine& machine, const std::string& name, ObjectPtr& out);
+bool FindGlobal(Machine& machine, const std::string& name, ObjectPtr& out);
 void STOL(Machine& machine);
 void RCLL(Machine& machine);
 void RCLL(Machine& machine, const std::string& name, ObjectPtr& out);
+bool FindLocal(Machine& machine, const std::string& name, ObjectPtr& out);
 void RCLA(Machine& machine);
+void StoreLocal(Machine& machine, size_t slot, const std::string& name, ObjectPtr& optr);
+bool RecallLocal(Machine& machine, size_t slot, const std::string& name, ObjectPtr& out);
+ObjectPtr *LookupGlobal(Machine& machine, GlobalCache& cache);
+void RecallGlobal(Machine& machine, GlobalCache& cache, const std::string& name, ObjectPtr& out);
+void StoreGlobal(Machine& machine, GlobalCache& cache, ObjectPtr& optr);
 void VARNAMES(Machine& machine);
 void VARTYPES(Machine& machine);
 void VARS(Machine& machine);
@@ -87,6 +94,11 @@ void FROMLIST(Machine&);
 void CREATELIST(Machine&);
 void UNIQUE(Machine&);
 void REVERSE(Machine&);
+void SORT(Machine&);
+void SORTBY(Machine&);
+void TOPK(Machine&);
+void COLLECT(Machine&);
+void LAZY(Machine&);
 void ZIP(Machine&);
 void UNZIP(Machine&);
 
@@ -99,6 +111,19 @@ void CREATEMAP(Machine&);
 void KEYS(Machine&);
 void VALUES(Machine&);
 
+// Table
+void TABLE(Machine&);
+void TSELECT(Machine&);
+void TEQ(Machine&);
+void TNE(Machine&);
+void TLT(Machine&);
+void TLE(Machine&);
+void TGT(Machine&);
+void TGE(Machine&);
+void TROWS(Machine&);
+void TCOLUMN(Machine&);
+void TNAMES(Machine&);
+
 // Functional
 void APPLY(Machine& machine);
 void APPLY1(Machine& machine);
@@ -107,6 +132,10 @@ void FILTER1(Machine& machine);
 void MAP(Machine& machine);
 void MAP1(Machine& machine);
 void REDUCE(Machine& machine);
+void PAPPLY(Machine& machine);
+void PFILTER(Machine& machine);
+void PREDUCE(Machine& machine);
+void GROUPBY(Machine& machine);
 
 // IO commands
 void PRINT(Machine&);
@@ -114,6 +143,7 @@ void PROMPT(Machine&);
 void PREAD(Machine&);
 void PWRITE(Machine&);
 void FREAD(Machine&);
+void GREP(Machine&);
 void FWRITE(Machine&);
 void FSAVE(Machine&);
 void FRESTORE(Machine&);
@@ -135,6 +165,14 @@ void STRBEGIN(Machine&);
 void STREND(Machine&);
 void STRHAS(Machine&);
 void STRCSPN(Machine&);
+void RMATCH(Machine&);
+void RSEARCH(Machine&);
+void RREPLACE(Machine&);
+void RCAPTURE(Machine&);
+void PBPARSE(Machine&);
+void PBFIELDS(Machine&);
+void KVPARSE(Machine&);
+void KVFIELDS(Machine&);
 
 // Types
 void TOINT(Machine&);
@@ -160,6 +198,13 @@ void SETPROPERTY(Machine&);
 void LISTPROPERTIES(Machine&);
 void HELP(Machine&);
 void IMPORT(Machine&);
+void HEAPSTATS(Machine&);
 
+/*
+ * Builtin command descriptors
+ */
+extern const CommandInfo command_table[];
+extern const size_t command_table_size;
+void RegisterCommands(Machine&);
 
 } // namespace rps
@@ -0,0 +1,227 @@
+#include <vector>
+#include <unordered_map>
+#include <cassert>
+#include <mutex>
+#include "token.h"
+#include "object.h"
+#include "module.h"
+#include "machine.h"
+#include "commands.h"
+#include "compiler.h"
+
+namespace rps
+{
+
+void CompileVector(Machine& machine, Code& code, Program *pp, std::vector<ObjectPtr>& vec);
+
+void CompileObject(Machine& machine, Code& code, Program *pp, ObjectPtr& optr)
+{
+    std::vector<Instruction>& ins = code.instructions;
+    switch(optr->type)
+    {
+    case OBJECT_STRING:
+    case OBJECT_INTEGER:
+    case OBJECT_NONE:
+    case OBJECT_LIST:
+    case OBJECT_MAP:
+    case OBJECT_PROGRAM:
+        ins.emplace_back(OP_PUSH);
+        ins.back().obj = optr;
+        break;
+    case OBJECT_COMMAND:
+        {
+            Command *cmd = (Command *)optr.get();
+            if (cmd->program)
+            {
+                ins.emplace_back(OP_PROGRAM);
+                ins.back().obj = cmd->program;
+            }
+            else
+            {
+                ins.emplace_back(OP_COMMAND);
+                ins.back().funcptr = cmd->funcptr;
+                ins.back().obj = optr;
+            }
+        }
+        break;
+    case OBJECT_IF:
+        {
+            If *p = (If *)optr.get();
+            CompileVector(machine, code, pp, p->cond);
+            size_t jfalse = ins.size();
+            ins.emplace_back(OP_JUMP_FALSE);
+            CompileVector(machine, code, pp, p->then);
+            if (p->els.size())
+            {
+                size_t jend = ins.size();
+                ins.emplace_back(OP_JUMP);
+                ins[jfalse].arg = ins.size();
+                CompileVector(machine, code, pp, p->els);
+                ins[jend].arg = ins.size();
+            }
+            else
+                ins[jfalse].arg = ins.size();
+        }
+        break;
+    case OBJECT_FOR:
+        {
+            For *p = (For *)optr.get();
+            size_t begin = ins.size();
+            ins.emplace_back(OP_FOR_BEGIN);
+            size_t next = ins.size();
+            ins.emplace_back(OP_FOR_NEXT);
+            CompileVector(machine, code, pp, p->program);
+            ins.emplace_back(OP_JUMP);
+            ins.back().arg = next;
+            ins[begin].arg = ins.size();
+            ins[next].arg = ins.size();
+            code.handlers.push_back(LoopHandler{begin, ins.size(), 0});
+        }
+        break;
+    case OBJECT_WHILE:
+        {
+            While *p = (While *)optr.get();
+            size_t begin = ins.size();
+            CompileVector(machine, code, pp, p->cond);
+            size_t jfalse = ins.size();
+            ins.emplace_back(OP_JUMP_FALSE);
+            CompileVector(machine, code, pp, p->program);
+            ins.emplace_back(OP_JUMP);
+            ins.back().arg = begin;
+            ins[jfalse].arg = ins.size();
+            code.handlers.push_back(LoopHandler{begin, ins.size(), 0});
+        }
+        break;
+    case OBJECT_TOKEN:
+        break;
+    default:
+        assert(false);
+        break;
+    }
+}
+
+// A literal name followed by one of the variable commands is compiled
+// into a single instruction bound to a frame slot or a global cache.
+// Returns OP_PUSH if the pair can not be fused.
+OpCode FusedOp(Program *pp, ObjectPtr& name, ObjectPtr& next)
+{
+    if (name->type != OBJECT_STRING || next->type != OBJECT_COMMAND)
+        return OP_PUSH;
+    void (*funcptr)(Machine&) = ((Command *)next.get())->funcptr;
+    if (funcptr == (void (*)(Machine&))&RCL)
+        return OP_RECALL_GLOBAL;
+    if (funcptr == &STO)
+        return OP_STORE_GLOBAL;
+    if (funcptr == &APPLY || funcptr == &FILTER || funcptr == &MAP)
+        return OP_PUSH_PROGRAM;
+    // the rest need the frame of a program
+    if (pp == nullptr)
+        return OP_PUSH;
+    if (funcptr == &STOL)
+        return OP_STORE_LOCAL;
+    if (funcptr == (void (*)(Machine&))&RCLL)
+        return OP_RECALL_LOCAL;
+    if (funcptr == &RCLA)
+        return OP_RECALL;
+    if (funcptr == &CALL)
+        return OP_CALL;
+    return OP_PUSH;
+}
+
+int32_t AddGlobal(Machine& machine, Code& code, const std::string& name)
+{
+    GlobalCache cache;
+    cache.symbol = &machine.Intern(name);
+    cache.module = nullptr;
+    cache.slot = 0;
+    cache.generation = 0;
+    code.globals.push_back(cache);
+    return code.globals.size() - 1;
+}
+
+void CompileVector(Machine& machine, Code& code, Program *pp, std::vector<ObjectPtr>& vec)
+{
+    for (size_t idx = 0; idx < vec.size(); ++idx)
+    {
+        OpCode op = OP_PUSH;
+        if (idx + 1 < vec.size())
+            op = FusedOp(pp, vec[idx], vec[idx+1]);
+        if (op == OP_PUSH)
+        {
+            CompileObject(machine, code, pp, vec[idx]);
+            continue;
+        }
+        const std::string& name = ((String *)vec[idx].get())->get();
+        code.instructions.emplace_back(op);
+        Instruction& in = code.instructions.back();
+        in.obj = vec[idx];
+        if (op == OP_STORE_LOCAL || op == OP_RECALL_LOCAL || op == OP_RECALL || op == OP_CALL)
+            in.arg = pp->AddLocal(name);
+        if (op != OP_STORE_LOCAL && op != OP_RECALL_LOCAL)
+            in.global = AddGlobal(machine, code, name);
+        // APPLY, FILTER and MAP still run, with the program already resolved
+        if (op != OP_PUSH_PROGRAM)
+            ++idx;
+    }
+}
+
+// Count the FOR loops enclosing each handler, this is the number of
+// iterators the interpreter must keep when the loop reports an error.
+void SetHandlerDepths(Code& code)
+{
+    for (LoopHandler& h : code.handlers)
+    {
+        h.depth = 0;
+        for (LoopHandler& outer : code.handlers)
+        {
+            if (&outer == &h)
+                continue;
+            if (outer.begin <= h.begin && h.end <= outer.end
+                    && code.instructions[outer.begin].op == OP_FOR_BEGIN)
+                ++h.depth;
+        }
+    }
+}
+
+CodePtr Compile(Machine& machine, ObjectPtr optr)
+{
+    CodePtr code;
+    code.reset(new Code());
+    if (optr->type == OBJECT_PROGRAM)
+    {
+        Program *pp = (Program *)optr.get();
+        CompileVector(machine, *code, pp, pp->program);
+    }
+    else
+        CompileObject(machine, *code, nullptr, optr);
+    SetHandlerDepths(*code);
+    return code;
+}
+
+namespace
+{
+std::mutex compile_mutex;
+}
+
+Code& GetCode(Machine& machine, ObjectPtr& optr)
+{
+    Program *pp = (Program *)optr.get();
+    if (machine.parent_)
+    {
+        // Workers compile what they run the first time they run it, the
+        // code is published atomically so later runs take no lock
+        CodePtr code = std::atomic_load(&pp->code);
+        if (code)
+            return *code;
+        std::lock_guard<std::mutex> lock(compile_mutex);
+        if (!pp->code)
+            std::atomic_store(&pp->code, Compile(machine, optr));
+        return *pp->code;
+    }
+    if (!pp->code)
+        pp->code = Compile(machine, optr);
+    return *pp->code;
+}
+
+} // namespace rps
+
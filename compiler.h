@@ -0,0 +1,74 @@
+#pragma once
+#include <vector>
+#include <memory>
+
+namespace rps
+{
+
+class Machine;
+
+/*
+ * A parsed Program is a tree of Objects. Before it is executed it is
+ * lowered into a flat array of instructions. IF, FOR and WHILE become
+ * jumps and commands are bound to their function pointers, so the
+ * interpreter loop never has to look at Object::type.
+ */
+enum OpCode
+{
+    OP_PUSH             // push obj
+    , OP_COMMAND        // call funcptr
+    , OP_PROGRAM        // EVAL a registered program, obj is the Program
+    , OP_JUMP           // continue at arg
+    , OP_JUMP_FALSE     // pop L0, continue at arg if it is false
+    , OP_FOR_BEGIN      // pop the List or Map at L0 and start iterating, arg is the loop exit
+    , OP_FOR_NEXT       // push the next item, or finish the loop and continue at arg
+    , OP_STORE_LOCAL    // "name" STOL, arg is the frame slot and obj the name
+    , OP_RECALL_LOCAL   // "name" RCLL
+    , OP_RECALL         // "name" RCLA, global is the cache used if there is no local
+    , OP_RECALL_GLOBAL  // "name" RCL, global is the index into Code::globals
+    , OP_STORE_GLOBAL   // "name" STO
+    , OP_CALL           // "name" CALL, resolved like OP_RECALL then evaluated
+    , OP_PUSH_PROGRAM   // push the global program named by obj, or obj if there is none
+};
+
+struct Instruction
+{
+    Instruction(OpCode o)
+    :op(o)
+    ,arg(0)
+    ,global(0)
+    ,funcptr(nullptr)
+    {}
+
+    OpCode op;
+    int32_t arg;
+    int32_t global;
+    void (*funcptr)(Machine&);
+    ObjectPtr obj;
+};
+
+// FOR and WHILE report errors raised inside the loop and carry on
+// after it. A handler covers the instructions [begin, end) of a loop.
+struct LoopHandler
+{
+    size_t begin;
+    size_t end;
+    size_t depth;       // number of FOR iterators active when the loop starts
+};
+
+class Code
+{
+public:
+    std::vector<Instruction> instructions;
+    std::vector<LoopHandler> handlers;      // innermost loops first
+    std::vector<GlobalCache> globals;       // inline caches of global lookups
+};
+
+typedef std::shared_ptr<Code> CodePtr;
+
+CodePtr Compile(Machine&, ObjectPtr);
+Code& GetCode(Machine&, ObjectPtr&);
+void Run(Machine&, Code&);
+
+} // namespace rps
+
@@ -15,12 +15,6 @@ namespace rps
 
 void IFT(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "Help not available";
-        return;
-    }
-
     if (machine.stack_.size() < 2)
         throw std::runtime_error("IFT: stack underflow");
     ObjectPtr cond;
@@ -45,12 +39,6 @@ void IFT(Machine& machine)
 
 void IFTE(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "Help not available";
-        return;
-    }
-
     if (machine.stack_.size() < 3)
         throw std::runtime_error("IFTE: stack underflow");
     ObjectPtr cond;
@@ -79,12 +67,6 @@ void IFTE(Machine& machine)
 
 void TRYCATCH(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "Help not available";
-        return;
-    }
-
     if (machine.stack_.size() < 2)
         throw std::runtime_error("TRYCATCH: stack underflow");
     ObjectPtr try_;
@@ -19,13 +19,6 @@ namespace rps
 
 void NAMESPACES(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "NAMESPACES: List namespaces";
-        machine.helpstrm() << "NAMESPACES => [list]";
-        machine.helpstrm() << "See also: SETNS GETNS =>";
-        return;
-    }
     ListPtr lp = MakeList();
     for (auto& pr : machine.modules_)
     {
@@ -38,13 +31,6 @@ void NAMESPACES(Machine& machine)
 
 void SETNS(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "SETNS: Create or change namespace";
-        machine.helpstrm() << "\"namespace\" SETNS =>";
-        machine.helpstrm() << "See also: GETNS NAMESPACES =>";
-        return;
-    }
     stack_required(machine, "SETNS", 1);
     throw_required(machine, "SETNS", 0, OBJECT_STRING);
 
@@ -55,25 +41,12 @@ void SETNS(Machine& machine)
 }
 
 void GETNS(Machine& machine)
-{ 
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "GETNS: Push current namespace";
-        machine.helpstrm() << "GETNS => \"namespace\"";
-        machine.helpstrm() << "See also: SETNS NAMESPACES =>";
-        return;
-    }
+{
     machine.push(machine.current_module_);
 }
 
 void CD(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "CD: Change current dir";
-        machine.helpstrm() << "\"dir\" CD =>";
-        return;
-    }
     stack_required(machine, "CD", 1);
     throw_required(machine, "CD", 0, OBJECT_STRING);
 
@@ -84,13 +57,6 @@ void CD(Machine& machine)
 
 void PWD(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "PWD: Present wqorking directory";
-        machine.helpstrm() << "PWD => \"dir\"";
-        return;
-    }
-
     char *p = getcwd(nullptr, 0);
     std::string s(p);
     free(p);
@@ -99,13 +65,6 @@ void PWD(Machine& machine)
 
 void SETPROPERTY(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "SETPROPERTY: Set a property";
-        machine.helpstrm() << "name value SETPROPERTY => ";
-        return;
-    }
-
     stack_required(machine, "SETPROPERTY", 2);
     throw_required(machine, "SETPROPERTY", 1, OBJECT_STRING);
 
@@ -119,13 +78,6 @@ void SETPROPERTY(Machine& machine)
 
 void GETPROPERTY(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "GETPROPERTY: Get a property";
-        machine.helpstrm() << "name GETPROPERTY => value";
-        return;
-    }
-
     stack_required(machine, "GETPROPERTY", 1);
     throw_required(machine, "GETPROPERTY", 0, OBJECT_STRING);
 
@@ -139,13 +91,6 @@ void GETPROPERTY(Machine& machine)
 
 void LISTPROPERTIES(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "LISTPROPERTIES: List properties";
-        machine.helpstrm() << "LISTPROPERTIES => [list]";
-        return;
-    }
-
     ListPtr lp = MakeList();
     for (auto& pr : machine.properties)
     {
@@ -156,15 +101,20 @@ void LISTPROPERTIES(Machine& machine)
     machine.push(lp);
 }
 
-void IMPORT(Machine& machine)
+void HEAPSTATS(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "IMPORT: Import and execute a file";
-        machine.helpstrm() << "name IMPORT => ";
-        return;
-    }
+    HeapStats stats = TotalHeapStats();
+    std::cout << "allocated: " << stats.allocated << std::endl;
+    std::cout << "freed:     " << stats.freed << std::endl;
+    std::cout << "live:      " << stats.allocated - stats.freed << std::endl;
+    std::cout << "reused:    " << stats.reused << std::endl;
+    std::cout << "chunks:    " << stats.chunks << std::endl;
+    std::cout << "released:  " << stats.released << std::endl;
+    std::cout << "large:     " << stats.large << std::endl;
+}
 
+void IMPORT(Machine& machine)
+{
     stack_required(machine, "IMPORT", 1);
     throw_required(machine, "IMPORT", 0, OBJECT_STRING);
 
@@ -11,18 +11,211 @@
 #include "machine.h"
 #include "commands.h"
 #include "utilities.h"
+#include "compiler.h"
 
 namespace rps
 {
 
-void Execute(Machine& machine, std::vector<ObjectPtr>& vec)
+struct ForIterator
 {
-    for (ObjectPtr& op : vec)
+    StreamPtr stream;
+    ListPtr list;
+    std::vector<std::pair<ObjectPtr, ObjectPtr>> pairs;
+    size_t idx;
+};
+
+LoopHandler *FindHandler(Code& code, size_t pc)
+{
+    for (LoopHandler& h : code.handlers)
     {
-        //std::cout << "=== machine::Execute vecsize: " << vec.size() << std::endl;
-        if (bInterrupt)
-            return;
-        Execute(machine, op);
+        if (h.begin <= pc && pc < h.end)
+            return &h;
+    }
+    return nullptr;
+}
+
+void Run(Machine& machine, Code& code)
+{
+    std::vector<ForIterator> iters;
+    std::vector<Instruction>& ins = code.instructions;
+    size_t pc = 0;
+    while (pc < ins.size())
+    {
+        try
+        {
+            while (pc < ins.size())
+            {
+                if (bInterrupt)
+                    return;
+                Instruction& in = ins[pc];
+                switch (in.op)
+                {
+                case OP_PUSH:
+                    machine.push(in.obj);
+                    ++pc;
+                    break;
+                case OP_COMMAND:
+                    (*in.funcptr)(machine);
+                    ++pc;
+                    break;
+                case OP_PROGRAM:
+                    EVAL(machine, in.obj);
+                    ++pc;
+                    break;
+                case OP_JUMP:
+                    pc = in.arg;
+                    break;
+                case OP_STORE_LOCAL:
+                    {
+                        ObjectPtr optr;
+                        machine.pop(optr);
+                        StoreLocal(machine, in.arg, ((String *)in.obj.get())->get(), optr);
+                        ++pc;
+                    }
+                    break;
+                case OP_RECALL_LOCAL:
+                    {
+                        const std::string& name = ((String *)in.obj.get())->get();
+                        ObjectPtr optr;
+                        if (!RecallLocal(machine, in.arg, name, optr))
+                        {
+                            std::stringstream strm;
+                            strm << "RCLL local Variable " << name << " not found";
+                            throw std::runtime_error(strm.str().c_str());
+                        }
+                        machine.push(optr);
+                        ++pc;
+                    }
+                    break;
+                case OP_RECALL:
+                case OP_CALL:
+                    {
+                        const std::string& name = ((String *)in.obj.get())->get();
+                        ObjectPtr optr;
+                        if (!RecallLocal(machine, in.arg, name, optr))
+                            RecallGlobal(machine, code.globals[in.global], name, optr);
+                        ++pc;
+                        if (in.op == OP_CALL)
+                            EVAL(machine, optr);
+                        else
+                            machine.push(optr);
+                    }
+                    break;
+                case OP_RECALL_GLOBAL:
+                    {
+                        ObjectPtr optr;
+                        RecallGlobal(machine, code.globals[in.global], ((String *)in.obj.get())->get(), optr);
+                        machine.push(optr);
+                        ++pc;
+                    }
+                    break;
+                case OP_STORE_GLOBAL:
+                    {
+                        ObjectPtr optr;
+                        machine.pop(optr);
+                        StoreGlobal(machine, code.globals[in.global], optr);
+                        ++pc;
+                    }
+                    break;
+                case OP_PUSH_PROGRAM:
+                    {
+                        ObjectPtr *optr = LookupGlobal(machine, code.globals[in.global]);
+                        if (optr && (*optr)->type == OBJECT_PROGRAM)
+                            machine.push(*optr);
+                        else
+                            machine.push(in.obj);
+                        ++pc;
+                    }
+                    break;
+                case OP_JUMP_FALSE:
+                    {
+                        ObjectPtr ob;
+                        machine.pop(ob);
+                        if (ToBool(machine, ob))
+                            ++pc;
+                        else
+                            pc = in.arg;
+                    }
+                    break;
+                case OP_FOR_BEGIN:
+                    if (machine.stack_.size() == 0)
+                    {
+                        std::cout << "FOR requires list, map or stream at L0" << std::endl;
+                        pc = in.arg;
+                    }
+                    else if (machine.peek(0)->type == OBJECT_LIST)
+                    {
+                        iters.emplace_back();
+                        machine.pop(iters.back().list);
+                        iters.back().idx = 0;
+                        ++pc;
+                    }
+                    else if (machine.peek(0)->type == OBJECT_STREAM)
+                    {
+                        iters.emplace_back();
+                        iters.back().stream = static_pointer_cast<Stream>(machine.peek(0));
+                        machine.pop();
+                        ++pc;
+                    }
+                    else if (machine.peek(0)->type == OBJECT_MAP)
+                    {
+                        MapPtr mp;
+                        machine.pop(mp);
+                        iters.emplace_back();
+                        iters.back().pairs.assign(mp->items.begin(), mp->items.end());
+                        iters.back().idx = 0;
+                        ++pc;
+                    }
+                    else
+                        pc = in.arg;
+                    break;
+                case OP_FOR_NEXT:
+                    {
+                        ForIterator& it = iters.back();
+                        ObjectPtr item;
+                        if (it.stream && it.stream->Next(machine, item))
+                        {
+                            machine.push(item);
+                            ++pc;
+                        }
+                        else if (it.stream)
+                        {
+                            iters.pop_back();
+                            pc = in.arg;
+                        }
+                        else if (it.list && it.idx < it.list->items.size())
+                        {
+                            machine.push(it.list->items[it.idx++]);
+                            ++pc;
+                        }
+                        else if (!it.list && it.idx < it.pairs.size())
+                        {
+                            ListPtr lp = MakeList();
+                            lp->items.push_back(it.pairs[it.idx].first);
+                            lp->items.push_back(it.pairs[it.idx].second);
+                            ++it.idx;
+                            machine.push(lp);
+                            ++pc;
+                        }
+                        else
+                        {
+                            iters.pop_back();
+                            pc = in.arg;
+                        }
+                    }
+                    break;
+                }
+            }
+        }
+        catch (std::exception& e)
+        {
+            LoopHandler *h = FindHandler(code, pc);
+            if (h == nullptr)
+                throw;
+            std::cout << e.what() << std::endl;
+            iters.resize(h->depth);
+            pc = h->end;
+        }
     }
 }
 
@@ -38,105 +231,28 @@ void Execute(Machine& machine, ObjectPtr optr)
         machine.push(optr);
         break;
     case OBJECT_LIST:
+    case OBJECT_STREAM:
+    case OBJECT_TABLE:
         machine.push(optr);
         break;
     case OBJECT_PROGRAM:
         machine.push(optr);
         break;
     case OBJECT_IF:
-        {
-            ObjectPtr ob;
-            If *p = (If *)optr.get();
-            Execute(machine, p->cond);
-            machine.pop(ob);
-            if (ToBool(machine, ob))
-                Execute(machine, p->then);
-            else
-                Execute(machine, p->els);
-        }
-        break;
     case OBJECT_FOR:
-        {
-            ObjectPtr ob;
-            For *p = (For *)optr.get();
-            try
-            {
-                if (machine.stack_.size() == 0)
-                    std::cout << "FOR requires list or map at L0" << std::endl;
-                else if (machine.peek(0)->type == OBJECT_LIST)
-                {
-                    ListPtr lp;
-                    machine.pop(lp);
-                    for (ObjectPtr op : lp->items)
-                    {
-                        if (bInterrupt)
-                            return;
-                        machine.push(op);
-                        Execute(machine, p->program);
-                    }
-                }
-                else if (machine.peek(0)->type == OBJECT_MAP)
-                {
-                    MapPtr mp;
-                    machine.pop(mp);
-                    for (auto& pr : mp->items)
-                    {
-                        if (bInterrupt)
-                            return;
-                        ListPtr lp = MakeList();
-                        lp->items.push_back(pr.first);
-                        lp->items.push_back(pr.second);
-                        machine.push(lp);
-                        Execute(machine, p->program);
-                    }
-                }
-            }
-            catch (std::exception& e)
-            {
-                std::cout << e.what() << std::endl;
-            }
-        }
-        break;
     case OBJECT_WHILE:
         {
-            ObjectPtr ob;
-            While *p = (While *)optr.get();
-            try
-            {
-                while (true)
-                {
-                    if (bInterrupt)
-                        return;
-                    Execute(machine, p->cond);
-                    ObjectPtr optr;
-                    machine.pop(optr);
-                    bool b = ToBool(machine, optr);
-                    if (b) 
-                    {
-                        Execute(machine, p->program);
-                    }
-                    else
-                        break;
-                }
-            }
-            catch (std::exception& e)
-            {
-                std::cout << e.what() << std::endl;
-            }
+            CodePtr code = Compile(machine, optr);
+            Run(machine, *code);
         }
         break;
     case OBJECT_COMMAND:
         {
-            CommandPtr cmd = std::static_pointer_cast<Command>(optr);
+            CommandPtr cmd = static_pointer_cast<Command>(optr);
             if (cmd->program)
                 EVAL(machine, cmd->program);
             else
-            {
-                if (cmd->value.back() == '?')
-                    ShowHelp(machine, cmd);
-                else
-                    (*cmd->funcptr)(machine);
-            }
+                (*cmd->funcptr)(machine);
         }
         break;
     case OBJECT_TOKEN:
@@ -176,29 +292,22 @@ void EVAL(Machine& machine, ObjectPtr optr)
         machine.push(optr);
         break;
     case OBJECT_LIST:
+    case OBJECT_STREAM:
+    case OBJECT_TABLE:
         machine.push(optr);
         break;
     case OBJECT_PROGRAM:
         {
-            ProgramPtr prev_program = machine.current_program;
-            machine.current_program = std::static_pointer_cast<Program>(optr);
-            std::string prev_module = machine.current_module_;
-            machine.current_module_ = machine.current_program->module_name;
+            Code& code = GetCode(machine, optr);
+            machine.PushFrame((Program *)optr.get());
             try
             {
-                std::unordered_map<std::string, ObjectPtr> locals;
-
-                machine.current_program->pLocals = &locals;
-                Execute(machine, machine.current_program->program);
-                machine.current_program->pLocals = nullptr;
-                machine.current_module_ = prev_module;
-                machine.current_program = prev_program;
+                Run(machine, code);
+                machine.PopFrame();
             }
             catch (std::exception& e)
             {
-                machine.current_program->pLocals = nullptr;
-                machine.current_module_ = prev_module;
-                machine.current_program = prev_program;
+                machine.PopFrame();
                 throw;
             }
         }
@@ -214,12 +323,6 @@ void EVAL(Machine& machine, ObjectPtr optr)
 
 void EVAL(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "EVAL: Evaluate an object";
-        machine.helpstrm() << "obj EVAL => ...";
-        return;
-    }
     ObjectPtr optr;
     machine.pop(optr);
     EVAL(machine, optr);
@@ -227,12 +330,6 @@ void EVAL(Machine& machine)
 
 void ALIAS(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "ALIAS: Set alias for a shell command";
-        machine.helpstrm() << "\"command\" \"name\" ALIAS => ";
-        return;
-    }
     std::string name;
     std::string command;
     machine.pop(name);
@@ -244,28 +341,12 @@ void ALIAS(Machine& machine)
 
 void CALL(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "CALL: Call a program";
-        machine.helpstrm() << "\"name\" CALL => ...";
-        machine.helpstrm() << "Equivilent to name RCLA EVAL";
-        machine.helpstrm() << "() is a synonym for CALL";
-        return;
-    }
     RCLA(machine);
     EVAL(machine);
 }
 
 void INTERRUPT(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "INTERRUPT: Set the interrupt flag";
-        machine.helpstrm() << "INTERRUPT => ...";
-        machine.helpstrm() << "Interrupt performs the same action as CTRL-C.";
-        machine.helpstrm() << "It will stop loops and break out of a program execution";
-        return;
-    }
     bInterrupt = true;
 }
 
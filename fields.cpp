@@ -0,0 +1,335 @@
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include "token.h"
+#include "object.h"
+#include "module.h"
+#include "machine.h"
+#include "fields.h"
+
+namespace rps
+{
+
+namespace
+{
+
+const size_t KEYS_MAX = 4096;   // the key table of a machine starts again after this
+
+bool IsNameChar(unsigned char ch)
+{
+    return isalnum(ch) || ch == '_';
+}
+
+// The bytes between protobuf fields, and the bytes that end an unquoted value
+const ByteSet pb_separators(" \t\r\n\v\f,;");
+const ByteSet pb_delimiters(" \t\r\n\v\f,;{}[]<>#");
+
+int HexDigit(unsigned char ch)
+{
+    if (ch >= '0' && ch <= '9')
+        return ch - '0';
+    if (ch >= 'a' && ch <= 'f')
+        return ch - 'a' + 10;
+    if (ch >= 'A' && ch <= 'F')
+        return ch - 'A' + 10;
+    return -1;
+}
+
+} // namespace
+
+std::string Unquote(const char *begin, const char *end)
+{
+    std::string result;
+    result.reserve(end - begin);
+    const char *p = begin;
+    while (p < end)
+    {
+        // adjacent strings are joined, "a" "b" is "ab"
+        char quote = *p++;
+        while (p < end && *p != quote)
+        {
+            if (*p != '\\' || p + 1 == end)
+            {
+                result += *p++;
+                continue;
+            }
+            ++p;
+            char ch = *p++;
+            switch (ch)
+            {
+            case 'n': result += '\n'; break;
+            case 't': result += '\t'; break;
+            case 'r': result += '\r'; break;
+            case 'a': result += '\a'; break;
+            case 'b': result += '\b'; break;
+            case 'f': result += '\f'; break;
+            case 'v': result += '\v'; break;
+            case 'x':
+            {
+                int value = 0;
+                int digits = 0;
+                for (int d; digits < 2 && p < end && (d = HexDigit(*p)) >= 0; ++digits, ++p)
+                    value = value * 16 + d;
+                result += digits ? char(value) : 'x';
+                break;
+            }
+            default:
+                if (ch >= '0' && ch <= '7')
+                {
+                    int value = ch - '0';
+                    for (int digits = 1; digits < 3 && p < end && *p >= '0' && *p <= '7'; ++digits, ++p)
+                        value = value * 8 + (*p - '0');
+                    result += char(value);
+                }
+                else
+                    result += ch;
+            }
+        }
+        if (p < end)
+            ++p;
+        while (p < end && isspace((unsigned char)*p))
+            ++p;
+    }
+    return result;
+}
+
+PbReader::PbReader(const char *cmd, const char *begin, const char *end)
+: cmd_(cmd)
+, begin_(begin)
+, p_(begin)
+, end_(end)
+, name_begin_(nullptr)
+, name_end_(nullptr)
+, value_begin_(nullptr)
+, value_end_(nullptr)
+, quoted_(false)
+{}
+
+void PbReader::Error(const char *what) const
+{
+    std::stringstream ss;
+    ss << cmd_ << ": " << what << " at offset " << (p_ - begin_);
+    throw std::runtime_error(ss.str());
+}
+
+// Fields may be separated by commas and semicolons as well as by spaces
+void PbReader::SkipSpace()
+{
+    for (;;)
+    {
+        p_ = pb_separators.Skip(p_, end_);
+        if (p_ == end_ || *p_ != '#')
+            break;
+        const char *eol = (const char *)memchr(p_, '\n', end_ - p_);
+        p_ = eol ? eol : end_;
+    }
+}
+
+void PbReader::Name()
+{
+    name_begin_ = p_;
+    if (*p_ == '[')
+    {
+        // an extension, [package.name]
+        while (p_ < end_ && *p_ != ']')
+            ++p_;
+        if (p_ == end_)
+            Error("missing ]");
+        ++p_;
+    }
+    else
+    {
+        while (p_ < end_ && IsNameChar(*p_))
+            ++p_;
+        if (p_ == name_begin_)
+            Error("expected a field name");
+    }
+    name_end_ = p_;
+}
+
+PbReader::Event PbReader::Value()
+{
+    if (p_ == end_)
+        Error("missing value");
+    if (*p_ == '{' || *p_ == '<')
+    {
+        open_ += *p_ == '{' ? '}' : '>';
+        ++p_;
+        return PB_BEGIN;
+    }
+    Scalar();
+    return PB_FIELD;
+}
+
+void PbReader::Scalar()
+{
+    value_begin_ = p_;
+    if (*p_ == '"' || *p_ == '\'')
+    {
+        quoted_ = true;
+        for (;;)
+        {
+            char quote = *p_++;
+            while (p_ < end_ && *p_ != quote)
+            {
+                if (*p_ == '\\' && p_ + 1 < end_)
+                    ++p_;
+                ++p_;
+            }
+            if (p_ == end_)
+                Error("unterminated string");
+            ++p_;
+            value_end_ = p_;
+            while (p_ < end_ && isspace((unsigned char)*p_))
+                ++p_;
+            if (p_ == end_ || (*p_ != '"' && *p_ != '\''))
+                break;
+        }
+        return;
+    }
+    quoted_ = false;
+    p_ = pb_delimiters.Find(p_, end_);
+    if (p_ == value_begin_)
+        Error("missing value");
+    value_end_ = p_;
+}
+
+PbReader::Event PbReader::Next()
+{
+    for (;;)
+    {
+        SkipSpace();
+        if (!open_.empty() && open_.back() == ']')
+        {
+            // the items of name: [a, b, { ... }] are each a name field
+            if (p_ == end_)
+                Error("missing ]");
+            if (*p_ == ']')
+            {
+                ++p_;
+                open_.pop_back();
+                lists_.pop_back();
+                continue;
+            }
+            name_begin_ = lists_.back().first;
+            name_end_ = lists_.back().second;
+            return Value();
+        }
+        if (p_ == end_)
+        {
+            if (!open_.empty())
+                Error(open_.back() == '}' ? "missing }" : "missing >");
+            return PB_DONE;
+        }
+        if (*p_ == '}' || *p_ == '>')
+        {
+            if (open_.empty() || open_.back() != *p_)
+                Error(*p_ == '}' ? "unexpected }" : "unexpected >");
+            ++p_;
+            open_.pop_back();
+            return PB_END;
+        }
+        Name();
+        while (p_ < end_ && isspace((unsigned char)*p_))
+            ++p_;
+        // the colon is optional before a message
+        if (p_ < end_ && *p_ == ':')
+        {
+            ++p_;
+            while (p_ < end_ && isspace((unsigned char)*p_))
+                ++p_;
+        }
+        if (p_ < end_ && *p_ == '[')
+        {
+            ++p_;
+            open_ += ']';
+            lists_.emplace_back(name_begin_, name_end_);
+            continue;
+        }
+        return Value();
+    }
+}
+
+std::string PbReader::value() const
+{
+    if (quoted_)
+        return Unquote(value_begin_, value_end_);
+    return std::string(value_begin_, value_end_);
+}
+
+KvReader::KvReader(const char *begin, const char *end, const std::string& seps)
+: p_(begin)
+, end_(end)
+, key_begin_(nullptr)
+, key_end_(nullptr)
+, value_begin_(nullptr)
+, value_end_(nullptr)
+, quoted_(false)
+, seps_(seps)
+, key_ends_(seps + '=')
+{}
+
+bool KvReader::Next()
+{
+    for (;;)
+    {
+        p_ = seps_.Skip(p_, end_);
+        if (p_ == end_)
+            return false;
+        key_begin_ = p_;
+        p_ = key_ends_.Find(p_, end_);
+        if (p_ == end_ || *p_ != '=' || p_ == key_begin_)
+        {
+            // not a pair, skip the word
+            p_ = seps_.Find(p_, end_);
+            continue;
+        }
+        key_end_ = p_++;
+        value_begin_ = p_;
+        quoted_ = p_ < end_ && *p_ == '"';
+        if (quoted_)
+        {
+            // an unterminated quote runs to the end of the line
+            ++p_;
+            while (p_ < end_ && *p_ != '"')
+            {
+                if (*p_ == '\\' && p_ + 1 < end_)
+                    ++p_;
+                ++p_;
+            }
+            if (p_ < end_)
+                ++p_;
+        }
+        else
+            p_ = seps_.Find(p_, end_);
+        value_end_ = p_;
+        return true;
+    }
+}
+
+std::string KvReader::value() const
+{
+    if (quoted_)
+        return Unquote(value_begin_, value_end_);
+    return std::string(value_begin_, value_end_);
+}
+
+void TrimKeys(Machine& machine)
+{
+    if (machine.keys_.size() >= KEYS_MAX)
+        machine.keys_.clear();
+}
+
+ObjectPtr InternKey(Machine& machine, const char *begin, const char *end)
+{
+    std::string name(begin, end);
+    auto it = machine.keys_.find(name);
+    if (it != machine.keys_.end())
+        return it->second;
+    ObjectPtr key(new String(name));
+    machine.keys_.emplace(std::move(name), key);
+    return key;
+}
+
+} // namespace rps
@@ -0,0 +1,107 @@
+#pragma once
+#include <string>
+#include <vector>
+#include "search.h"
+
+namespace rps
+{
+
+class Machine;
+
+/*
+ * Readers for the records in our logs: protobuf text format, as written
+ * by DebugString and ShortDebugString, and lines of key=value pairs.
+ * They walk the text once and hand out each field as a range of it, so
+ * a command can build a Map or pick out a few fields without copying
+ * anything it does not keep.
+ */
+class PbReader
+{
+public:
+    enum Event
+    {
+        PB_FIELD        // name: value
+        , PB_BEGIN      // name { starts a message
+        , PB_END        // } ends it
+        , PB_DONE       // the end of the text
+    };
+
+    // cmd names the command in errors
+    PbReader(const char *cmd, const char *begin, const char *end);
+
+    Event Next();
+
+    // The field name of PB_FIELD and PB_BEGIN
+    const char *name_begin() const { return name_begin_; }
+    const char *name_end() const { return name_end_; }
+    // The value of PB_FIELD as written, quotes included
+    const char *value_begin() const { return value_begin_; }
+    const char *value_end() const { return value_end_; }
+    bool quoted() const { return quoted_; }
+    // The value of PB_FIELD with quotes and escapes removed
+    std::string value() const;
+
+private:
+    void Error(const char *what) const;
+    void SkipSpace();
+    void Name();
+    Event Value();
+    void Scalar();
+
+    const char *cmd_;
+    const char *begin_;
+    const char *p_;
+    const char *end_;
+    const char *name_begin_;
+    const char *name_end_;
+    const char *value_begin_;
+    const char *value_end_;
+    bool quoted_;
+    // '}' or '>' for each open message, ']' for an open [list]
+    std::string open_;
+    // the field name of each open [list]
+    std::vector<std::pair<const char *, const char *>> lists_;
+};
+
+/*
+ * key=value pairs split by any of seps. A value may be quoted with ",
+ * then it runs to the closing quote. Words without an = are skipped.
+ */
+class KvReader
+{
+public:
+    KvReader(const char *begin, const char *end, const std::string& seps);
+
+    // false at the end of the text
+    bool Next();
+
+    const char *key_begin() const { return key_begin_; }
+    const char *key_end() const { return key_end_; }
+    const char *value_begin() const { return value_begin_; }
+    const char *value_end() const { return value_end_; }
+    bool quoted() const { return quoted_; }
+    std::string value() const;
+
+private:
+    const char *p_;
+    const char *end_;
+    const char *key_begin_;
+    const char *key_end_;
+    const char *value_begin_;
+    const char *value_end_;
+    bool quoted_;
+    ByteSet seps_;
+    ByteSet key_ends_;      // seps_ and =
+};
+
+// Remove the quotes around [begin, end) and undo the C escapes in it
+std::string Unquote(const char *begin, const char *end);
+
+// The String for a field name, the same object each time the name is
+// seen by the machine. Each worker thread keeps its own keys.
+ObjectPtr InternKey(Machine& machine, const char *begin, const char *end);
+// Called before a record is read: empties the key table once it is full,
+// so the keys of one record are the same objects all through it
+void TrimKeys(Machine& machine);
+
+} // namespace rps
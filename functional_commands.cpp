@@ -4,34 +4,29 @@
 #include <iostream>
 #include <sstream>
 #include <cassert>
+#include <algorithm>
+#include <functional>
+#include <memory>
 #include "token.h"
 #include "object.h"
 #include "module.h"
 #include "machine.h"
 #include "commands.h"
 #include "utilities.h"
+#include "thread_pool.h"
+#include "pipeline.h"
+#include "table.h"
 
 namespace rps
 {
 
 void APPLY(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "APPLY: Apply a program to each item in a list.";
-        machine.helpstrm() << "       Returns a list the same size as the input.";
-        machine.helpstrm() << "[srclist] <<prog>> APPLY => [dstlist]";
-        machine.helpstrm() << "[srclist] \"progname\" APPLY => [dstlist]";
-        machine.helpstrm() << "srclist: List of items";
-        machine.helpstrm() << "prog: Program to execute. The program will have a list item at L0";
-        machine.helpstrm() << "      the program will return an object to be placed on the dstlist";
-        return;
-    }
     stack_required(machine, "APPLY", 2);
-    throw_required(machine, "APPLY", 1, OBJECT_LIST);
+    items_required(machine, "APPLY", 1);
 
     ListPtr result = MakeList();
-    ListPtr lp;
+    ObjectPtr src;
     ObjectPtr optr;
     ProgramPtr pptr;
 
@@ -44,11 +39,18 @@ void APPLY(Machine& machine)
     if (optr->type != OBJECT_PROGRAM)
         throw std::runtime_error("APPLY: Program or program name must be at level 0");
 
-    pptr = std::static_pointer_cast<Program>(optr);
+    pptr = static_pointer_cast<Program>(optr);
 
-    machine.pop(lp);
+    machine.pop(src);
+    if (src->type == OBJECT_STREAM)
+    {
+        PushStep(machine, src, PipelineStep{PipelineStep::STEP_APPLY, pptr, ObjectPtr(), 0});
+        return;
+    }
+    ItemReader items(src);
 
-    for (ObjectPtr p : lp->items)
+    ObjectPtr p;
+    while (items.Next(machine, p))
     {
         if (bInterrupt)
             return;
@@ -62,22 +64,11 @@ void APPLY(Machine& machine)
 
 void APPLY1(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "APPLY1: Apply a program to each item in a list with an argument.";
-        machine.helpstrm() << "       Returns a list the same size as the input.";
-        machine.helpstrm() << "[srclist] <<prog>> argObj APPLY1 => [dstlist]";
-        machine.helpstrm() << "[srclist] \"progname\" argObj APPLY1 => [dstlist]";
-        machine.helpstrm() << "srclist: List of items";
-        machine.helpstrm() << "prog: Program to execute. The program will have a list item at L1 and argObj at L0";
-        machine.helpstrm() << "      the program will return an object to be placed on the dstlist";
-        return;
-    }
     stack_required(machine, "APPLY", 3);
-    throw_required(machine, "APPLY", 2, OBJECT_LIST);
+    items_required(machine, "APPLY", 2);
 
     ListPtr result = MakeList();
-    ListPtr lp;
+    ObjectPtr src;
     ObjectPtr optr;
     ObjectPtr arg;
     ProgramPtr pptr;
@@ -92,11 +83,18 @@ void APPLY1(Machine& machine)
     if (optr->type != OBJECT_PROGRAM)
         throw std::runtime_error("APPLY: Program or program name must be at level 1");
 
-    pptr = std::static_pointer_cast<Program>(optr);
+    pptr = static_pointer_cast<Program>(optr);
 
-    machine.pop(lp);
+    machine.pop(src);
+    if (src->type == OBJECT_STREAM)
+    {
+        PushStep(machine, src, PipelineStep{PipelineStep::STEP_APPLY, pptr, arg, 0});
+        return;
+    }
+    ItemReader items(src);
 
-    for (ObjectPtr p : lp->items)
+    ObjectPtr p;
+    while (items.Next(machine, p))
     {
         if (bInterrupt)
             return;
@@ -111,23 +109,11 @@ void APPLY1(Machine& machine)
 
 void FILTER(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "FILTER Filter items from a list";
-        machine.helpstrm() << "       Returns a list of items removed from the input list.";
-        machine.helpstrm() << "[srclist] <<prog>> FILTER => [dstlist]";
-        machine.helpstrm() << "srclist: List of items";
-        machine.helpstrm() << "prog: Program to execute. The program will have a list item at L0";
-        machine.helpstrm() << "      the program will return true or false to have the item removed";
-        machine.helpstrm() << "      on the dest list" << std::endl;
-        return;
-    }
-
     stack_required(machine, "FILTER", 2);
-    throw_required(machine, "FILTER", 1, OBJECT_LIST);
+    items_required(machine, "FILTER", 1);
 
     ListPtr result = MakeList();
-    ListPtr lp;
+    ObjectPtr src;
     ObjectPtr optr;
     ProgramPtr pptr;
 
@@ -139,11 +125,18 @@ void FILTER(Machine& machine)
     }
     if (optr->type != OBJECT_PROGRAM)
         throw std::runtime_error("FILTER: Program or program name must be at level 0");
-    pptr = std::static_pointer_cast<Program>(optr);
+    pptr = static_pointer_cast<Program>(optr);
 
-    machine.pop(lp);
+    machine.pop(src);
+    if (src->type == OBJECT_STREAM)
+    {
+        PushStep(machine, src, PipelineStep{PipelineStep::STEP_FILTER, pptr, ObjectPtr(), 0});
+        return;
+    }
+    ItemReader items(src);
 
-    for (ObjectPtr p : lp->items)
+    ObjectPtr p;
+    while (items.Next(machine, p))
     {
         if (bInterrupt)
             return;
@@ -158,23 +151,11 @@ void FILTER(Machine& machine)
 
 void FILTER1(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "FILTER1 Remove items from a list with an argument";
-        machine.helpstrm() << "       Returns a list of items removed from the input list.";
-        machine.helpstrm() << "[srclist] <<prog>> argObj FILTER1 => [dstlist]";
-        machine.helpstrm() << "srclist: List of items";
-        machine.helpstrm() << "prog: Program to execute. The program will have a list item at L1 and argObj at L0";
-        machine.helpstrm() << "      the program will return true or false to have the item removed";
-        machine.helpstrm() << "      on the dest list" << std::endl;
-        return;
-    }
-
     stack_required(machine, "SELECT", 3);
-    throw_required(machine, "SELECT", 2, OBJECT_LIST);
+    items_required(machine, "SELECT", 2);
 
     ListPtr result = MakeList();
-    ListPtr lp;
+    ObjectPtr src;
     ObjectPtr optr;
     ObjectPtr arg;
     ProgramPtr pptr;
@@ -188,11 +169,18 @@ void FILTER1(Machine& machine)
     }
     if (optr->type != OBJECT_PROGRAM)
         throw std::runtime_error("SELECT: Program or program name must be at level 1");
-    pptr = std::static_pointer_cast<Program>(optr);
+    pptr = static_pointer_cast<Program>(optr);
 
-    machine.pop(lp);
+    machine.pop(src);
+    if (src->type == OBJECT_STREAM)
+    {
+        PushStep(machine, src, PipelineStep{PipelineStep::STEP_FILTER, pptr, arg, 0});
+        return;
+    }
+    ItemReader items(src);
 
-    for (ObjectPtr p : lp->items)
+    ObjectPtr p;
+    while (items.Next(machine, p))
     {
         if (bInterrupt)
             return;
@@ -208,23 +196,10 @@ void FILTER1(Machine& machine)
 
 void MAP(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "MAP a function over a list";
-        machine.helpstrm() << "[list] <<prog>> opt MAP => ";
-        machine.helpstrm() << "[list] \"progname\" opt MAP => ";
-        machine.helpstrm() << "srclist: List of items";
-        machine.helpstrm() << "prog: Program to execute. The program will have a list item at L0";
-        machine.helpstrm() << "opt: Optional options.";
-        machine.helpstrm() << "     --query: Prompt the user to continue";
-        machine.helpstrm() << "MAP itself does not push anything on the stack, however the executed program may.";
-        return;
-    }
-
     stack_required(machine, "MAP", 2);
 
     ListPtr result = MakeList();
-    ListPtr lp;
+    ObjectPtr src;
     ObjectPtr optr;
     ProgramPtr pptr;
     std::vector<std::string> args;
@@ -236,7 +211,7 @@ void MAP(Machine& machine)
             query = true;
     }
 
-    throw_required(machine, "MAP", 1, OBJECT_LIST);
+    items_required(machine, "MAP", 1);
     machine.pop(optr);
     if (optr->type == OBJECT_STRING)
     {
@@ -245,12 +220,14 @@ void MAP(Machine& machine)
     }
     if (optr->type != OBJECT_PROGRAM)
         throw std::runtime_error("MAP: Program or program name must be at level 0");
-    pptr = std::static_pointer_cast<Program>(optr);
+    pptr = static_pointer_cast<Program>(optr);
 
-    machine.pop(lp);
+    machine.pop(src);
+    ItemReader items(src);
 
     std::string input;
-    for (ObjectPtr p : lp->items)
+    ObjectPtr p;
+    while (items.Next(machine, p))
     {
         if (bInterrupt)
             return;
@@ -268,23 +245,10 @@ void MAP(Machine& machine)
 
 void MAP1(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "MAP1 a function over a list with an argument";
-        machine.helpstrm() << "[list] <<prog>> argObj opt MAP => ";
-        machine.helpstrm() << "[list] \"progname\" argObj opt MAP => ";
-        machine.helpstrm() << "srclist: List of items";
-        machine.helpstrm() << "prog: Program to execute. The program will have a list item at L1 and argObj at L0";
-        machine.helpstrm() << "opt: Optional options.";
-        machine.helpstrm() << "     --query: Prompt the user to continue";
-        machine.helpstrm() << "MAP1 itself does not push anything on the stack, however the executed program may.";
-        return;
-    }
-
     stack_required(machine, "MAP1", 3);
 
     ListPtr result = MakeList();
-    ListPtr lp;
+    ObjectPtr src;
     ObjectPtr optr;
     ProgramPtr pptr;
     ObjectPtr arg;
@@ -297,7 +261,7 @@ void MAP1(Machine& machine)
             query = true;
     }
 
-    throw_required(machine, "MAP1", 2, OBJECT_LIST);
+    items_required(machine, "MAP1", 2);
     machine.pop(arg);
 
     machine.pop(optr);
@@ -308,12 +272,14 @@ void MAP1(Machine& machine)
     }
     if (optr->type != OBJECT_PROGRAM)
         throw std::runtime_error("MAP: Program or program name must be at level 1");
-    pptr = std::static_pointer_cast<Program>(optr);
+    pptr = static_pointer_cast<Program>(optr);
 
-    machine.pop(lp);
+    machine.pop(src);
+    ItemReader items(src);
 
     std::string input;
-    for (ObjectPtr p : lp->items)
+    ObjectPtr p;
+    while (items.Next(machine, p))
     {
         if (bInterrupt)
             return;
@@ -332,24 +298,11 @@ void MAP1(Machine& machine)
 
 void REDUCE(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "REDUCE a list to an object";
-        machine.helpstrm() << "[list] <<prog>> startobj REDUCE => obj ";
-        machine.helpstrm() << "[list] \"progname\" startobj REDUCE => obj ";
-        machine.helpstrm() << "REDUCE calls prog with a list item and the startobj.";
-        machine.helpstrm() << "The program will then return an object to be provided";
-        machine.helpstrm() << "to the next invocation of the program";
-        machine.helpstrm() << "<<prog>> must have signiture:";
-        machine.helpstrm() << "   listitem obj => obj";
-        return;
-    }
-
     stack_required(machine, "REDUCE", 3);
-    throw_required(machine, "REDUCE", 2, OBJECT_LIST);
+    items_required(machine, "REDUCE", 2);
 
     ObjectPtr prog;
-    ListPtr list;
+    ObjectPtr src;
     ObjectPtr obj;
     machine.pop(obj);
     machine.pop(prog);
@@ -362,9 +315,11 @@ void REDUCE(Machine& machine)
         throw std::runtime_error("REDUCE: Program or program name must be at level 0");
 
     ProgramPtr pptr;
-    pptr = std::static_pointer_cast<Program>(prog);
-    machine.pop(list);
-    for (ObjectPtr p : list->items)
+    pptr = static_pointer_cast<Program>(prog);
+    machine.pop(src);
+    ItemReader items(src);
+    ObjectPtr p;
+    while (items.Next(machine, p))
     {
         if (bInterrupt)
             return;
@@ -377,5 +332,638 @@ void REDUCE(Machine& machine)
 }
 
 
-} // namespace rps
+/*
+ * PAPPLY, PFILTER and PREDUCE split the list into tasks that run on the
+ * thread pool. Every worker thread gets its own execution context, see
+ * Machine::Machine(Machine *). Lists that are too short, or a call from
+ * inside a worker, fall back to the sequential command.
+ */
+const size_t TASKS_PER_WORKER = 4;
+
+bool RunSequential(Machine& machine, size_t items)
+{
+    return machine.parent_ != nullptr || ThreadPool::Instance().size() == 1 || items < 2;
+}
+
+// Resolve the program argument the way APPLY does
+ProgramPtr ParallelProgram(Machine& machine, const char *cmd, ObjectPtr optr)
+{
+    if (optr->type == OBJECT_STRING)
+    {
+        std::string name = ((String *)optr.get())->get();
+        RCL(machine, name, optr);
+    }
+    if (optr->type != OBJECT_PROGRAM)
+    {
+        std::stringstream strm;
+        strm << cmd << ": Program or program name must be at level 0";
+        throw std::runtime_error(strm.str());
+    }
+    return static_pointer_cast<Program>(optr);
+}
+
+// Reference counts are updated atomically while it is in scope, however
+// the parallel run ends
+struct AtomicRefs
+{
+    AtomicRefs() { atomic_refs = true; }
+    ~AtomicRefs() { atomic_refs = false; }
+};
+
+// Trims the object heaps once the workers are idle and the contexts of
+// the parallel run are gone, declared before them so it runs last
+struct IdleTrim
+{
+    ~IdleTrim() { TrimHeaps(); }
+};
 
+// Run task(context, index) for index in [0, count) on the thread pool
+void RunParallel(Machine& machine, size_t count, const std::function<void(Machine&, size_t)>& task)
+{
+    ThreadPool& pool = ThreadPool::Instance();
+    IdleTrim trim;
+    std::vector<std::unique_ptr<Machine>> contexts;
+    for (size_t i = 0; i < pool.size(); ++i)
+        contexts.emplace_back(new Machine(&machine));
+
+    AtomicRefs refs;
+    pool.Run(count, [&](size_t worker, size_t index) {
+        task(*contexts[worker], index);
+    });
+}
+
+// The items of task t out of count
+void TaskRange(size_t items, size_t count, size_t t, size_t& begin, size_t& end)
+{
+    begin = items * t / count;
+    end = items * (t + 1) / count;
+}
+
+size_t TaskCount(size_t items)
+{
+    return std::min(items, ThreadPool::Instance().size() * TASKS_PER_WORKER);
+}
+
+void PAPPLY(Machine& machine)
+{
+    stack_required(machine, "PAPPLY", 2);
+    throw_required(machine, "PAPPLY", 1, OBJECT_LIST);
+
+    ListPtr lp = static_pointer_cast<List>(machine.peek(1));
+    if (RunSequential(machine, lp->items.size()))
+    {
+        APPLY(machine);
+        return;
+    }
+
+    ObjectPtr optr;
+    machine.pop(optr);
+    ProgramPtr pptr = ParallelProgram(machine, "PAPPLY", optr);
+    machine.pop(lp);
+
+    std::vector<ObjectPtr> results(lp->items.size());
+    size_t count = TaskCount(results.size());
+    RunParallel(machine, count, [&](Machine& context, size_t t) {
+        size_t begin, end;
+        TaskRange(results.size(), count, t, begin, end);
+        for (size_t i = begin; i < end && !bInterrupt; ++i)
+        {
+            context.push(lp->items[i]);
+            EVAL(context, pptr);
+            context.pop(results[i]);
+        }
+    });
+    if (bInterrupt)
+        return;
+
+    ListPtr result = MakeList();
+    result->items = std::move(results);
+    machine.push(result);
+}
+
+void PFILTER(Machine& machine)
+{
+    stack_required(machine, "PFILTER", 2);
+    throw_required(machine, "PFILTER", 1, OBJECT_LIST);
+
+    ListPtr lp = static_pointer_cast<List>(machine.peek(1));
+    if (RunSequential(machine, lp->items.size()))
+    {
+        FILTER(machine);
+        return;
+    }
+
+    ObjectPtr optr;
+    machine.pop(optr);
+    ProgramPtr pptr = ParallelProgram(machine, "PFILTER", optr);
+    machine.pop(lp);
+
+    std::vector<char> removed(lp->items.size());
+    size_t count = TaskCount(removed.size());
+    RunParallel(machine, count, [&](Machine& context, size_t t) {
+        size_t begin, end;
+        TaskRange(removed.size(), count, t, begin, end);
+        ObjectPtr optr;
+        for (size_t i = begin; i < end && !bInterrupt; ++i)
+        {
+            context.push(lp->items[i]);
+            EVAL(context, pptr);
+            context.pop(optr);
+            removed[i] = ToBool(context, optr);
+        }
+    });
+    if (bInterrupt)
+        return;
+
+    ListPtr result = MakeList();
+    for (size_t i = 0; i < removed.size(); ++i)
+    {
+        if (!removed[i])
+            result->items.push_back(lp->items[i]);
+    }
+    machine.push(result);
+}
+
+// Each task reduces its part of the list, the first one starting from
+// startobj and the others from their first item. The partial results
+// are then combined pairwise, the later part at L1 as REDUCE would
+// pass it, until one is left.
+void PREDUCE(Machine& machine)
+{
+    stack_required(machine, "PREDUCE", 3);
+    throw_required(machine, "PREDUCE", 2, OBJECT_LIST);
+
+    ListPtr lp = static_pointer_cast<List>(machine.peek(2));
+    if (RunSequential(machine, lp->items.size()))
+    {
+        REDUCE(machine);
+        return;
+    }
+
+    ObjectPtr obj;
+    ObjectPtr prog;
+    machine.pop(obj);
+    machine.pop(prog);
+    ProgramPtr pptr = ParallelProgram(machine, "PREDUCE", prog);
+    machine.pop(lp);
+
+    size_t items = lp->items.size();
+    size_t count = TaskCount(items);
+    std::vector<ObjectPtr> partial(count);
+    RunParallel(machine, count, [&](Machine& context, size_t t) {
+        size_t begin, end;
+        TaskRange(items, count, t, begin, end);
+        ObjectPtr acc = obj;
+        if (t > 0)
+            acc = lp->items[begin++];
+        for (size_t i = begin; i < end && !bInterrupt; ++i)
+        {
+            context.push(lp->items[i]);
+            context.push(acc);
+            EVAL(context, pptr);
+            context.pop(acc);
+        }
+        partial[t] = acc;
+    });
+
+    while (partial.size() > 1 && !bInterrupt)
+    {
+        std::vector<ObjectPtr> next((partial.size() + 1) / 2);
+        if (partial.size() % 2)
+            next.back() = partial.back();
+        RunParallel(machine, partial.size() / 2, [&](Machine& context, size_t t) {
+            context.push(partial[2 * t + 1]);
+            context.push(partial[2 * t]);
+            EVAL(context, pptr);
+            context.pop(next[t]);
+        });
+        partial.swap(next);
+    }
+    if (bInterrupt)
+        return;
+    machine.push(partial[0]);
+}
+
+//*******************************************************************
+// GROUPBY
+
+namespace
+{
+
+// An aggregate of GROUPBY, "--name" or "--name=field"
+struct Aggregate
+{
+    enum Kind
+    {
+        AGG_COUNT
+        , AGG_SUM
+        , AGG_MIN
+        , AGG_MAX
+        , AGG_FIRST
+        , AGG_LAST
+        , AGG_COLLECT
+    };
+
+    Kind kind;
+    ObjectPtr field;    // an index or a name, null for the item itself
+    size_t column;      // the column of field when grouping a Table
+};
+
+// A field of an item. The integers of a Table column are not made into
+// Objects unless they are kept.
+struct Value
+{
+    Value() : none(true), is_int(false), i(0) {}
+
+    ObjectPtr Get() const
+    {
+        if (none)
+            return MakeNone();
+        if (is_int)
+            return MakeInteger(i);
+        return obj;
+    }
+
+    bool none;
+    bool is_int;
+    int64_t i;
+    ObjectPtr obj;
+};
+
+struct AggState
+{
+    AggState() : n(0), set(false) {}
+
+    int64_t n;          // count or sum
+    bool set;           // v holds a value
+    Value v;            // min, max, first or last
+    ListPtr list;       // collect
+};
+
+Value MakeValue(const ObjectPtr& obj)
+{
+    Value v;
+    if (!obj || obj->type == OBJECT_NONE)
+        return v;
+    v.none = false;
+    if (obj->type == OBJECT_INTEGER)
+    {
+        v.is_int = true;
+        v.i = ((Integer *)obj.get())->value;
+    }
+    else
+        v.obj = obj;
+    return v;
+}
+
+// Field field of a List or a Map, the item itself if field is null
+Value FieldValue(Machine& machine, const ObjectPtr& item, const ObjectPtr& field)
+{
+    if (!field)
+        return MakeValue(item);
+    if (item->type == OBJECT_LIST && field->type == OBJECT_INTEGER)
+    {
+        List *lp = (List *)item.get();
+        int64_t idx = ((Integer *)field.get())->value;
+        if (idx >= 0 && idx < (int64_t)lp->items.size())
+            return MakeValue(lp->items[idx]);
+        return Value();
+    }
+    if (item->type == OBJECT_MAP)
+    {
+        Map *mp = (Map *)item.get();
+        auto it = mp->items.find(field);
+        return it == mp->items.end() ? Value() : MakeValue(it->second);
+    }
+    std::stringstream ss;
+    ss << "GROUPBY: cannot take field " << ToStr(machine, field) << " of a " << ObjectNames[item->type];
+    throw std::runtime_error(ss.str());
+}
+
+// Cell row of column c of a Table, strings is the cache of the Strings
+// made for the column
+Value CellValue(const Table& table, size_t c, size_t row, std::vector<ObjectPtr>& strings)
+{
+    const Column& col = *table.columns[c];
+    Value v;
+    if (col.none(row))
+        return v;
+    v.none = false;
+    if (col.kind == Column::COLUMN_INT)
+    {
+        v.is_int = true;
+        v.i = col.ints[row];
+        return v;
+    }
+    uint32_t code = col.codes[row];
+    if (col.integer(row))
+    {
+        v.is_int = true;
+        v.i = col.number(code);
+        return v;
+    }
+    if (strings.empty())
+        strings.resize(col.entries());
+    if (!strings[code])
+        strings[code].reset(new String(col.text(code), col.text(code) + col.length(code)));
+    v.obj = strings[code];
+    return v;
+}
+
+// Integers come before strings, other objects cannot be compared
+bool ValueLess(const Value& a, const Value& b)
+{
+    if (a.is_int || b.is_int)
+        return a.is_int && (!b.is_int || a.i < b.i);
+    if (a.obj->type == OBJECT_STRING && b.obj->type == OBJECT_STRING)
+        return ((String *)a.obj.get())->get() < ((String *)b.obj.get())->get();
+    std::stringstream ss;
+    ss << "GROUPBY: cannot compare a " << ObjectNames[a.obj->type] << " and a " << ObjectNames[b.obj->type];
+    throw std::runtime_error(ss.str());
+}
+
+void Accumulate(Machine& machine, const Aggregate& agg, AggState& st, const Value& v)
+{
+    switch (agg.kind)
+    {
+    case Aggregate::AGG_COUNT:
+        ++st.n;
+        break;
+    case Aggregate::AGG_SUM:
+        if (!v.none)
+            st.n += v.is_int ? v.i : ToInt(machine, v.obj);
+        break;
+    case Aggregate::AGG_MIN:
+        if (!v.none && (!st.set || ValueLess(v, st.v)))
+        {
+            st.v = v;
+            st.set = true;
+        }
+        break;
+    case Aggregate::AGG_MAX:
+        if (!v.none && (!st.set || ValueLess(st.v, v)))
+        {
+            st.v = v;
+            st.set = true;
+        }
+        break;
+    case Aggregate::AGG_FIRST:
+        if (!st.set)
+        {
+            st.v = v;
+            st.set = true;
+        }
+        break;
+    case Aggregate::AGG_LAST:
+        st.v = v;
+        st.set = true;
+        break;
+    case Aggregate::AGG_COLLECT:
+        if (!st.list)
+            st.list = MakeList();
+        st.list->items.push_back(v.Get());
+        break;
+    }
+}
+
+ObjectPtr AggResult(const Aggregate& agg, const AggState& st)
+{
+    switch (agg.kind)
+    {
+    case Aggregate::AGG_COUNT:
+    case Aggregate::AGG_SUM:
+        return MakeInteger(st.n);
+    case Aggregate::AGG_COLLECT:
+        return st.list ? ObjectPtr(st.list) : ObjectPtr(MakeList());
+    default:
+        return st.set ? st.v.Get() : ObjectPtr(MakeNone());
+    }
+}
+
+void GetAggregates(const std::vector<std::string>& args, std::vector<Aggregate>& aggs)
+{
+    static const struct
+    {
+        const char *name;
+        Aggregate::Kind kind;
+    } names[] = {
+        { "count", Aggregate::AGG_COUNT },
+        { "sum", Aggregate::AGG_SUM },
+        { "min", Aggregate::AGG_MIN },
+        { "max", Aggregate::AGG_MAX },
+        { "first", Aggregate::AGG_FIRST },
+        { "last", Aggregate::AGG_LAST },
+        { "collect", Aggregate::AGG_COLLECT },
+    };
+
+    // GetArgs pops the options, the last one first
+    for (auto it = args.rbegin(); it != args.rend(); ++it)
+    {
+        std::string name = it->substr(2);
+        std::string field;
+        size_t eq = name.find('=');
+        if (eq != std::string::npos)
+        {
+            field = name.substr(eq + 1);
+            name.resize(eq);
+        }
+        Aggregate agg;
+        size_t i = 0;
+        while (i < sizeof(names) / sizeof(names[0]) && name != names[i].name)
+            ++i;
+        if (i == sizeof(names) / sizeof(names[0]))
+            throw std::runtime_error("GROUPBY: unknown aggregate " + *it);
+        agg.kind = names[i].kind;
+        agg.column = 0;
+        if (!field.empty())
+        {
+            if (field.find_first_not_of("0123456789") == std::string::npos)
+                agg.field = MakeInteger(std::stoll(field));
+            else
+                agg.field = ObjectPtr(new String(field));
+        }
+        aggs.push_back(agg);
+    }
+    if (aggs.empty())
+        aggs.push_back(Aggregate{Aggregate::AGG_COLLECT, ObjectPtr(), 0});
+}
+
+} // namespace
+
+void GROUPBY(Machine& machine)
+{
+    std::vector<std::string> args;
+    GetArgs(machine, args);
+    stack_required(machine, "GROUPBY", 2);
+    ObjectPtr key = machine.peek(0);
+    ObjectPtr src = machine.peek(1);
+    if (src->type != OBJECT_TABLE)
+        items_required(machine, "GROUPBY", 1);
+    if (key->type != OBJECT_PROGRAM && key->type != OBJECT_INTEGER && key->type != OBJECT_STRING)
+        throw std::runtime_error("GROUPBY: the key must be a program, an index or a name");
+
+    std::vector<Aggregate> aggs;
+    GetAggregates(args, aggs);
+    size_t naggs = aggs.size();
+
+    std::vector<ObjectPtr> keys;        // of each group
+    std::vector<AggState> states;       // naggs for each group
+    MapItems index;                     // key => nothing, the position of a key is its group
+    auto group_of = [&](const ObjectPtr& k) {
+        // other objects would be grouped by identity, not by value
+        if (k->type != OBJECT_STRING && k->type != OBJECT_INTEGER && k->type != OBJECT_NONE)
+        {
+            std::stringstream ss;
+            ss << "GROUPBY: a key must be a String, Integer or None, got a " << ObjectNames[k->type];
+            throw std::runtime_error(ss.str());
+        }
+        auto inserted = index.emplace(k, ObjectPtr());
+        size_t g = inserted.first - index.begin();
+        if (inserted.second)
+        {
+            keys.push_back(k);
+            states.resize(states.size() + naggs);
+        }
+        return g;
+    };
+    auto eval_key = [&](ObjectPtr item) {
+        ObjectPtr k;
+        size_t depth = machine.stack_.size();
+        machine.push(item);
+        EVAL(machine, key);
+        if (machine.stack_.size() != depth + 1)
+        {
+            while (machine.stack_.size() > depth)
+                machine.pop();
+            throw std::runtime_error("GROUPBY: the key program must replace the item with one key");
+        }
+        machine.pop(k);
+        return k;
+    };
+
+    if (src->type == OBJECT_TABLE)
+    {
+        TablePtr table = static_pointer_cast<Table>(src);
+        size_t ncols = table->columns.size();
+        bool whole = key->type == OBJECT_PROGRAM;
+        for (auto& agg: aggs)
+        {
+            if (agg.field)
+                agg.column = table->ColumnIndex("GROUPBY", agg.field);
+            else if (agg.kind != Aggregate::AGG_COUNT)
+                whole = true;
+        }
+        // the key column, none for a program
+        size_t kc = 0;
+        const Column *kcol = nullptr;
+        if (key->type != OBJECT_PROGRAM)
+        {
+            kc = table->ColumnIndex("GROUPBY", key);
+            kcol = table->columns[kc].get();
+        }
+        std::vector<std::vector<ObjectPtr>> strings(ncols);
+        std::vector<size_t> code_group;     // group + 1 of each code of a string key column
+        std::unordered_map<int64_t, size_t> int_group;
+
+        for (size_t r = 0; r < table->rows; ++r)
+        {
+            if (!table->IsSelected(r))
+                continue;
+            if (bInterrupt)
+                return;
+            ListPtr row;
+            if (whole)
+            {
+                row = MakeList();
+                for (size_t c = 0; c < ncols; ++c)
+                    row->items.push_back(CellValue(*table, c, r, strings[c]).Get());
+            }
+
+            size_t g;
+            if (key->type == OBJECT_PROGRAM)
+                g = group_of(eval_key(row));
+            else if (kcol->none(r))
+                g = group_of(MakeNone());
+            else if (kcol->kind == Column::COLUMN_STRING && !kcol->integer(r))
+            {
+                if (code_group.empty())
+                    code_group.resize(kcol->entries());
+                size_t& cg = code_group[kcol->codes[r]];
+                if (cg == 0)
+                    cg = group_of(CellValue(*table, kc, r, strings[kc]).obj) + 1;
+                g = cg - 1;
+            }
+            else
+            {
+                int64_t n = CellValue(*table, kc, r, strings[kc]).i;
+                auto it = int_group.find(n);
+                if (it == int_group.end())
+                    it = int_group.emplace(n, group_of(MakeInteger(n))).first;
+                g = it->second;
+            }
+
+            for (size_t a = 0; a < naggs; ++a)
+            {
+                const Aggregate& agg = aggs[a];
+                Value v;
+                if (agg.field)
+                    v = CellValue(*table, agg.column, r, strings[agg.column]);
+                else if (row)
+                    v = MakeValue(row);
+                Accumulate(machine, agg, states[g * naggs + a], v);
+            }
+        }
+    }
+    else
+    {
+        ItemReader items(src);
+        ObjectPtr item;
+        while (items.Next(machine, item))
+        {
+            if (bInterrupt)
+                return;
+            ObjectPtr k;
+            if (key->type == OBJECT_PROGRAM)
+                k = eval_key(item);
+            else
+            {
+                // a missing field of a map is a None key, an index past
+                // the end of a list is a mistake
+                if (item->type == OBJECT_LIST && key->type == OBJECT_INTEGER
+                        && (uint64_t)((Integer *)key.get())->value >= ((List *)item.get())->items.size())
+                {
+                    std::stringstream ss;
+                    ss << "GROUPBY: key index " << ((Integer *)key.get())->value << " is out of range for a list of "
+                       << ((List *)item.get())->items.size() << " items";
+                    throw std::runtime_error(ss.str());
+                }
+                k = FieldValue(machine, item, key).Get();
+            }
+            size_t g = group_of(k);
+            for (size_t a = 0; a < naggs; ++a)
+                Accumulate(machine, aggs[a], states[g * naggs + a], FieldValue(machine, item, aggs[a].field));
+        }
+    }
+
+    MapPtr result = MakeMap();
+    result->items.reserve(keys.size());
+    for (size_t g = 0; g < keys.size(); ++g)
+    {
+        ObjectPtr value;
+        if (naggs == 1)
+            value = AggResult(aggs[0], states[g]);
+        else
+        {
+            ListPtr lp = MakeList();
+            for (size_t a = 0; a < naggs; ++a)
+                lp->items.push_back(AggResult(aggs[a], states[g * naggs + a]));
+            value = lp;
+        }
+        result->items.emplace(keys[g], value);
+    }
+    machine.pop();
+    machine.pop();
+    machine.push(result);
+}
+
+} // namespace rps
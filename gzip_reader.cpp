@@ -0,0 +1,188 @@
+#include <cstring>
+#include <vector>
+#include <stdexcept>
+#include <zlib.h>
+#include "gzip_reader.h"
+
+namespace rps
+{
+
+namespace
+{
+const size_t GZIP_BLOCK_BYTES = 1 << 20;
+const size_t GZIP_INPUT_BYTES = 1 << 20;
+const size_t GZIP_QUEUE_BLOCKS = 4;     // blocks decompressed ahead of the reader
+}
+
+std::unique_ptr<GzipReader> OpenGzip(const std::string& filename)
+{
+    FILE *fp = fopen(filename.c_str(), "rb");
+    if (fp == nullptr)
+        return std::unique_ptr<GzipReader>();
+    unsigned char magic[2];
+    if (fread(magic, 1, 2, fp) != 2 || magic[0] != 0x1f || magic[1] != 0x8b)
+    {
+        fclose(fp);
+        return std::unique_ptr<GzipReader>();
+    }
+    rewind(fp);
+    return std::unique_ptr<GzipReader>(new GzipReader(fp));
+}
+
+GzipReader::GzipReader(FILE *fp)
+: fp_(fp)
+, finished_(false)
+, stop_(false)
+, pos_(0)
+{
+    thread_ = std::thread(&GzipReader::Inflate, this);
+}
+
+GzipReader::~GzipReader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    space_.notify_all();
+    thread_.join();
+    fclose(fp_);
+}
+
+// Queue a full block, false if the reader has gone away
+bool GzipReader::Push(std::string& block)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    space_.wait(lock, [this] { return stop_ || blocks_.size() < GZIP_QUEUE_BLOCKS; });
+    if (stop_)
+        return false;
+    blocks_.push_back(std::move(block));
+    lock.unlock();
+    ready_.notify_one();
+    return true;
+}
+
+void GzipReader::Inflate()
+{
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    std::string error;
+    if (inflateInit2(&zs, 16 + MAX_WBITS) != Z_OK)
+        error = "gzip: can not initialise zlib";
+
+    std::vector<unsigned char> in(GZIP_INPUT_BYTES);
+    std::string out(GZIP_BLOCK_BYTES, '\0');
+    zs.next_out = (Bytef *)&out[0];
+    zs.avail_out = out.size();
+    bool ended = false;         // at the end of a gzip member
+    while (error.empty())
+    {
+        if (zs.avail_in == 0)
+        {
+            size_t n = fread(in.data(), 1, in.size(), fp_);
+            if (n == 0)
+            {
+                if (ferror(fp_))
+                    error = "gzip: read error";
+                else if (!ended)
+                    error = "gzip: unexpected end of file";
+                break;
+            }
+            zs.next_in = in.data();
+            zs.avail_in = n;
+        }
+        if (ended)
+        {
+            // gzip ignores trailing garbage after a member
+            if (zs.next_in[0] != 0x1f)
+                break;
+            inflateReset(&zs);
+            ended = false;
+        }
+        int ret = inflate(&zs, Z_NO_FLUSH);
+        if (ret == Z_STREAM_END)
+            ended = true;
+        else if (ret != Z_OK && ret != Z_BUF_ERROR)
+        {
+            error = std::string("gzip: ") + (zs.msg ? zs.msg : "corrupt data");
+            break;
+        }
+        if (zs.avail_out == 0)
+        {
+            if (!Push(out))
+                break;
+            out.assign(GZIP_BLOCK_BYTES, '\0');
+            zs.next_out = (Bytef *)&out[0];
+            zs.avail_out = out.size();
+        }
+    }
+    inflateEnd(&zs);
+
+    out.resize(out.size() - zs.avail_out);
+    if (!out.empty() && error.empty())
+        Push(out);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        finished_ = true;
+        error_ = error;
+    }
+    ready_.notify_one();
+}
+
+bool GzipReader::ReadBlock(std::string& block)
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    ready_.wait(lock, [this] { return finished_ || !blocks_.empty(); });
+    if (blocks_.empty())
+    {
+        if (!error_.empty())
+            throw std::runtime_error(error_);
+        return false;
+    }
+    block = std::move(blocks_.front());
+    blocks_.pop_front();
+    lock.unlock();
+    space_.notify_one();
+    return true;
+}
+
+bool GzipReader::GetLine(std::string& line)
+{
+    line.clear();
+    bool any = false;
+    for (;;)
+    {
+        const char *p = current_.data() + pos_;
+        size_t left = current_.size() - pos_;
+        const char *nl = (const char *)memchr(p, '\n', left);
+        if (nl)
+        {
+            line.append(p, nl);
+            pos_ += nl - p + 1;
+            return true;
+        }
+        if (left)
+        {
+            line.append(p, left);
+            any = true;
+        }
+        pos_ = 0;
+        if (!ReadBlock(current_))
+        {
+            current_.clear();
+            return any;
+        }
+    }
+}
+
+void GzipReader::ReadAll(std::string& data)
+{
+    data.append(current_, pos_, std::string::npos);
+    current_.clear();
+    pos_ = 0;
+    std::string block;
+    while (ReadBlock(block))
+        data.append(block);
+}
+
+} // namespace rps
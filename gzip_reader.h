@@ -0,0 +1,54 @@
+#pragma once
+#include <string>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <memory>
+#include <cstdio>
+
+namespace rps
+{
+
+/*
+ * Reads a gzip file. A thread decompresses it with zlib into blocks of
+ * GZIP_BLOCK_BYTES while the caller splits the previous blocks into
+ * lines. Concatenated gzip members are read as one file, like zcat.
+ */
+class GzipReader
+{
+public:
+    explicit GzipReader(FILE *fp);      // takes ownership of fp
+    ~GzipReader();
+    GzipReader(const GzipReader&) = delete;
+    GzipReader& operator=(const GzipReader&) = delete;
+
+    // The next line without its newline, false at the end of the data
+    bool GetLine(std::string& line);
+    // The next block of decompressed data, false at the end
+    bool ReadBlock(std::string& block);
+    // Append the rest of the data
+    void ReadAll(std::string& data);
+
+private:
+    void Inflate();
+    bool Push(std::string& block);
+
+    FILE *fp_;
+    std::thread thread_;
+    std::mutex mutex_;
+    std::condition_variable ready_;     // a block was added or the data ended
+    std::condition_variable space_;     // a block was taken or reading stopped
+    std::deque<std::string> blocks_;
+    bool finished_;
+    bool stop_;
+    std::string error_;
+    std::string current_;               // the block GetLine is splitting
+    size_t pos_;
+};
+
+// A reader for filename if it starts with the gzip magic bytes,
+// otherwise nullptr
+std::unique_ptr<GzipReader> OpenGzip(const std::string& filename);
+
+} // namespace rps
@@ -1,4 +1,5 @@
 #include <vector>
+#include <deque>
 #include <unordered_map>
 #include <exception>
 #include <iostream>
@@ -7,6 +8,8 @@
 #include <cstdio>
 #include <cstring>
 #include <limits>
+#include <algorithm>
+#include <sys/stat.h>
 #include "token.h"
 #include "object.h"
 #include "module.h"
@@ -14,35 +17,191 @@
 #include "commands.h"
 #include "utilities.h"
 #include "parser.h"
+#include "search.h"
+#include "regex.h"
+#include "thread_pool.h"
+#include "gzip_reader.h"
 
 namespace rps
 {
 
-void PRINT(Machine& machine)
+// The lines of a file, or of the output of a command, read as they are
+// consumed. The file is closed at the end of the data.
+class LineStream : public Stream
 {
-    if (machine.GetProperty("help", 0))
+public:
+    LineStream(FILE *fp, bool pipe, const std::string& name, int64_t limit)
+    : fp_(fp)
+    , pipe_(pipe)
+    , name_(name)
+    , limit_(limit)
+    , buf_(nullptr)
+    , size_(0)
+    {}
+
+    LineStream(std::unique_ptr<GzipReader> gz, const std::string& name, int64_t limit)
+    : fp_(nullptr)
+    , pipe_(false)
+    , gz_(std::move(gz))
+    , name_(name)
+    , limit_(limit)
+    , buf_(nullptr)
+    , size_(0)
+    {}
+
+    ~LineStream()
     {
-        machine.helpstrm() << "PRINT: Print the object at L0 according to the rules of TOSTR";
-        machine.helpstrm() << "\"str\" => ";
-        return;
+        Close();
+        free(buf_);
     }
+
+    bool Next(Machine&, ObjectPtr& out) override
+    {
+        if (gz_)
+        {
+            if (limit_ <= 0 || !gz_->GetLine(line_))
+            {
+                gz_.reset();
+                return false;
+            }
+            --limit_;
+            out.reset(new String(line_));
+            return true;
+        }
+        if (fp_ == nullptr)
+            return false;
+        ssize_t n = limit_ > 0 ? getline(&buf_, &size_, fp_) : -1;
+        if (n < 0)
+        {
+            Close();
+            return false;
+        }
+        --limit_;
+        if (n > 0 && buf_[n-1] == '\n')
+            --n;
+        out.reset(new String(buf_, buf_ + n));
+        return true;
+    }
+
+    std::string Describe() const override
+    {
+        return name_;
+    }
+
+private:
+    void Close()
+    {
+        if (fp_ == nullptr)
+            return;
+        if (pipe_)
+            pclose(fp_);
+        else
+            fclose(fp_);
+        fp_ = nullptr;
+    }
+
+    FILE *fp_;
+    bool pipe_;
+    std::unique_ptr<GzipReader> gz_;
+    std::string name_;
+    int64_t limit_;         // lines left to read
+    char *buf_;
+    size_t size_;
+    std::string line_;
+};
+
+// Append up to limit lines of fp to ret, without their newlines
+void ReadLines(FILE *fp, int limit, ListPtr& ret)
+{
+    char *buf = nullptr;
+    size_t size = 0;
+    ssize_t n;
+    for (int count = 0; count < limit && (n = getline(&buf, &size, fp)) >= 0; ++count)
+    {
+        if (bInterrupt)
+            break;
+        if (n > 0 && buf[n-1] == '\n')
+            --n;
+        ret->items.push_back(ObjectPtr(new String(buf, buf + n)));
+    }
+    free(buf);
+}
+
+// FREAD reads a regular file this much at a time. The lines are slices
+// of the chunk they are in, so a line that is kept holds on to its chunk
+// and not to the whole file.
+const size_t READ_CHUNK_BYTES = 1 << 20;
+
+// Read the lines of a regular file of about file_size bytes in chunks.
+// A line that does not end in a chunk is moved to the start of the next
+// one, which is made larger if the line does not fit.
+void ReadChunks(FILE *fp, size_t file_size, int limit, ListPtr& ret)
+{
+    std::unique_ptr<char[]> rest;
+    size_t rest_size = 0;
+    size_t read = 0;
+    int count = 0;
+    bool eof = false;
+    while (count < limit && !eof && !bInterrupt)
+    {
+        // one more byte than is left finds the end without another read
+        size_t left = file_size > read ? file_size - read : 0;
+        size_t size = std::max(std::min(READ_CHUNK_BYTES, left + rest_size + 1), 2 * rest_size);
+        std::unique_ptr<char[]> buf(new char[size]);
+        if (rest_size)
+            memcpy(buf.get(), rest.get(), rest_size);
+        size_t n = fread(buf.get() + rest_size, 1, size - rest_size, fp);
+        read += n;
+        size_t used = rest_size + n;
+        eof = used < size;
+        rest_size = 0;
+        if (!eof)
+        {
+            const char *nl = (const char *)memrchr(buf.get(), '\n', used);
+            if (nl == nullptr)
+            {
+                // the line is longer than the chunk
+                rest = std::move(buf);
+                rest_size = used;
+                continue;
+            }
+            rest_size = buf.get() + used - (nl + 1);
+            rest.reset(new char[rest_size]);
+            memcpy(rest.get(), nl + 1, rest_size);
+            used -= rest_size;
+        }
+        if (used == 0)
+            break;
+        MappedFilePtr chunk = std::make_shared<MappedFile>(buf.release(), used, false);
+        const char *p = chunk->data;
+        const char *end = p + chunk->size;
+        for (; count < limit && p < end; ++count)
+        {
+            const char *eol = (const char *)memchr(p, '\n', end - p);
+            if (eol == nullptr)
+                eol = end;
+            ret->items.push_back(ObjectPtr(new String(p, eol, chunk)));
+            p = eol + 1;
+        }
+    }
+}
+
+void PRINT(Machine& machine)
+{
     stack_required(machine, "PRINT", 1);
 
     ObjectPtr optr;
     machine.pop(optr);
 
-    std::cout << ToStr(machine, optr) << std::endl;
+    TextWriter out(stdout);
+    out.Write(machine, optr);
+    out.Put('\n');
+    out.Flush();
+    fflush(stdout);
 }
 
 void PROMPT(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "PROMPT: Prompt for user input";
-        machine.helpstrm() << "\"prompt\" => \"response\"";
-        return;
-    }
-
     stack_required(machine, "PROMPT", 1);
     throw_required(machine, "PROMPT", 0, OBJECT_STRING);
 
@@ -58,13 +217,6 @@ void PROMPT(Machine& machine)
 
 void PREAD(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "PREAD: Capture process output into a list";
-        machine.helpstrm() << "\"command line\" opts PREAD => [dstlist]";
-        machine.helpstrm() << "opts: --limit=n  Read a maximum of n lines of data";
-        return;
-    }
    stack_required(machine, "PREAD", 1);
    throw_required(machine, "PREAD", 0, OBJECT_STRING);
 
@@ -72,6 +224,7 @@ void PREAD(Machine& machine)
    std::string cmd;
    std::vector<std::string> args;
    int limit = std::numeric_limits<int>::max();
+   bool lazy = false;
 
    GetArgs(machine, args);
    for(auto arg : args)
@@ -80,29 +233,22 @@ void PREAD(Machine& machine)
        {
             limit = std::stoi(&arg.c_str()[8]);
        }
+       else if (arg == "--lazy")
+            lazy = true;
    }
    throw_required(machine, "PREAD", 0, OBJECT_STRING);
    machine.pop(cmd);
 
    FILE *fp = popen(cmd.c_str(), "r");
-   if (fp)
+   if (fp && lazy)
+   {
+       ObjectPtr stream(new LineStream(fp, true, cmd, limit));
+       machine.push(stream);
+   }
+   else if (fp)
    {
        ListPtr ret = MakeList();
-       char buf[10240];
-       for (int count = 0; count < limit && !feof(fp); ++count)
-       {
-           if (bInterrupt)
-               break;
-           if (fgets(buf, sizeof(buf), fp))
-           {
-               size_t l = strlen(buf);
-               if (buf[l-1] == '\n')
-                   buf[l-1] = '\0';
-               StringPtr sp = MakeString();
-               sp->set(buf);
-               ret->items.push_back(sp);
-           }
-       }
+       ReadLines(fp, limit, ret);
        pclose(fp);
        machine.push(ret);
    }
@@ -110,19 +256,12 @@ void PREAD(Machine& machine)
    {
        std::stringstream strm;
        strm << "Failed to open pipe " << cmd.c_str() << " for reading";
-       pclose(fp);
        throw std::runtime_error(strm.str().c_str());
    }
 }
 
 void PWRITE(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "PWRITE: Write object at L1 to the commandline on L0";
-        machine.helpstrm() << "\"obj\" \"command line\" PWRITE =>";
-        return;
-    }
    stack_required(machine, "PWRITE", 2);
 
    ObjectPtr data;
@@ -134,23 +273,25 @@ void PWRITE(Machine& machine)
    FILE *fp = popen(cmd.c_str(), "w");
    if (fp)
    {
-       if (data->type == OBJECT_LIST)
-       {
-            List *lp = (List *)data.get();
-            for (ObjectPtr optr : lp->items)
-            {
-                if (bInterrupt)
-                    break;
-                std::string s = ToStr(machine, optr);
-                fputs(s.c_str(), fp);
-                fputs("\n", fp);
-            }
-       }
-       else
        {
-           std::string s = ToStr(machine, data);
-           fputs(s.c_str(), fp);
-           fputs("\n", fp);
+           TextWriter out(fp);
+           if (data->type == OBJECT_LIST)
+           {
+                List *lp = (List *)data.get();
+                for (ObjectPtr& optr : lp->items)
+                {
+                    if (bInterrupt)
+                        break;
+                    out.Write(machine, optr);
+                    out.Put('\n');
+                    out.Spill();
+                }
+           }
+           else
+           {
+               out.Write(machine, data);
+               out.Put('\n');
+           }
        }
        pclose(fp);
    }
@@ -158,20 +299,12 @@ void PWRITE(Machine& machine)
    {
        std::stringstream strm;
        strm << "Failed to open pipe " << cmd.c_str() << " for writing";
-       pclose(fp);
        throw std::runtime_error(strm.str().c_str());
    }
 }
 
 void FWRITE(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "FWRITE: Write list at L1 to the file on L0";
-        machine.helpstrm() << "[list] \"filename\" FWRITE =>";
-        return;
-    }
-
    stack_required(machine, "FWRITE", 2);
    throw_required(machine, "FWRITE", 0, OBJECT_STRING);
    throw_required(machine, "FWRITE", 1, OBJECT_LIST);
@@ -185,21 +318,21 @@ void FWRITE(Machine& machine)
    FILE *fp = fopen(file.c_str(), "w");
    if (fp)
    {
+        TextWriter out(fp);
         List *lp = (List *)data.get();
-        for (ObjectPtr optr : lp->items)
+        for (ObjectPtr& optr : lp->items)
         {
             if (bInterrupt)
                 break;
-            std::string s = ToStr(machine, optr);
-            fputs(s.c_str(), fp);
-            fputs("\n", fp);
+            out.Write(machine, optr);
+            out.Put('\n');
+            out.Spill();
         }
    }
    else
    {
        std::stringstream strm;
        strm << "Failed to open " << file.c_str() << " for writing";
-       fclose(fp);
        throw std::runtime_error(strm.str().c_str());
    }
    fclose(fp);
@@ -207,19 +340,13 @@ void FWRITE(Machine& machine)
 
 void FREAD(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "FREAD: Capture a file into a list";
-        machine.helpstrm() << "\"filename\" opts FREAD => [list]";
-        machine.helpstrm() << "opts: --limit=n  Read a maximum of n lines of data";
-        return;
-    }
    stack_required(machine, "FREAD", 1);
    throw_required(machine, "FREAD", 0, OBJECT_STRING);
 
    std::string opt;
    std::string file;
    int limit = std::numeric_limits<int>::max();
+   bool lazy = false;
 
    std::vector<std::string> args;
    GetArgs(machine, args);
@@ -229,29 +356,54 @@ void FREAD(Machine& machine)
        {
             limit = std::stoi(&arg.c_str()[8]);
        }
+       else if (arg == "--lazy")
+            lazy = true;
    }
    throw_required(machine, "FREAD", 0, OBJECT_STRING);
    machine.pop(file);
 
-   FILE *fp = fopen(file.c_str(), "r");
-   if (fp)
+   std::unique_ptr<GzipReader> gz = OpenGzip(file);
+   if (gz && lazy)
+   {
+       ObjectPtr stream(new LineStream(std::move(gz), file, limit));
+       machine.push(stream);
+       return;
+   }
+   if (gz)
    {
-       char buf[10240];
        ListPtr ret = MakeList();
-       for (int count = 0; count < limit && !feof(fp); ++count)
+       std::string line;
+       for (int count = 0; count < limit && gz->GetLine(line); ++count)
        {
            if (bInterrupt)
                break;
-           if (fgets(buf, sizeof(buf), fp))
-           {
-               size_t l = strlen(buf);
-               if (buf[l-1] == '\n')
-                   buf[l-1] = '\0';
-               StringPtr sp = MakeString();
-               sp->set(buf);
-               ret->items.push_back(sp);
-           }
+           ret->items.push_back(ObjectPtr(new String(line)));
        }
+       machine.push(ret);
+       return;
+   }
+
+   FILE *fp = fopen(file.c_str(), "r");
+   struct stat st;
+   if (fp && lazy)
+   {
+       ObjectPtr stream(new LineStream(fp, false, file, limit));
+       machine.push(stream);
+   }
+   else if (fp && fstat(fileno(fp), &st) == 0 && S_ISREG(st.st_mode))
+   {
+       // The file is read rather than mapped, a mapping would fault if
+       // the file were truncated while its lines are still in use
+       ListPtr ret = MakeList();
+       ReadChunks(fp, st.st_size, limit, ret);
+       fclose(fp);
+       machine.push(ret);
+   }
+   else if (fp)
+   {
+       // pipes and devices
+       ListPtr ret = MakeList();
+       ReadLines(fp, limit, ret);
        fclose(fp);
        machine.push(ret);
    } 
@@ -259,24 +411,319 @@ void FREAD(Machine& machine)
    {
        std::stringstream strm;
        strm << "Failed to open " << file.c_str() << " for reading";
-       fclose(fp);
        throw std::runtime_error(strm.str().c_str());
    }
 }
 
-void FSAVE(Machine& machine)
+// GREP splits the files into chunks of about this size that are
+// searched in parallel. A chunk starts at the beginning of a line.
+const size_t GREP_CHUNK_BYTES = 1 << 20;
+// GREP searches the decompressed data of a gzip file as it is read, it
+// holds at most about this much of it at a time
+const size_t GREP_BATCH_BYTES = 64 << 20;
+
+struct GrepFile
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "FSAVE: Write obj at L1 to the file on L0";
-        machine.helpstrm() << "obj \"filename\" FSAVE =>";
-        machine.helpstrm() << "FSAVE/FRESTORE is suitable for writing any object to a file for editing or";
-        machine.helpstrm() << "archiving.";
-        machine.helpstrm() << "See also: FRESTORE";
+    std::string name;
+    MappedFilePtr mapped;   // regular files
+    std::string data;       // pipes and devices are read into memory
+    const char *begin;
+    const char *end;
+};
+
+struct GrepMatch
+{
+    const char *begin;      // the line holding the match
+    const char *end;
+    size_t lineno;          // newlines in the chunk before the line
+};
 
+struct GrepChunk
+{
+    const GrepFile *file;
+    const char *begin;
+    const char *end;
+    size_t offset;          // of begin in the file
+    size_t lines;           // newlines in the chunk
+    std::vector<GrepMatch> matches;
+};
+
+// Map or read a file that is not compressed
+void GrepOpen(GrepFile& file)
+{
+    file.mapped = MapFile(file.name);
+    if (file.mapped)
+    {
+        file.begin = file.mapped->data;
+        file.end = file.begin + file.mapped->size;
         return;
     }
+    if (!ReadFile(file.name, file.data))
+    {
+        std::stringstream strm;
+        strm << "GREP: Failed to open " << file.name << " for reading";
+        throw std::runtime_error(strm.str().c_str());
+    }
+    file.begin = file.data.data();
+    file.end = file.begin + file.data.size();
+}
+
+void GrepSearch(const Finder& finder, GrepChunk& chunk)
+{
+    const char *p = chunk.begin;       // always the start of a line
+    const char *counted = chunk.begin;
+    size_t lines = 0;
+    while (p < chunk.end)
+    {
+        const char *m = finder.Find(p, chunk.end);
+        if (m == nullptr)
+            break;
+        const char *bol = (const char *)memrchr(p, '\n', m - p);
+        bol = bol ? bol + 1 : p;
+        const char *eol = (const char *)memchr(m, '\n', chunk.end - m);
+        if (eol == nullptr)
+            eol = chunk.end;
+        lines += std::count(counted, bol, '\n');
+        counted = bol;
+        chunk.matches.push_back(GrepMatch{bol, eol, lines});
+        p = eol + 1;
+    }
+    chunk.lines = lines + std::count(counted, chunk.end, '\n');
+}
 
+// The lines of the chunk with a match of re, a line at a time as the
+// pattern may match a newline
+void GrepSearch(const Regex& re, GrepChunk& chunk)
+{
+    size_t lines = 0;
+    for (const char *p = chunk.begin; p < chunk.end; ++lines)
+    {
+        const char *eol = (const char *)memchr(p, '\n', chunk.end - p);
+        if (eol == nullptr)
+            eol = chunk.end;
+        if (re.Search(p, eol))
+            chunk.matches.push_back(GrepMatch{p, eol, lines});
+        if (eol == chunk.end)
+            break;
+        p = eol + 1;
+    }
+    chunk.lines = std::count(chunk.begin, chunk.end, '\n');
+}
+
+/*
+ * The chunks GREP has yet to search, in the order of the files. Data
+ * read into memory, such as the decompressed text of a gzip file, is
+ * kept until its chunks have been searched. The matches are added to
+ * the result in order.
+ */
+class GrepBatch
+{
+public:
+    GrepBatch(Machine& machine, const std::string& pattern, const Regex *re, bool many, ListPtr& result)
+    : machine_(machine)
+    , finder_(pattern)
+    , re_(re)
+    , many_(many)
+    , result_(result)
+    , text_bytes_(0)
+    , line_file_(nullptr)
+    , lineno_(1)
+    {}
+
+    // Split [begin, end), at offset in file, into chunks
+    void Add(const GrepFile& file, const char *begin, const char *end, size_t offset)
+    {
+        const char *p = begin;
+        while (p < end)
+        {
+            const char *cend = end;
+            if ((size_t)(end - p) > GREP_CHUNK_BYTES)
+            {
+                cend = (const char *)memchr(p + GREP_CHUNK_BYTES, '\n', end - p - GREP_CHUNK_BYTES);
+                cend = cend ? cend + 1 : end;
+            }
+            chunks_.push_back(GrepChunk{&file, p, cend, offset + (p - begin), 0, std::vector<GrepMatch>()});
+            p = cend;
+        }
+    }
+
+    // Add text read from file, the batch is searched once it holds
+    // GREP_BATCH_BYTES of text
+    void Add(const GrepFile& file, std::string&& text, size_t offset)
+    {
+        if (text.empty())
+            return;
+        texts_.push_back(std::move(text));
+        const std::string& t = texts_.back();
+        Add(file, t.data(), t.data() + t.size(), offset);
+        text_bytes_ += t.size();
+        if (text_bytes_ >= GREP_BATCH_BYTES)
+            Flush();
+    }
+
+    // Search the chunks and add their matches to the result
+    void Flush()
+    {
+        // the searches do not touch any Objects, a worker running GREP
+        // searches by itself as the pool is busy
+        if (chunks_.size() > 1 && machine_.parent_ == nullptr)
+        {
+            ThreadPool::Instance().Run(chunks_.size(), [&](size_t, size_t index) {
+                Search(chunks_[index]);
+            });
+        }
+        else
+        {
+            for (GrepChunk& chunk : chunks_)
+                Search(chunk);
+        }
+
+        for (GrepChunk& chunk : chunks_)
+        {
+            if (chunk.file != line_file_)
+            {
+                line_file_ = chunk.file;
+                lineno_ = 1;
+            }
+            for (GrepMatch& m : chunk.matches)
+            {
+                ListPtr item = MakeList();
+                if (many_)
+                    item->items.push_back(ObjectPtr(new String(chunk.file->name)));
+                item->items.push_back(MakeInteger(chunk.offset + (m.begin - chunk.begin)));
+                item->items.push_back(MakeInteger(lineno_ + m.lineno));
+                // copied, the text is released when the batch is searched
+                item->items.push_back(ObjectPtr(new String(m.begin, m.end)));
+                result_->items.push_back(item);
+            }
+            lineno_ += chunk.lines;
+        }
+        chunks_.clear();
+        texts_.clear();
+        text_bytes_ = 0;
+    }
+
+private:
+    void Search(GrepChunk& chunk) const
+    {
+        if (re_)
+            GrepSearch(*re_, chunk);
+        else
+            GrepSearch(finder_, chunk);
+    }
+
+    Machine& machine_;
+    Finder finder_;
+    const Regex *re_;
+    bool many_;
+    ListPtr& result_;
+    std::vector<GrepChunk> chunks_;
+    std::deque<std::string> texts_;     // a deque, the chunks point into the strings
+    size_t text_bytes_;
+    const GrepFile *line_file_;         // the file lineno_ counts the lines of
+    size_t lineno_;                     // of the first line of the next chunk
+};
+
+// Search a gzip file while it is decompressed. The text is added to the
+// batch a block at a time, cut at the end of a line.
+void GrepGzip(GrepBatch& batch, const GrepFile& file, GzipReader& gz)
+{
+    std::string carry;      // a line that goes on in the next block
+    size_t offset = 0;
+    bool more = true;
+    while (more && !bInterrupt)
+    {
+        std::string text;
+        text.swap(carry);
+        std::string block;
+        while (text.size() < GREP_CHUNK_BYTES && (more = gz.ReadBlock(block)))
+            text += block;
+        if (more)
+        {
+            size_t eol = text.rfind('\n');
+            if (eol == std::string::npos)
+            {
+                carry.swap(text);
+                continue;
+            }
+            carry.assign(text, eol + 1, std::string::npos);
+            text.resize(eol + 1);
+        }
+        size_t size = text.size();
+        batch.Add(file, std::move(text), offset);
+        offset += size;
+    }
+}
+
+void GREP(Machine& machine)
+{
+    // --regex is the only option, the string searched for can start
+    // with -- too
+    bool regex = false;
+    if (machine.stack_.size() > 2 && machine.peek(0)->type == OBJECT_STRING
+            && ((String *)machine.peek(0).get())->get() == "--regex")
+    {
+        regex = true;
+        machine.pop();
+    }
+
+    stack_required(machine, "GREP", 2);
+    throw_required(machine, "GREP", 0, OBJECT_STRING);
+    if (machine.peek(1)->type != OBJECT_LIST)
+        throw_required(machine, "GREP", 1, OBJECT_STRING);
+
+    RegexPtr re;
+    if (regex)
+        re = GetRegex(machine, ((String *)machine.peek(0).get())->get());
+    std::string pattern;
+    ObjectPtr src;
+    machine.pop(pattern);
+    machine.pop(src);
+    if (pattern.empty() || pattern.find('\n') != std::string::npos)
+        throw std::runtime_error("GREP: pattern must be a non empty single line");
+
+    std::vector<GrepFile> files;
+    bool many = src->type == OBJECT_LIST;
+    if (many)
+    {
+        List *lp = (List *)src.get();
+        files.resize(lp->items.size());
+        for (size_t i = 0; i < files.size(); ++i)
+        {
+            if (lp->items[i]->type != OBJECT_STRING)
+                throw std::runtime_error("GREP: List of file names required at L1");
+            files[i].name = ((String *)lp->items[i].get())->get();
+        }
+    }
+    else
+    {
+        files.resize(1);
+        files[0].name = ((String *)src.get())->get();
+    }
+
+    ListPtr result = MakeList();
+    GrepBatch batch(machine, pattern, re.get(), many, result);
+    for (GrepFile& file : files)
+    {
+        if (bInterrupt)
+            return;
+        std::unique_ptr<GzipReader> gz = OpenGzip(file.name);
+        if (gz)
+            GrepGzip(batch, file, *gz);
+        else
+        {
+            GrepOpen(file);
+            batch.Add(file, file.begin, file.end, 0);
+        }
+    }
+    batch.Flush();
+    if (bInterrupt)
+        return;
+    machine.push(result);
+}
+
+void FSAVE(Machine& machine)
+{
    stack_required(machine, "FSAVE", 2);
    throw_required(machine, "FSAVE", 0, OBJECT_STRING);
 
@@ -289,26 +736,27 @@ void FSAVE(Machine& machine)
    FILE *fp = fopen(file.c_str(), "w");
    if (fp)
    {
-        if (data->type == OBJECT_LIST)
         {
-            List *lp = (List *)data.get();
-            fputs("[", fp);
-            fputs("\n", fp);
-            for (ObjectPtr optr : lp->items)
+            TextWriter out(fp);
+            if (data->type == OBJECT_LIST)
             {
-                if (bInterrupt)
-                    break;
-                std::string s = ToStr(machine, optr);
-                fputs(s.c_str(), fp);
-                fputs("\n", fp);
+                List *lp = (List *)data.get();
+                out.Put("[\n", 2);
+                for (ObjectPtr& optr : lp->items)
+                {
+                    if (bInterrupt)
+                        break;
+                    out.Write(machine, optr);
+                    out.Put('\n');
+                    out.Spill();
+                }
+                out.Put(']');
+            }
+            else
+            {
+                out.Write(machine, data);
+                out.Put('\n');
             }
-            fputs("]", fp);
-        }
-        else
-        {
-            std::string s = ToStr(machine, data);
-            fputs(s.c_str(), fp);
-            fputs("\n", fp);
         }
         fclose(fp);
    }
@@ -316,20 +764,12 @@ void FSAVE(Machine& machine)
    {
        std::stringstream strm;
        strm << "Failed to open " << file.c_str() << " for writing";
-       fclose(fp);
        throw std::runtime_error(strm.str().c_str());
    }
 }
 
 void FRESTORE(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "FRESTORE: Restore a saved Object";
-        machine.helpstrm() << "\"filename\" FRESTORE => obj";
-        machine.helpstrm() << "Restore an object save with FSAVE";
-        return;
-    }
     stack_required(machine, "FRESTORE", 1);
     throw_required(machine, "FRESTORE", 0, OBJECT_STRING);
 
@@ -337,23 +777,11 @@ void FRESTORE(Machine& machine)
     machine.pop(file);
     std::string data;
 
-    FILE *fp = fopen(file.c_str(), "r");
-    if (fp)
+    if (ReadFile(file, data))
     {
-        char buf[10240];
-        while (!feof(fp))
-        {
-            if (fgets(buf, sizeof(buf), fp))
-            {
-                data.append(buf);
-            }
-        }
-        fclose(fp);
         RPNParser parser(machine);
 
-        std::stringstream strm;
-        strm.str(data);
-        Source src(strm);
+        Source src(std::move(data));
         src.interactive = false;
         src.prompt = "> ";
 
@@ -375,20 +803,12 @@ void FRESTORE(Machine& machine)
    {
        std::stringstream strm;
        strm << "Failed to open " << file.c_str() << " for reading";
-       fclose(fp);
        throw std::runtime_error(strm.str().c_str());
    }
 }
 
 void SYSTEM(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "SYSTEM or !: Execute the command at L0";
-        machine.helpstrm() << "No output is captured";
-        machine.helpstrm() << "\"command line\" SYSTEM =>";
-        return;
-    }
     stack_required(machine, "SYSTEM", 1);
     throw_required(machine, "SYSTEM", 0, OBJECT_STRING);
     std::string cmd;
@@ -6,26 +6,21 @@
 #include <cassert>
 #include <memory>
 #include <algorithm>
-#include <set>
 #include "token.h"
 #include "object.h"
 #include "module.h"
 #include "machine.h"
 #include "commands.h"
 #include "utilities.h"
+#include "pipeline.h"
+#include "table.h"
+#include "thread_pool.h"
 
 namespace rps
 {
 
 void APPEND(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "APPEND: Append the object at L0 to the list on L1" << std::endl;
-        machine.helpstrm() << "[list] \"obj\" APPEND => [list]" << std::endl;
-        return;
-    }
-
     ListPtr lp;
     ObjectPtr optr;
     stack_required(machine, "APPEND", 2);
@@ -38,15 +33,6 @@ void APPEND(Machine& machine)
 
 void GET(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "GET: Get the object in a list at the given index" << std::endl;
-        machine.helpstrm() << "[list] idx GET => obj" << std::endl;
-        machine.helpstrm() << "[list] idx GET* => [list] obj" << std::endl;
-        machine.helpstrm() << "If idx < 0 it is taken from the end of the list" << std::endl;
-        return;
-    }
-
     stack_required(machine, "GET", 2);
     throw_required(machine, "GET", 0, OBJECT_INTEGER);
     throw_required(machine, "GET", 1, OBJECT_LIST);
@@ -71,26 +57,31 @@ void GET(Machine& machine)
 
 void SUBLIST(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "SUBLIST: Push a sublist";
-        machine.helpstrm() << "[list] startpos length SUBLIST => [list]";
-        machine.helpstrm() << "If startpos is < 0, it is taken from the end of the list";
-        machine.helpstrm() << "If length < 0 it is used as the index to copy to.";
-        machine.helpstrm() << "In all cases, if length exceeds the end of the list, copy";
-        machine.helpstrm() << "to the end of the list.";
-        return;
-    }
-
     stack_required(machine, "SUBLIST", 3);
     throw_required(machine, "SUBLIST", 0, OBJECT_INTEGER);
     throw_required(machine, "SUBLIST", 1, OBJECT_INTEGER);
-    throw_required(machine, "SUBLIST", 2, OBJECT_LIST);
+    items_required(machine, "SUBLIST", 2);
 
     int64_t startpos, length;
     ListPtr lp;
     machine.pop(length);
     machine.pop(startpos);
+    if (machine.peek(0)->type == OBJECT_STREAM)
+    {
+        // the length of a Stream is not known until it is read
+        if (startpos < 0 || length < -1)
+            throw std::runtime_error("SUBLIST: startpos and length can not count from the end of a Stream");
+        ObjectPtr src;
+        machine.pop(src);
+        PipelinePtr pl = ExtendPipeline(src);
+        if (startpos > 0)
+            pl->steps.push_back(PipelineStep{PipelineStep::STEP_SKIP, ProgramPtr(), ObjectPtr(), startpos});
+        if (length >= 0)
+            pl->steps.push_back(PipelineStep{PipelineStep::STEP_TAKE, ProgramPtr(), ObjectPtr(), length});
+        ObjectPtr optr(pl);
+        machine.push(optr);
+        return;
+    }
     machine.pop(lp);
     if (startpos < 0)
     {
@@ -116,13 +107,6 @@ void SUBLIST(Machine& machine)
 
 void LINSERT(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "LINSERT: Insert an item into a list";
-        machine.helpstrm() << "[list] idx obj => [list]";
-        return;
-    }
-
     stack_required(machine, "LINSERT", 3);
     throw_required(machine, "LINSERT", 2, OBJECT_LIST);
     throw_required(machine, "LINSERT", 1, OBJECT_INTEGER);
@@ -147,12 +131,6 @@ void LINSERT(Machine& machine)
 }
 void INSERT(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "Help not available";
-        return;
-    }
-
     if (machine.stack_.size() >= 3 
             && machine.peek(2)->type == OBJECT_LIST 
             && machine.peek(1)->type == OBJECT_INTEGER)
@@ -172,14 +150,6 @@ void INSERT(Machine& machine)
 
 void ERASE(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "ERASE: Erase an item from a list or a map";
-        machine.helpstrm() << "[list] idx ERASE => [list]";
-        machine.helpstrm() << "{map} key ERASE => {map}";
-        return;
-    }
-
     stack_required(machine, "ERASE",  2);
     if (machine.peek(1)->type == OBJECT_LIST)
     {
@@ -220,15 +190,6 @@ void ERASE(Machine& machine)
 
 void CLEAR(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "CLEAR: Clear a list or map";
-        machine.helpstrm() << "[list] CLEAR => []";
-        machine.helpstrm() << "{map} CLEAR => {}";
-        machine.helpstrm() << "\"str\" CLEAR => \"\"";
-        return;
-    }
-
     stack_required(machine, "CLEAR",  1);
 
     if (machine.peek(0)->type == OBJECT_LIST)
@@ -260,16 +221,6 @@ void CLEAR(Machine& machine)
 
 void SIZE(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "SIZE: Return the size of an object";
-        machine.helpstrm() << "[list] SIZE => int";
-        machine.helpstrm() << "{map} SIZE => int";
-        machine.helpstrm() << "\"str\" SIZE => int";
-        machine.helpstrm() << "<<prog>> SIZE => int";
-        return;
-    }
-
     stack_required(machine, "SIZE", 1);
 
     if (machine.peek(0)->type == OBJECT_LIST)
@@ -288,6 +239,14 @@ void SIZE(Machine& machine)
         machine.push(sz);
         return;
     }
+    if (machine.peek(0)->type == OBJECT_TABLE)
+    {
+        ObjectPtr optr;
+        machine.pop(optr);
+        int64_t sz = ((Table *)optr.get())->Selected();
+        machine.push(sz);
+        return;
+    }
     if (machine.peek(0)->type == OBJECT_STRING)
     {
         ObjectPtr optr;
@@ -309,13 +268,6 @@ void SIZE(Machine& machine)
 
 void FIRST(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "FIRST: Get the fist element of a list";
-        machine.helpstrm() << "[list] FIRST => obj";
-        return;
-    }
-
     stack_required(machine, "FIRST", 1);
     throw_required(machine, "FIRST", 0,  OBJECT_LIST);
     machine.push(0);
@@ -324,13 +276,6 @@ void FIRST(Machine& machine)
 
 void SECOND(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "SECOND: Get the second element of a list";
-        machine.helpstrm() << "[list] SECOND => obj";
-        return;
-    }
-
     stack_required(machine, "SECOND", 1);
     throw_required(machine, "SECOND", 0, OBJECT_LIST);
     machine.push(1);
@@ -339,14 +284,31 @@ void SECOND(Machine& machine)
 
 void HEAD(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
+    stack_required(machine, "HEAD", 1);
+    if (machine.peek(0)->type == OBJECT_INTEGER)
     {
-        machine.helpstrm() << "HEAD: Get head and tail of a list";
-        machine.helpstrm() << "[obj1 obj2...objn] HEAD => [ obj1 [obj2...objn] ]";
+        // [list] n HEAD, the first n items
+        stack_required(machine, "HEAD", 2);
+        items_required(machine, "HEAD", 1);
+        int64_t count;
+        ObjectPtr src;
+        machine.pop(count);
+        machine.pop(src);
+        if (src->type == OBJECT_STREAM)
+        {
+            PushStep(machine, src, PipelineStep{PipelineStep::STEP_TAKE, ProgramPtr(), ObjectPtr(), count});
+            return;
+        }
+        ListPtr lp = static_pointer_cast<List>(src);
+        ListPtr result = MakeList();
+        if (count > 0)
+        {
+            size_t n = std::min((size_t)count, lp->items.size());
+            std::copy(lp->items.begin(), lp->items.begin()+n, std::back_inserter(result->items));
+        }
+        machine.push(result);
         return;
     }
-
-    stack_required(machine, "HEAD", 1);
     throw_required(machine, "HEAD", 0, OBJECT_LIST);
 
     ListPtr lp;
@@ -355,7 +317,7 @@ void HEAD(Machine& machine)
     {
         if (lp->items[1]->type != OBJECT_LIST)
             throw std::runtime_error("HEAD: Second element of list must be a list");
-        ListPtr tail = std::static_pointer_cast<List>(lp->items[1]);
+        ListPtr tail = static_pointer_cast<List>(lp->items[1]);
         if (tail->items.size() == 0)
         {
             lp->items.clear();
@@ -381,13 +343,6 @@ void HEAD(Machine& machine)
 
 void TOLIST(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "TOLIST: Take n items from the stack and create a list";
-        machine.helpstrm() << "obj1 obj2 obj3... nitems TOLIST => [list]";
-        return;
-    }
-
     ListPtr lp;
     lp = MakeList();
     int64_t num;
@@ -402,15 +357,296 @@ void TOLIST(Machine& machine)
     machine.push(lp);
 }
 
-void FROMLIST(Machine& machine)
+//*******************************************************************
+// sorting
+
+namespace
+{
+
+// Lists at least this long are sorted on the thread pool
+const size_t PARALLEL_SORT_MIN = 1 << 16;
+
+// The sort key of item index of a list. The key of an Integer is i and
+// s is null, the key of a String is *s. Integers come before Strings.
+struct SortKey
+{
+    int64_t i;
+    const std::string *s;
+    size_t index;
+};
+
+int CompareKeys(const SortKey& a, const SortKey& b)
+{
+    if (a.s == nullptr || b.s == nullptr)
+    {
+        if (a.s != nullptr)
+            return 1;
+        if (b.s != nullptr)
+            return -1;
+        return a.i < b.i ? -1 : (a.i > b.i ? 1 : 0);
+    }
+    return a.s->compare(*b.s);
+}
+
+// Equal keys keep the order of the list, so every sort is stable and
+// the parallel sort gives the same result as the sequential one
+struct KeyOrder
+{
+    explicit KeyOrder(bool desc) : desc(desc) {}
+
+    bool operator()(const SortKey& a, const SortKey& b) const
+    {
+        int r = CompareKeys(a, b);
+        if (r == 0)
+            return a.index < b.index;
+        return desc ? r > 0 : r < 0;
+    }
+
+    bool desc;
+};
+
+SortKey MakeKey(const char *cmd, const ObjectPtr& key, size_t index)
+{
+    SortKey k = { 0, nullptr, index };
+    if (key->type == OBJECT_INTEGER)
+        k.i = ((Integer *)key.get())->value;
+    else if (key->type == OBJECT_STRING)
+        k.s = &((String *)key.get())->get();
+    else
+    {
+        std::stringstream ss;
+        ss << cmd << ": sort keys must be Integers or Strings, got " << ObjectNames[key->type];
+        throw std::runtime_error(ss.str());
+    }
+    return k;
+}
+
+// Sort runs of the keys on the worker threads, then merge pairs of runs
+// until one is left. The keys point into Objects that are not touched,
+// so the workers need no execution context.
+void SortKeys(Machine& machine, std::vector<SortKey>& keys, KeyOrder order)
+{
+    ThreadPool& pool = ThreadPool::Instance();
+    if (machine.parent_ != nullptr || pool.size() == 1 || keys.size() < PARALLEL_SORT_MIN)
+    {
+        std::sort(keys.begin(), keys.end(), order);
+        return;
+    }
+
+    size_t runs = pool.size();
+    std::vector<size_t> bounds;
+    for (size_t r = 0; r <= runs; ++r)
+        bounds.push_back(keys.size() * r / runs);
+    pool.Run(runs, [&](size_t, size_t r) {
+        std::sort(keys.begin() + bounds[r], keys.begin() + bounds[r + 1], order);
+    });
+
+    std::vector<SortKey> buffer(keys.size());
+    std::vector<SortKey> *src = &keys;
+    std::vector<SortKey> *dst = &buffer;
+    while (bounds.size() > 2)
+    {
+        size_t pairs = (bounds.size() - 1) / 2;
+        pool.Run(pairs, [&](size_t, size_t p) {
+            std::merge(src->begin() + bounds[2 * p], src->begin() + bounds[2 * p + 1],
+                       src->begin() + bounds[2 * p + 1], src->begin() + bounds[2 * p + 2],
+                       dst->begin() + bounds[2 * p], order);
+        });
+        // an odd run out is carried over to the next round
+        if ((bounds.size() - 1) % 2)
+            std::copy(src->begin() + bounds[bounds.size() - 2], src->end(),
+                      dst->begin() + bounds[bounds.size() - 2]);
+        std::vector<size_t> merged;
+        for (size_t b = 0; b < bounds.size(); b += 2)
+            merged.push_back(bounds[b]);
+        if (merged.back() != keys.size())
+            merged.push_back(keys.size());
+        bounds.swap(merged);
+        std::swap(src, dst);
+    }
+    if (src != &keys)
+        keys.swap(buffer);
+}
+
+bool Descending(const std::vector<std::string>& args)
+{
+    for (auto& arg : args)
+    {
+        if (arg == "--desc")
+            return true;
+    }
+    return false;
+}
+
+// The items of the List or Stream at level
+void GetItems(Machine& machine, int level, std::vector<ObjectPtr>& items)
 {
-    if (machine.GetProperty("help", 0))
+    ObjectPtr src = machine.peek(level);
+    if (src->type == OBJECT_LIST)
     {
-        machine.helpstrm() << "FROMLIST: Push all items of a list to the stack";
-        machine.helpstrm() << "[list] FROMLIST => obj1, obj2, obj3...";
+        items = ((List *)src.get())->items;
         return;
     }
+    ItemReader reader(src);
+    ObjectPtr p;
+    while (reader.Next(machine, p))
+        items.push_back(p);
+}
+
+// The program at level, given as a Program or the name of one
+ObjectPtr KeyProgram(Machine& machine, const char *cmd, int level)
+{
+    ObjectPtr optr = machine.peek(level);
+    if (optr->type == OBJECT_STRING)
+        RCL(machine, ((String *)optr.get())->get(), optr);
+    if (optr->type != OBJECT_PROGRAM)
+    {
+        std::stringstream ss;
+        ss << cmd << ": Program or program name must be at level " << level;
+        throw std::runtime_error(ss.str());
+    }
+    return optr;
+}
+
+ObjectPtr EvalKey(Machine& machine, const ObjectPtr& prog, ObjectPtr item)
+{
+    ObjectPtr key;
+    machine.push(item);
+    EVAL(machine, prog);
+    machine.pop(key);
+    return key;
+}
+
+ListPtr SortedList(const std::vector<ObjectPtr>& items, const std::vector<SortKey>& keys)
+{
+    ListPtr result = MakeList();
+    result->items.reserve(keys.size());
+    for (auto& k : keys)
+        result->items.push_back(items[k.index]);
+    return result;
+}
+
+} // namespace
+
+void SORT(Machine& machine)
+{
+    std::vector<std::string> args;
+    GetArgs(machine, args);
+    stack_required(machine, "SORT", 1);
+    items_required(machine, "SORT", 0);
+
+    std::vector<ObjectPtr> items;
+    GetItems(machine, 0, items);
+    std::vector<SortKey> keys;
+    keys.reserve(items.size());
+    for (size_t i = 0; i < items.size(); ++i)
+        keys.push_back(MakeKey("SORT", items[i], i));
+    SortKeys(machine, keys, KeyOrder(Descending(args)));
+
+    ListPtr result = SortedList(items, keys);
+    machine.pop();
+    machine.push(result);
+}
+
+void SORTBY(Machine& machine)
+{
+    std::vector<std::string> args;
+    GetArgs(machine, args);
+    stack_required(machine, "SORTBY", 2);
+    items_required(machine, "SORTBY", 1);
+
+    ObjectPtr prog = KeyProgram(machine, "SORTBY", 0);
+    std::vector<ObjectPtr> items;
+    GetItems(machine, 1, items);
+    // the program runs once per item, the keys are kept for the sort
+    std::vector<ObjectPtr> values(items.size());
+    std::vector<SortKey> keys;
+    keys.reserve(items.size());
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        if (bInterrupt)
+            return;
+        values[i] = EvalKey(machine, prog, items[i]);
+        keys.push_back(MakeKey("SORTBY", values[i], i));
+    }
+    SortKeys(machine, keys, KeyOrder(Descending(args)));
+
+    ListPtr result = SortedList(items, keys);
+    machine.pop();
+    machine.pop();
+    machine.push(result);
+}
+
+void TOPK(Machine& machine)
+{
+    std::vector<std::string> args;
+    GetArgs(machine, args);
+    bool least = false;
+    for (auto& arg : args)
+    {
+        if (arg == "--least")
+            least = true;
+    }
+    stack_required(machine, "TOPK", 2);
+    throw_required(machine, "TOPK", 0, OBJECT_INTEGER);
+
+    int64_t k = ((Integer *)machine.peek(0).get())->value;
+    if (k < 0)
+        throw std::runtime_error("TOPK: k must not be negative");
+    ObjectPtr prog;
+    int level = 1;
+    if (machine.peek(1)->type == OBJECT_PROGRAM || machine.peek(1)->type == OBJECT_STRING)
+    {
+        stack_required(machine, "TOPK", 3);
+        prog = KeyProgram(machine, "TOPK", 1);
+        level = 2;
+    }
+    items_required(machine, "TOPK", level);
+
+    // The best k so far in a heap with the worst of them on top
+    struct Ranked
+    {
+        SortKey key;
+        ObjectPtr item;
+        ObjectPtr value;        // keeps the String of key alive
+    };
+    KeyOrder order(!least);
+    auto worse = [&](const Ranked& a, const Ranked& b) { return order(a.key, b.key); };
+    std::vector<Ranked> heap;
+
+    ItemReader reader(machine.peek(level));
+    ObjectPtr item;
+    for (size_t i = 0; k > 0 && reader.Next(machine, item); ++i)
+    {
+        if (bInterrupt)
+            return;
+        ObjectPtr value = prog ? EvalKey(machine, prog, item) : item;
+        SortKey key = MakeKey("TOPK", value, i);
+        if (heap.size() < (size_t)k)
+        {
+            heap.push_back(Ranked{key, item, value});
+            std::push_heap(heap.begin(), heap.end(), worse);
+        }
+        else if (order(key, heap.front().key))
+        {
+            std::pop_heap(heap.begin(), heap.end(), worse);
+            heap.back() = Ranked{key, item, value};
+            std::push_heap(heap.begin(), heap.end(), worse);
+        }
+    }
+    std::sort_heap(heap.begin(), heap.end(), worse);
+
+    ListPtr result = MakeList();
+    result->items.reserve(heap.size());
+    for (auto& r : heap)
+        result->items.push_back(r.item);
+    for (int i = 0; i <= level; ++i)
+        machine.pop();
+    machine.push(result);
+}
 
+void FROMLIST(Machine& machine)
+{
     ListPtr lp;
     machine.pop(lp);
     for (ObjectPtr op : lp->items)
@@ -421,37 +657,164 @@ void FROMLIST(Machine& machine)
 
 void CREATELIST(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "CREATELIST: Create a list";
-        machine.helpstrm() << "CREATELIST => []";
-        return;
-    }
-
     ListPtr lp = MakeList();
     machine.push(lp);
 }
 
+namespace
+{
+
+/*
+ * The items UNIQUE has kept, an open addressing table of their positions
+ * in the result with the low bits of their hashes. Strings and Integers
+ * are equal if their values are, like Map keys.
+ */
+class ItemSet
+{
+public:
+    explicit ItemSet(std::vector<ObjectPtr>& kept) : kept_(kept), slots_(16, Slot{EMPTY, 0}) {}
+
+    // Add item to kept if it is not there yet
+    void Insert(const ObjectPtr& item)
+    {
+        if ((kept_.size() + 1) * 2 > slots_.size())
+            Grow();
+        size_t hash = KeyHash(item.get());
+        size_t i = Lookup(item.get(), hash);
+        if (slots_[i].item != EMPTY)
+            return;
+        slots_[i] = Slot{(uint32_t)kept_.size(), (uint32_t)hash};
+        kept_.push_back(item);
+    }
+
+private:
+    static const uint32_t EMPTY = UINT32_MAX;
+
+    struct Slot
+    {
+        uint32_t item;      // index into kept_, EMPTY if the slot is free
+        uint32_t hash;
+    };
+
+    size_t Lookup(const Object *item, size_t hash) const
+    {
+        size_t mask = slots_.size() - 1;
+        for (size_t i = hash & mask; ; i = (i + 1) & mask)
+        {
+            const Slot& slot = slots_[i];
+            if (slot.item == EMPTY)
+                return i;
+            if (slot.hash == (uint32_t)hash && KeyEqual(kept_[slot.item].get(), item))
+                return i;
+        }
+    }
+
+    void Grow()
+    {
+        std::vector<Slot> old(slots_.size() * 2, Slot{EMPTY, 0});
+        old.swap(slots_);
+        size_t mask = slots_.size() - 1;
+        for (auto& slot : old)
+        {
+            if (slot.item == EMPTY)
+                continue;
+            // the kept items are distinct, only a free slot is needed
+            size_t i = KeyHash(kept_[slot.item].get()) & mask;
+            while (slots_[i].item != EMPTY)
+                i = (i + 1) & mask;
+            slots_[i] = slot;
+        }
+    }
+
+    std::vector<ObjectPtr>& kept_;
+    std::vector<Slot> slots_;   // a power of 2 in size, at most half used
+};
+
+/*
+ * The 64 bit hashes of the items seen by UNIQUE --fingerprint. Only the
+ * hashes are kept, the items are never compared, so two items with the
+ * same hash count as one.
+ */
+class FingerprintSet
+{
+public:
+    FingerprintSet() : used_(0), slots_(16, 0) {}
+
+    // false if hash was already there
+    bool Insert(uint64_t hash)
+    {
+        if (hash == 0)
+            hash = 1;   // 0 marks a free slot
+        if ((used_ + 1) * 2 > slots_.size())
+            Grow();
+        size_t i = Lookup(hash);
+        if (slots_[i] == hash)
+            return false;
+        slots_[i] = hash;
+        ++used_;
+        return true;
+    }
+
+private:
+    size_t Lookup(uint64_t hash) const
+    {
+        size_t mask = slots_.size() - 1;
+        size_t i = hash & mask;
+        while (slots_[i] != 0 && slots_[i] != hash)
+            i = (i + 1) & mask;
+        return i;
+    }
+
+    void Grow()
+    {
+        std::vector<uint64_t> old(slots_.size() * 2, 0);
+        old.swap(slots_);
+        for (uint64_t hash : old)
+        {
+            if (hash)
+                slots_[Lookup(hash)] = hash;
+        }
+    }
+
+    size_t used_;
+    std::vector<uint64_t> slots_;
+};
+
+} // namespace
+
 void UNIQUE(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
+    std::vector<std::string> args;
+    GetArgs(machine, args);
+    bool fingerprint = false;
+    for (auto& arg : args)
     {
-        machine.helpstrm() << "UNIQUE: Returns a unique list of items from a List";
-        machine.helpstrm() << "[list] UNIQUE => [list]";
-        return;
+        if (arg == "--fingerprint")
+            fingerprint = true;
     }
     stack_required(machine, "UNIQUE", 1);
-    throw_required(machine, "UNIQUE", 0, OBJECT_LIST);
-    std::set<ObjectPtr> oset;
+    items_required(machine, "UNIQUE", 0);
+
+    ObjectPtr src = machine.peek(0);
+    ListPtr rtn = MakeList();
+    ItemReader items(src);
     ObjectPtr optr;
-    machine.pop(optr);
-    List *lp = (List *)optr.get();
-    for (ObjectPtr op : lp->items)
+    if (fingerprint)
     {
-        oset.insert(op);
+        FingerprintSet seen;
+        while (items.Next(machine, optr))
+        {
+            if (seen.Insert(KeyHash(optr.get())))
+                rtn->items.push_back(optr);
+        }
     }
-    ListPtr rtn = MakeList();
-    std::copy(oset.begin(), oset.end(), std::back_inserter(rtn->items));
+    else
+    {
+        ItemSet seen(rtn->items);
+        while (items.Next(machine, optr))
+            seen.Insert(optr);
+    }
+    machine.pop();
     machine.push(rtn);
 }
 
@@ -460,25 +823,12 @@ void UNIQUE(Machine& machine)
 
 void CREATEMAP(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "CREATEMAP: Create a map";
-        machine.helpstrm() << "CREATEMAP => {}";
-        return;
-    }
-
     MapPtr mp = MakeMap();
     machine.push(mp);
 }
 
 void KEYS(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "KEYS: Get a list of keys";
-        machine.helpstrm() << "{map} KEYS => [list]";
-        return;
-    }
     stack_required(machine, "KEYS", 1);
     throw_required(machine, "KEYS", 0, OBJECT_MAP);
 
@@ -486,6 +836,7 @@ void KEYS(Machine& machine)
     machine.pop(optr);
     Map *pMap = (Map *)optr.get();
     ListPtr lp = MakeList();
+    lp->items.reserve(pMap->items.size());
     for (auto& pr : pMap->items)
     {
         lp->items.push_back(pr.first);
@@ -495,12 +846,6 @@ void KEYS(Machine& machine)
 
 void VALUES(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "VALUES: Get a list of values";
-        machine.helpstrm() << "{map} VALUES => [list]";
-        return;
-    }
     stack_required(machine, "VALUES", 1);
     throw_required(machine, "VALUES", 0, OBJECT_MAP);
 
@@ -508,6 +853,7 @@ void VALUES(Machine& machine)
     machine.pop(optr);
     Map *pMap = (Map *)optr.get();
     ListPtr lp = MakeList();
+    lp->items.reserve(pMap->items.size());
     for (auto& pr : pMap->items)
     {
         lp->items.push_back(pr.second);
@@ -517,19 +863,10 @@ void VALUES(Machine& machine)
 
 void FIND(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "FIND: Find an item in a map";
-        machine.helpstrm() << "{map} key onError FIND => obj";
-        machine.helpstrm() << "key: Either a string or integer key";
-        machine.helpstrm() << "onError: If the key is not found, this is the value placed on L0";
-        return;
-    }
-
     stack_required(machine, "FIND", 3);
     throw_required(machine, "FIND", 2, OBJECT_MAP);
     if (machine.peek(1)->type != OBJECT_INTEGER && machine.peek(1)->type != OBJECT_STRING)
-        throw std::runtime_error("GET: requires Integer or String key for Map");
+        throw std::runtime_error("FIND: requires Integer or String key for Map");
     ObjectPtr key;
     MapPtr mp;
     ObjectPtr onError;
@@ -547,14 +884,6 @@ void FIND(Machine& machine)
 
 void MINSERT(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "MINSERT: Insert into a map";
-        machine.helpstrm() << "{map} [k,v] => {map}";
-        machine.helpstrm() << "list: A tuple of a Key-Value pair";
-        return;
-    }
-
     stack_required(machine, "MINSERT",  2);
     throw_required(machine, "MINSERT",  1, OBJECT_MAP);
     throw_required(machine, "MINSERT",  0, OBJECT_LIST);
@@ -569,17 +898,12 @@ void MINSERT(Machine& machine)
 
 void TOMAP(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "TOMAP: Take n tuples from the stack and create a map";
-        machine.helpstrm() << "[k,v] [k,v] [k,v]... nitems TOMAP => {map}";
-        return;
-    }
-
     MapPtr mp;
     mp = MakeMap();
     int64_t num;
     machine.pop(num);
+    if (num > 0)
+        mp->items.reserve(num);
     while (num--)
     {
         ListPtr lp;
@@ -591,13 +915,6 @@ void TOMAP(Machine& machine)
 
 void FROMMAP(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "FROMMAP: Push all key/values of a map onto the stack";
-        machine.helpstrm() << "{map} FROMMAP => [k, v] [k, v] [k,v]...";
-        return;
-    }
-
     MapPtr mp;
     machine.pop(mp);
     for (auto& pr :mp->items)
@@ -611,13 +928,6 @@ void FROMMAP(Machine& machine)
 
 void REVERSE(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "REVERSE: Reverse a list";
-        machine.helpstrm() << "[obj1 obj2...objn] REVERSE => [objn...obj2 obj1]";
-        return;
-    }
-
     stack_required(machine, "REVERSE", 1);
     throw_required(machine, "REVERSE", 0, OBJECT_LIST);
 
@@ -627,18 +937,40 @@ void REVERSE(Machine& machine)
     machine.push(lp);
 }
 
-void ZIP(Machine& machine)
+void COLLECT(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
+    stack_required(machine, "COLLECT", 1);
+    items_required(machine, "COLLECT", 0);
+
+    ObjectPtr src;
+    machine.pop(src);
+    if (src->type == OBJECT_LIST)
     {
-        machine.helpstrm() << "ZIP: zip two lists together";
-        machine.helpstrm() << "[list1] [list] <<prog>> ZIP => [list]";
-        machine.helpstrm() << "[list1] [list] \"prog_name\" ZIP => [list]";
-        machine.helpstrm() << "prog receives two items, one from each list and should return";
-        machine.helpstrm() << "an object to be placed on the returned list.";
-        machine.helpstrm() << "If one list is shorter than the other, None will be passed.";
+        machine.push(src);
         return;
     }
+    ListPtr result = MakeList();
+    ItemReader items(src);
+    ObjectPtr p;
+    while (items.Next(machine, p))
+        result->items.push_back(p);
+    machine.push(result);
+}
+
+void LAZY(Machine& machine)
+{
+    stack_required(machine, "LAZY", 1);
+    items_required(machine, "LAZY", 0);
+
+    ObjectPtr src;
+    machine.pop(src);
+    if (src->type == OBJECT_LIST)
+        src.reset(new Pipeline(src));
+    machine.push(src);
+}
+
+void ZIP(Machine& machine)
+{
     stack_required(machine, "ZIP", 3);
     throw_required(machine, "ZIP", 1, OBJECT_LIST);
     throw_required(machine, "ZIP", 2, OBJECT_LIST);
@@ -657,7 +989,7 @@ void ZIP(Machine& machine)
     if (optr->type != OBJECT_PROGRAM)
         throw std::runtime_error("ZIP: Program or program name must be at level 0");
 
-    pptr = std::static_pointer_cast<Program>(optr);
+    pptr = static_pointer_cast<Program>(optr);
 
     machine.pop(lp2);
     machine.pop(lp1);
@@ -701,16 +1033,6 @@ void ZIP(Machine& machine)
 
 void UNZIP(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "UNZIP: unzip a list into two lists";
-        machine.helpstrm() << "[list] <<prog>> UNZIP => [list1] [list]";
-        machine.helpstrm() << "[list] \"prog_name\" UNZIP => [list1] [list]";
-        machine.helpstrm() << "prog receives a list item and should return two items to be placed";
-        machine.helpstrm() << "on each list";
-        return;
-    }
-
     stack_required(machine, "UNZIP", 2);
     throw_required(machine, "UNZIP", 1, OBJECT_LIST);
 
@@ -729,7 +1051,7 @@ void UNZIP(Machine& machine)
     if (optr->type != OBJECT_PROGRAM)
         throw std::runtime_error("UNZIP: Program or program name must be at level 0");
 
-    pptr = std::static_pointer_cast<Program>(optr);
+    pptr = static_pointer_cast<Program>(optr);
 
     machine.pop(lp);
 
@@ -30,8 +30,8 @@ void LogicalInteger(Machine& machine, ObjectPtr olhs, ObjectPtr orhs, Operator o
 {
     assert(olhs->type == OBJECT_INTEGER);
     assert(orhs->type == OBJECT_INTEGER);
-    IntegerPtr lhs = std::static_pointer_cast<Integer>(olhs);
-    IntegerPtr rhs = std::static_pointer_cast<Integer>(orhs);
+    IntegerPtr lhs = static_pointer_cast<Integer>(olhs);
+    IntegerPtr rhs = static_pointer_cast<Integer>(orhs);
     switch (oper)
     {
     case OP_EQ:
@@ -67,8 +67,8 @@ void LogicalString(Machine& machine, ObjectPtr olhs, ObjectPtr orhs, Operator op
 {
     assert(olhs->type == OBJECT_STRING);
     assert(orhs->type == OBJECT_STRING);
-    StringPtr lhs = std::static_pointer_cast<String>(olhs);
-    StringPtr rhs = std::static_pointer_cast<String>(orhs);
+    StringPtr lhs = static_pointer_cast<String>(olhs);
+    StringPtr rhs = static_pointer_cast<String>(orhs);
     switch (oper)
     {
     case OP_EQ:
@@ -102,14 +102,6 @@ void LogicalString(Machine& machine, ObjectPtr olhs, ObjectPtr orhs, Operator op
 
 void EQ(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "EQ: Compare for equality";
-        machine.helpstrm() << "\"str1\" \"str2\" EQ => int";
-        machine.helpstrm() << "int1 int2 EQ => int";
-        return;
-    }
-
     ObjectPtr lhs, rhs;
     stack_required(machine, "EQ", 2);
     machine.pop(rhs);
@@ -128,14 +120,6 @@ void EQ(Machine& machine)
 
 void NEQ(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "NEQ: Compare for not equal";
-        machine.helpstrm() << "\"str1\" \"str2\" NEQ => int";
-        machine.helpstrm() << "int1 int2 NEQ => int";
-        return;
-    }
-
     stack_required(machine, "NEQ", 2);
     ObjectPtr lhs, rhs;
 
@@ -155,14 +139,6 @@ void NEQ(Machine& machine)
 
 void LT(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "LT: Compare for less than";
-        machine.helpstrm() << "\"str1\" \"str2\" LT => int";
-        machine.helpstrm() << "int1 int2 LT => int";
-        return;
-    }
-
     stack_required(machine, "LT", 2);
     ObjectPtr lhs, rhs;
 
@@ -182,14 +158,6 @@ void LT(Machine& machine)
 
 void LTEQ(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "LTEQ: Compare for less than or equal";
-        machine.helpstrm() << "\"str1\" \"str2\" LTEQ => int";
-        machine.helpstrm() << "int1 int2 LTEQ => int";
-        return;
-    }
-
     stack_required(machine, "LTEQ", 2);
     ObjectPtr lhs, rhs;
 
@@ -209,14 +177,6 @@ void LTEQ(Machine& machine)
 
 void GT(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "GT: Compare for greater than";
-        machine.helpstrm() << "\"str1\" \"str2\" GT => int";
-        machine.helpstrm() << "int1 int2 GT => int";
-        return;
-    }
-
     stack_required(machine, "GT", 2);
     ObjectPtr lhs, rhs;
 
@@ -236,14 +196,6 @@ void GT(Machine& machine)
 
 void GTEQ(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "GTEQ: Compare for greater than or equal";
-        machine.helpstrm() << "\"str1\" \"str2\" GTEQ => int";
-        machine.helpstrm() << "int1 int2 GTEQ => int";
-        return;
-    }
-
     stack_required(machine, "GTEQ", 2);
     ObjectPtr lhs, rhs;
 
@@ -263,14 +215,6 @@ void GTEQ(Machine& machine)
 
 void AND(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "AND: Logical AND";
-        machine.helpstrm() << "\"str1\" \"str2\" AND => int";
-        machine.helpstrm() << "int1 int2 AND => int";
-        return;
-    }
-
     stack_required(machine, "AND", 2);
     ObjectPtr lhs, rhs;
 
@@ -288,14 +232,6 @@ void AND(Machine& machine)
 
 void OR(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "OR: Logical OR";
-        machine.helpstrm() << "\"str1\" \"str2\" OR => int";
-        machine.helpstrm() << "int1 int2 OR => int";
-        return;
-    }
-
     stack_required(machine, "OR", 2);
     ObjectPtr lhs, rhs;
 
@@ -315,13 +251,6 @@ void OR(Machine& machine)
 
 void NOT(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "NOT: Logical NOT";
-        machine.helpstrm() << "int NOT => int";
-        return;
-    }
-
     stack_required(machine, "NOT", 1);
     ObjectPtr rhs;
 
@@ -6,6 +6,7 @@
 #include <cassert>
 #include <memory>
 #include <algorithm>
+#include <mutex>
 #include "token.h"
 #include "object.h"
 #include "module.h"
@@ -19,24 +20,114 @@ namespace rps
 bool bInterrupt = false;
 
 Machine::Machine()
+: modules_(own_modules_)
+, generation_(0)
+, commands(own_commands_)
+, properties(own_properties_)
+, aliases(own_aliases_)
+, debug_(false)
+, parent_(nullptr)
 {
     SetProperty("viewwidth", 120);
     SetProperty("debug", 0);
-    SetProperty("help", 0);
+    RegisterCommands(*this);
+}
+
+// Execution context of a worker thread. It has its own stack, frames and
+// locals and reads the modules, commands, properties and aliases of the
+// parent, which do not change while workers run. The locals of the
+// parent's frames are found through parent_. Names are interned in the
+// parent, the compiled programs refer to its symbols.
+Machine::Machine(Machine *parent)
+: modules_(parent->modules_)
+, current_module_(parent->current_module_)
+, generation_(parent->generation_)
+, commands(parent->commands)
+, properties(parent->properties)
+, aliases(parent->aliases)
+, debug_(parent->debug_)
+, parent_(parent)
+{
+}
+
+void Machine::Shared(const char *cmd) const
+{
+    if (parent_)
+    {
+        std::stringstream strm;
+        strm << cmd << ": A program run in parallel can not change variables, commands or properties";
+        throw std::runtime_error(strm.str());
+    }
+}
+
+namespace
+{
+std::mutex intern_mutex;
 }
 
 void Machine::CreateModule(const std::string& name)
 {
+    Shared("IMPORT");
     Module mod;
     mod.module_name_ = name;
-    modules_.emplace(name, std::move(mod));
+    if (modules_.emplace(name, std::move(mod)).second)
+        ++generation_;
+}
+
+const Symbol& Machine::Intern(const std::string& name)
+{
+    if (parent_)
+    {
+        std::lock_guard<std::mutex> lock(intern_mutex);
+        return parent_->Intern(name);
+    }
+    auto it = symbols_.find(name);
+    if (it != symbols_.end())
+        return it->second;
+    Symbol sym;
+    size_t n = name.find_first_of('.');
+    sym.qualified = n != std::string::npos;
+    if (sym.qualified)
+    {
+        sym.module = name.substr(0, n);
+        sym.name = name.substr(n + 1);
+    }
+    else
+        sym.name = name;
+    return symbols_.emplace(name, sym).first->second;
+}
+
+void Machine::PushFrame(Program *pp)
+{
+    frames_.emplace_back();
+    Frame& frame = frames_.back();
+    frame.program = pp;
+    frame.base = locals_.size();
+    frame.count = pp->local_names.size();
+    frame.restore_module = current_module_ != pp->module_name;
+    if (frame.restore_module)
+    {
+        frame.module.swap(current_module_);
+        current_module_ = pp->module_name;
+    }
+    locals_.resize(frame.base + frame.count);
+}
+
+void Machine::PopFrame()
+{
+    Frame& frame = frames_.back();
+    if (frame.restore_module)
+        current_module_.swap(frame.module);
+    else if (current_module_ != frame.program->module_name)
+        current_module_ = frame.program->module_name;     // the program ran SETNS
+    locals_.resize(frame.base);
+    frames_.pop_back();
 }
 
 void Machine::push(ObjectPtr& optr)
 {
-    int64_t debug = GetProperty("debug", 0);
     assert(optr->type != OBJECT_COMMAND);
-    if (debug)
+    if (debug_)
         std::cout << "push: " << ToStr(*this, optr) << std::endl;
     stack_.push_back(optr);
 }
@@ -50,11 +141,10 @@ void Machine::pop()
 
 void Machine::pop(ObjectPtr& optr)
 {
-    int64_t debug = GetProperty("debug", 0);
     if (stack_.empty())
         throw std::runtime_error("stack underflow");
     optr = stack_.back();
-    if (debug)
+    if (debug_)
         std::cout << "pop: " << ToStr(*this, optr) << std::endl;
     stack_.pop_back();
 }
@@ -77,8 +167,7 @@ void Machine::pop(int64_t& v)
 
 void Machine::push(int64_t v)
 {
-    ObjectPtr optr;
-    optr.reset(new Integer(v));
+    ObjectPtr optr = MakeInteger(v);
     push(optr);
 }
 
@@ -94,7 +183,7 @@ void Machine::pop(ListPtr& lp)
     }
     ObjectPtr optr;
     pop(optr);
-    lp = std::static_pointer_cast<List>(optr);
+    lp = static_pointer_cast<List>(optr);
 }
 
 void Machine::push(ListPtr& lp)
@@ -115,7 +204,7 @@ void Machine::pop(MapPtr& mp)
     }
     ObjectPtr optr;
     pop(optr);
-    mp = std::static_pointer_cast<Map>(optr);
+    mp = static_pointer_cast<Map>(optr);
 }
 
 void Machine::push(MapPtr& mp)
@@ -136,7 +225,7 @@ void Machine::pop(ProgramPtr& pp)
     }
     ObjectPtr optr;
     pop(optr);
-    pp = std::static_pointer_cast<Program>(optr);
+    pp = static_pointer_cast<Program>(optr);
 }
 
 void Machine::push(ProgramPtr& pp)
@@ -185,21 +274,28 @@ ObjectPtr& Machine::peek(size_t n)
 
 void Machine::SetProperty(const std::string& name, int64_t n)
 {
-    IntegerPtr ip = MakeInteger();
-    ip->value = n;
-    properties[name] = ip;
+    Shared("SETPROPERTY");
+    properties[name] = MakeInteger(n);
+    if (name == "debug")
+        debug_ = n != 0;
 }
 
 void Machine::SetProperty(const std::string& name, const std::string& value)
 {
+    Shared("SETPROPERTY");
     StringPtr sp = MakeString();
     sp->set(value);
     properties[name] = sp;
+    if (name == "debug")
+        debug_ = false;
 }
 
 void Machine::SetProperty(const std::string& name, ObjectPtr optr)
 {
+    Shared("SETPROPERTY");
     properties[name] = optr;
+    if (name == "debug")
+        debug_ = GetProperty("debug", 0) != 0;
 }
 
 int64_t Machine::GetProperty(const std::string& name, int64_t def)
@@ -234,6 +330,7 @@ ObjectPtr Machine::GetProperty(const std::string& name)
 
 void Machine::AddAlias(const std::string& name, const std::vector<std::string>& vec)
 {
+    Shared("ALIAS");
     aliases[name] = vec;
 }
 
@@ -246,26 +343,11 @@ std::vector<std::string> * Machine::GetAlias(const std::string& name)
 }
 
 
-std::ostream& Machine::helpstrm()
-{
-    if (hstrm.str().size())
-        hstrm << std::endl;
-    return hstrm;
-}
 std::string GetFunctionSynopsis(Machine& machine, const std::string& cmd)
 {
     auto it = machine.commands.find(cmd);
-    if (it != machine.commands.end())
-    {
-        machine.SetProperty("help", 1);
-        machine.hstrm.str("");
-        (*it->second->funcptr)(machine);
-        machine.SetProperty("help", 0);
-        std::string s = machine.hstrm.str();
-        size_t pos = s.find_first_of('\n');
-        if (pos != std::string::npos)
-            return s.substr(0, pos);
-    }
+    if (it != machine.commands.end() && it->second->info)
+        return it->second->info->synopsis;
     return "";
 }
 
@@ -284,26 +366,20 @@ void ShowCategory(Machine& machine, const std::string& cat)
 
 void ShowHelp(Machine& machine, CommandPtr cmd)
 {
-    if (cmd->funcptr == nullptr)
+    const CommandInfo *info = cmd->info;
+    if (info == nullptr)
     {
         std::cout << "Help not available for Registered programs" << std::endl;
         return;
     }
-    machine.SetProperty("help", 1);
-    machine.hstrm.str("");
-    (*cmd->funcptr)(machine);
-    machine.SetProperty("help", 0);
-    std::cout << std::endl << machine.hstrm.str() << std::endl;
+    std::cout << std::endl << info->synopsis << std::endl << info->signature << std::endl;
+    if (*info->details)
+        std::cout << info->details << std::endl;
+    std::cout << std::endl;
 }
 
 void HELP(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "HELP: HELP system";
-        machine.helpstrm() << "HELP =>";
-        return;
-    }
     while (true)
     {
         for (auto& pr : machine.categories)
@@ -347,6 +423,13 @@ void throw_required(Machine& machine, const char *f, int level, ObjectType t)
     }
 }
 
+// A List or a Stream
+void items_required(Machine& machine, const char *f, int level)
+{
+    if (machine.peek(level)->type != OBJECT_STREAM)
+        throw_required(machine, f, level, OBJECT_LIST);
+}
+
 void stack_required(Machine& machine, const char *f, int depth)
 {
     if (machine.stack_.size() < depth-1)
@@ -358,20 +441,30 @@ void stack_required(Machine& machine, const char *f, int depth)
 }
 
 
-void AddCommand(Machine& machine, const std::string& name, void (*funcptr)(Machine&))
+void AddCommand(Machine& machine, const CommandInfo& info)
 {
+    machine.Shared("REGISTER");
     CommandPtr cp;
-    cp.reset(new Command(name, funcptr));
-    machine.commands.emplace(name, cp);
+    cp.reset(new Command(info.name, &info, info.funcptr));
+    machine.commands.emplace(info.name, cp);
+    if (info.category)
+        Category(machine, info.category, info.name);
+}
 
-    cp.reset(new Command(name+"?", funcptr));
-    machine.commands.emplace(name+"?", cp);
+void AddSynonym(Machine& machine, const std::string& name, const std::string& cmd)
+{
+    machine.Shared("REGISTER");
+    const CommandInfo *info = machine.commands.at(cmd)->info;
+    CommandPtr cp;
+    cp.reset(new Command(name, info, info->funcptr));
+    machine.commands.emplace(name, cp);
 }
 
 void AddCommand(Machine& machine, const std::string& name, ProgramPtr pptr)
 {
+    machine.Shared("REGISTER");
     CommandPtr cp;
-    cp.reset(new Command(name, nullptr));
+    cp.reset(new Command(name, nullptr, nullptr));
     cp->program = pptr;
     machine.commands.emplace(name, cp);
 
@@ -380,6 +473,7 @@ void AddCommand(Machine& machine, const std::string& name, ProgramPtr pptr)
 
 void RemoveCommand(Machine& machine, const std::string& name)
 {
+    machine.Shared("UNREGISTER");
     machine.commands.erase(name);
 
     std::set<std::string>& st = machine.categories["RegisteredPrograms"];
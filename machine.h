@@ -10,20 +10,53 @@ namespace rps
 extern bool bInterrupt;
 
 class Command;
-typedef std::shared_ptr<Command> CommandPtr;
+typedef Ref<Command> CommandPtr;
+class Regex;
+
+// Static description of a builtin command, see command_table.cpp
+struct CommandInfo
+{
+    const char *name;
+    void (*funcptr)(Machine&);
+    const char *category;       // nullptr if not listed by HELP
+    const char *synopsis;
+    const char *signature;      // stack picture, one line per form
+    const char *details;
+};
+
+// Activation record of a running program. Its local variables are
+// Machine::locals_[base, base+count), indexed by Program::local_names.
+struct Frame
+{
+    Program *program;
+    size_t base;
+    size_t count;
+    bool restore_module;        // module is the caller's module
+    std::string module;
+};
 
 class Machine
 {
 public:
     Machine();
+    explicit Machine(Machine *parent);
     void push(ObjectPtr& ptr);
-    std::unordered_map<std::string, Module> modules_;
+    // A worker shares the modules, commands, properties and aliases of
+    // its parent and may only read them, see Shared
+    std::unordered_map<std::string, Module>& modules_;
     std::vector<ObjectPtr> stack_;
     std::string current_module_;
-    ProgramPtr current_program;
+    std::vector<Frame> frames_;
+    std::vector<ObjectPtr> locals_;
+
+    void PushFrame(Program *pp);
+    void PopFrame();
+
+    std::unordered_map<std::string, Symbol> symbols_;
+    uint64_t generation_;       // bumped when modules are created or imported
+    const Symbol& Intern(const std::string& name);
 
     void CreateModule(const std::string& name);
-    std::ostream& helpstrm();
 
     ObjectPtr& peek();
     ObjectPtr& peek(size_t n);
@@ -51,25 +84,41 @@ public:
     void AddAlias(const std::string&, const std::vector<std::string>&);
     std::vector<std::string> * GetAlias(const std::string&);
 
-    std::unordered_map<std::string, CommandPtr> commands;
+    std::unordered_map<std::string, CommandPtr>& commands;
     std::unordered_map<std::string, std::set<std::string>> categories;
-    std::unordered_map<std::string, ObjectPtr> properties;
-    std::unordered_map<std::string, std::vector<std::string>> aliases;
-    std::stringstream hstrm;
+    std::unordered_map<std::string, ObjectPtr>& properties;
+    std::unordered_map<std::string, std::vector<std::string>>& aliases;
+    std::unordered_map<std::string, std::shared_ptr<const Regex>> regexes_;    // see GetRegex
+    std::unordered_map<std::string, ObjectPtr> keys_;   // see InternKey
+    bool debug_;        // cached "debug" property, checked on every push and pop
+    Machine *parent_;   // set in the context of a worker thread
+
+    // Throws naming cmd in a worker, called before the shared state is
+    // changed
+    void Shared(const char *cmd) const;
+
+private:
+    // The state a Machine that is not a worker owns
+    std::unordered_map<std::string, Module> own_modules_;
+    std::unordered_map<std::string, CommandPtr> own_commands_;
+    std::unordered_map<std::string, ObjectPtr> own_properties_;
+    std::unordered_map<std::string, std::vector<std::string>> own_aliases_;
 };
 
 
 void stack_required(Machine& machine, const char *f, int depth);
 void throw_required(Machine& machine, const char *f, int level, ObjectType t);
+void items_required(Machine& machine, const char *f, int level);
 void Execute(Machine&);
 void Execute(Machine&, ObjectPtr);
 
 class Program;
-typedef std::shared_ptr<Program> ProgramPtr;
+typedef Ref<Program> ProgramPtr;
 
 void Category(Machine& machine, const std::string& cat, const std::string& name);
-void AddCommand(Machine& machine, const std::string& name, void (*funcptr)(Machine&));
+void AddCommand(Machine& machine, const CommandInfo&);
 void AddCommand(Machine& machine, const std::string&, ProgramPtr);
+void AddSynonym(Machine& machine, const std::string& name, const std::string& cmd);
 void RemoveCommand(Machine& machine, const std::string&);
 void ShowHelp(Machine& machine, CommandPtr cmd);
 
@@ -13,13 +13,6 @@ namespace rps
 
 void ADD(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "ADD: Addition";
-        machine.helpstrm() << "int1 int2 ADD => int";
-        return;
-    }
-
     int64_t arg1, arg2;
     stack_required(machine, "ADD", 2);
     throw_required(machine, "ADD", 0, OBJECT_INTEGER);
@@ -31,13 +24,6 @@ void ADD(Machine& machine)
 
 void SUB(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "SUB: Subraction";
-        machine.helpstrm() << "int1 int2 SUB => int";
-        return;
-    }
-
     int64_t arg1, arg2;
     stack_required(machine, "SUB", 2);
     throw_required(machine, "SUB", 0, OBJECT_INTEGER);
@@ -49,13 +35,6 @@ void SUB(Machine& machine)
 
 void MUL(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "MUL: Multilication";
-        machine.helpstrm() << "int1 int2 MUL => int";
-        return;
-    }
-
     int64_t arg1, arg2;
     stack_required(machine, "MUL", 2);
     throw_required(machine, "MUL", 0, OBJECT_INTEGER);
@@ -67,13 +46,6 @@ void MUL(Machine& machine)
 
 void DIV(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "DIV: Division";
-        machine.helpstrm() << "int1 int2 DIV => int";
-        return;
-    }
-
     int64_t arg1, arg2;
     stack_required(machine, "DIV", 2);
     throw_required(machine, "DIV", 0, OBJECT_INTEGER);
@@ -85,13 +57,6 @@ void DIV(Machine& machine)
 
 void INC(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "INC: Increment";
-        machine.helpstrm() << "int INC => int";
-        return;
-    }
-
     stack_required(machine, "INC", 1);
     throw_required(machine, "INC", 0, OBJECT_INTEGER);
     int64_t n;
@@ -102,13 +67,6 @@ void INC(Machine& machine)
 
 void DEC(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "DEC: Decrement";
-        machine.helpstrm() << "int DEC => int";
-        return;
-    }
-
     stack_required(machine, "DEC", 1);
     throw_required(machine, "DEC", 0, OBJECT_INTEGER);
     int64_t n;
@@ -4,4 +4,27 @@
 #include "module.h"
 #include "machine.h"
 
+namespace rps
+{
+
+ObjectPtr *Module::Find(const std::string& name)
+{
+    auto it = slots_.find(name);
+    if (it == slots_.end())
+        return nullptr;
+    return &values_[it->second];
+}
+
+size_t Module::Slot(const std::string& name)
+{
+    auto it = slots_.find(name);
+    if (it != slots_.end())
+        return it->second;
+    names_.push_back(name);
+    values_.emplace_back();
+    slots_.emplace(name, names_.size() - 1);
+    return names_.size() - 1;
+}
+
+} // namespace rps
 
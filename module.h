@@ -1,16 +1,47 @@
 #pragma once
 
 #include <unordered_map>
+#include <vector>
+#include <string>
+#include <cstdint>
 
 namespace rps
 {
 
+/*
+ * Module variables live in a vector of slots. A slot is never removed,
+ * so a slot index stays valid for the life of the module.
+ */
 class Module
 {
 public:
 
     std::string module_name_;
-    std::unordered_map<std::string, ObjectPtr> variables_;
+    std::vector<std::string> names_;            // variable name of each slot
+    std::vector<ObjectPtr> values_;
+    std::unordered_map<std::string, size_t> slots_;
+
+    ObjectPtr *Find(const std::string& name);   // nullptr if never stored
+    size_t Slot(const std::string& name);       // find or add the slot for name
+};
+
+// A global variable name split into its module and variable parts
+struct Symbol
+{
+    bool qualified;         // name was "module.var"
+    std::string module;
+    std::string name;
+};
+
+// Per call site cache of the slot a Symbol resolved to. It is valid while
+// Machine::generation_ is unchanged and, for unqualified names, while the
+// current module is the cached module.
+struct GlobalCache
+{
+    const Symbol *symbol;
+    Module *module;
+    size_t slot;
+    uint64_t generation;
 };
 
 } // namespace rps
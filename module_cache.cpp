@@ -0,0 +1,394 @@
+#include <vector>
+#include <unordered_map>
+#include <iostream>
+#include <sstream>
+#include <cstring>
+#include <cstdio>
+#include <unistd.h>
+#include "token.h"
+#include "object.h"
+#include "module.h"
+#include "machine.h"
+#include "parser.h"
+#include "commands.h"
+#include "utilities.h"
+#include "module_cache.h"
+
+namespace rps
+{
+
+// Bump when the encoding or the parser output changes
+const uint32_t cache_version = 3;
+const char cache_magic[4] = {'R', 'P', 'S', 'C'};
+
+enum CacheTag
+{
+    TAG_STRING = 'S'
+    , TAG_INTEGER = 'I'
+    , TAG_NONE = 'N'
+    , TAG_LIST = 'L'
+    , TAG_COMMAND = 'C'
+    , TAG_WORD = 'W'       // a bare word that named no command
+    , TAG_PROGRAM = 'P'
+    , TAG_TOKEN = 'T'
+    , TAG_IF = 'i'
+    , TAG_FOR = 'f'
+    , TAG_WHILE = 'w'
+    , TAG_ITEM = 'o'        // top level object
+    , TAG_SHELL = 's'       // line for the shell parser
+};
+
+struct CacheHeader
+{
+    char magic[4];
+    uint32_t version;
+    uint64_t commands;      // size of the command table
+    int64_t size;           // of the source
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+void PutVarint(std::string& out, uint64_t n)
+{
+    while (n >= 0x80)
+    {
+        out.push_back((char)(n | 0x80));
+        n >>= 7;
+    }
+    out.push_back((char)n);
+}
+
+void PutString(std::string& out, const std::string& s)
+{
+    PutVarint(out, s.size());
+    out.append(s);
+}
+
+bool PutObject(std::string& out, const ObjectPtr& optr);
+
+bool PutVector(std::string& out, const std::vector<ObjectPtr>& vec)
+{
+    PutVarint(out, vec.size());
+    for (auto& item : vec)
+    {
+        if (!PutObject(out, item))
+            return false;
+    }
+    return true;
+}
+
+// Only what the parser creates can be stored, false for anything else
+bool PutObject(std::string& out, const ObjectPtr& optr)
+{
+    switch (optr->type)
+    {
+    case OBJECT_STRING:
+        out.push_back(((String *)optr.get())->word ? TAG_WORD : TAG_STRING);
+        PutString(out, ((String *)optr.get())->get());
+        return true;
+    case OBJECT_INTEGER:
+        {
+            int64_t v = ((Integer *)optr.get())->value;
+            out.push_back(TAG_INTEGER);
+            PutVarint(out, ((uint64_t)v << 1) ^ (uint64_t)(v >> 63));
+        }
+        return true;
+    case OBJECT_NONE:
+        out.push_back(TAG_NONE);
+        return true;
+    case OBJECT_LIST:
+        out.push_back(TAG_LIST);
+        return PutVector(out, ((List *)optr.get())->items);
+    case OBJECT_COMMAND:
+        out.push_back(TAG_COMMAND);
+        PutString(out, ((Command *)optr.get())->value);
+        return true;
+    case OBJECT_PROGRAM:
+        out.push_back(TAG_PROGRAM);
+        return PutVector(out, ((Program *)optr.get())->program);
+    case OBJECT_TOKEN:
+        {
+            Token *tp = (Token *)optr.get();
+            out.push_back(TAG_TOKEN);
+            PutVarint(out, tp->tok_type);
+            PutString(out, tp->value);
+        }
+        return true;
+    case OBJECT_IF:
+        {
+            If *p = (If *)optr.get();
+            out.push_back(TAG_IF);
+            return PutVector(out, p->cond) && PutVector(out, p->then) && PutVector(out, p->els);
+        }
+    case OBJECT_FOR:
+        out.push_back(TAG_FOR);
+        return PutVector(out, ((For *)optr.get())->program);
+    case OBJECT_WHILE:
+        {
+            While *p = (While *)optr.get();
+            out.push_back(TAG_WHILE);
+            return PutVector(out, p->cond) && PutVector(out, p->program);
+        }
+    default:
+        return false;
+    }
+}
+
+bool RecordItem(std::string& out, const ObjectPtr& optr)
+{
+    out.push_back(TAG_ITEM);
+    return PutObject(out, optr);
+}
+
+void RecordShellLine(std::string& out, const std::string& line)
+{
+    out.push_back(TAG_SHELL);
+    PutString(out, line);
+}
+
+class CacheReader
+{
+public:
+    CacheReader(Machine& m, const std::string& items)
+    : machine(m)
+    , p(items.data())
+    , end(items.data() + items.size())
+    {}
+
+    bool done() const { return p == end; }
+
+    char GetTag()
+    {
+        if (p == end)
+            Corrupt();
+        return *p++;
+    }
+
+    uint64_t GetVarint()
+    {
+        uint64_t n = 0;
+        for (int shift = 0; shift < 64; shift += 7)
+        {
+            unsigned char c = GetTag();
+            n |= (uint64_t)(c & 0x7f) << shift;
+            if ((c & 0x80) == 0)
+                return n;
+        }
+        Corrupt();
+        return 0;
+    }
+
+    void GetString(std::string& s)
+    {
+        uint64_t len = GetVarint();
+        if (len > (uint64_t)(end - p))
+            Corrupt();
+        s.assign(p, len);
+        p += len;
+    }
+
+    void GetVector(std::vector<ObjectPtr>& vec, Program *enclosing)
+    {
+        uint64_t n = GetVarint();
+        if (n > (uint64_t)(end - p))
+            Corrupt();
+        vec.reserve(n);
+        for (uint64_t i = 0; i < n; ++i)
+            vec.push_back(GetObject(enclosing));
+    }
+
+    // Rebuilt the way the parser builds them, so commands are looked up
+    // and programs take the current module when the item is reached
+    ObjectPtr GetObject(Program *enclosing)
+    {
+        ObjectPtr optr;
+        switch (GetTag())
+        {
+        case TAG_STRING:
+            GetString(scratch);
+            optr.reset(new String(scratch));
+            break;
+        case TAG_INTEGER:
+            {
+                uint64_t n = GetVarint();
+                optr = MakeInteger((int64_t)(n >> 1) ^ -(int64_t)(n & 1));
+            }
+            break;
+        case TAG_NONE:
+            optr = MakeNone();
+            break;
+        case TAG_LIST:
+            {
+                ListPtr lp;
+                lp.reset(new List());
+                GetVector(lp->items, enclosing);
+                optr = lp;
+            }
+            break;
+        case TAG_COMMAND:
+        case TAG_WORD:
+            {
+                // commands registered since the cache was written are
+                // found too
+                GetString(scratch);
+                auto it = machine.commands.find(scratch);
+                if (it != machine.commands.end())
+                    optr = it->second;
+                else
+                {
+                    StringPtr sp(new String(scratch));
+                    sp->word = true;
+                    optr = sp;
+                }
+            }
+            break;
+        case TAG_PROGRAM:
+            {
+                ProgramPtr pp;
+                pp.reset(new Program());
+                pp->module_name = machine.current_module_;
+                if (enclosing)
+                    pp->enclosingProgram.reset(enclosing);
+                GetVector(pp->program, pp.get());
+                optr = pp;
+            }
+            break;
+        case TAG_TOKEN:
+            {
+                TokenType type = (TokenType)GetVarint();
+                GetString(scratch);
+                if (type > TOKEN_SHELL)
+                    Corrupt();
+                optr = SharedToken(type, scratch.data(), scratch.data() + scratch.size());
+            }
+            break;
+        case TAG_IF:
+            {
+                IfPtr ifp;
+                ifp.reset(new If());
+                GetVector(ifp->cond, enclosing);
+                GetVector(ifp->then, enclosing);
+                GetVector(ifp->els, enclosing);
+                optr = ifp;
+            }
+            break;
+        case TAG_FOR:
+            {
+                ForPtr forp;
+                forp.reset(new For());
+                GetVector(forp->program, enclosing);
+                optr = forp;
+            }
+            break;
+        case TAG_WHILE:
+            {
+                WhilePtr whilep;
+                whilep.reset(new While());
+                GetVector(whilep->cond, enclosing);
+                GetVector(whilep->program, enclosing);
+                optr = whilep;
+            }
+            break;
+        default:
+            Corrupt();
+        }
+        return optr;
+    }
+
+    void Corrupt()
+    {
+        throw std::runtime_error("import: corrupt module cache");
+    }
+
+    Machine& machine;
+    const char *p;
+    const char *end;
+    std::string scratch;
+};
+
+std::string CachePath(const std::string& source)
+{
+    const char *dir = getenv("RPS_CACHE");
+    if (dir == nullptr || *dir == '\0')
+        return source + "c";
+    // flatten the source path into a file name
+    std::string name(source);
+    for (char& c : name)
+    {
+        if (c == '/')
+            c = '%';
+    }
+    return std::string(dir) + "/" + name + "c";
+}
+
+void FillHeader(CacheHeader& header, const struct stat& st)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, cache_magic, sizeof(header.magic));
+    header.version = cache_version;
+    header.commands = command_table_size;
+    header.size = st.st_size;
+    header.mtime_sec = st.st_mtim.tv_sec;
+    header.mtime_nsec = st.st_mtim.tv_nsec;
+}
+
+bool ReadModuleCache(const std::string& source, const struct stat& st, std::string& items)
+{
+    std::string data;
+    if (!ReadFile(CachePath(source), data) || data.size() < sizeof(CacheHeader))
+        return false;
+    CacheHeader expected;
+    FillHeader(expected, st);
+    if (memcmp(data.data(), &expected, sizeof(expected)) != 0)
+        return false;
+    items.assign(data, sizeof(CacheHeader), std::string::npos);
+    return true;
+}
+
+// Written to a temporary file and renamed, so concurrent imports never
+// see a partial cache. Failing to write the cache is not an error.
+void WriteModuleCache(const std::string& source, const struct stat& st, const std::string& items)
+{
+    std::string path = CachePath(source);
+    std::stringstream tmp;
+    tmp << path << "." << getpid();
+    FILE *fp = fopen(tmp.str().c_str(), "w");
+    if (fp == nullptr)
+        return;
+    CacheHeader header;
+    FillHeader(header, st);
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+        && fwrite(items.data(), 1, items.size(), fp) == items.size();
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmp.str().c_str(), path.c_str()) != 0)
+        unlink(tmp.str().c_str());
+}
+
+void RunModuleCache(Machine& machine, RPNParser& rparser, ShellParser& sparser, const std::string& items)
+{
+    CacheReader reader(machine, items);
+    std::string line;
+    while (!reader.done())
+    {
+        char tag = reader.GetTag();
+        if (tag == TAG_SHELL)
+        {
+            reader.GetString(line);
+            try
+            {
+                sparser.Parse(machine, line);
+            }
+            catch (std::runtime_error& e)
+            {
+                std::cout << e.what() << std::endl;
+            }
+            continue;
+        }
+        if (tag != TAG_ITEM)
+            reader.Corrupt();
+        ObjectPtr optr = reader.GetObject(nullptr);
+        rparser.Dispatch(machine, optr, false);
+    }
+}
+
+} // namespace rps
@@ -0,0 +1,27 @@
+#pragma once
+#include <string>
+#include <sys/stat.h>
+
+namespace rps
+{
+
+class Machine;
+class RPNParser;
+class ShellParser;
+
+/*
+ * IMPORT keeps the parsed top level of a module in a cache file, the
+ * source with a 'c' appended (std.rps -> std.rpsc), or a file in
+ * $RPS_CACHE if that is set. The cache is a list of items: objects as
+ * the RPN parser returned them and lines for the shell parser. It is
+ * used while the size and mtime of the source and the cache version
+ * match.
+ */
+bool RecordItem(std::string& out, const ObjectPtr& optr);
+void RecordShellLine(std::string& out, const std::string& line);
+
+bool ReadModuleCache(const std::string& source, const struct stat& st, std::string& items);
+void WriteModuleCache(const std::string& source, const struct stat& st, const std::string& items);
+void RunModuleCache(Machine&, RPNParser&, ShellParser&, const std::string& items);
+
+} // namespace rps
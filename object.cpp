@@ -1,12 +1,529 @@
 #include <iostream>
+#include <new>
+#include <mutex>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <vector>
+#include <unordered_map>
+#include <sys/mman.h>
 #include "object.h"
 
 namespace rps
 {
 
+bool atomic_refs = false;
+
+namespace
+{
+
+const size_t SIZE_CLASS_BYTES = 16;
+const size_t SIZE_CLASSES = 16;             // pooled objects are at most 256 bytes
+const size_t CHUNK_BYTES = 64 * 1024;       // chunks are aligned to their size
+
+struct FreeBlock
+{
+    FreeBlock *next;
+};
+
+// Each thread has its own lists, a block freed by another thread than
+// the one that allocated it simply moves to the freeing thread's list.
+// The tails and counts let TrimHeaps move a whole list in one step.
+struct Heap
+{
+    FreeBlock *lists[SIZE_CLASSES];
+    FreeBlock *tails[SIZE_CLASSES];
+    size_t counts[SIZE_CLASSES];
+    HeapStats stats;
+};
+
+thread_local Heap heap;
+thread_local bool registered = false;
+
+// The heaps of the running threads, the free blocks and the counters
+// of threads that ended, and the free bytes left by the last trim
+std::mutex heaps_mutex;
+std::vector<Heap *>& heaps = *new std::vector<Heap *>;
+Heap& retired = *new Heap();
+size_t trimmed_bytes = 0;
+
+// Move the free lists of from to the end of the lists of to
+void Splice(Heap& to, Heap& from)
+{
+    for (size_t cls = 0; cls < SIZE_CLASSES; ++cls)
+    {
+        if (!from.lists[cls])
+            continue;
+        if (to.lists[cls])
+            to.tails[cls]->next = from.lists[cls];
+        else
+            to.lists[cls] = from.lists[cls];
+        to.tails[cls] = from.tails[cls];
+        to.counts[cls] += from.counts[cls];
+        from.lists[cls] = nullptr;
+        from.tails[cls] = nullptr;
+        from.counts[cls] = 0;
+    }
+}
+
+void Add(HeapStats& to, const HeapStats& from)
+{
+    to.allocated += from.allocated;
+    to.freed += from.freed;
+    to.reused += from.reused;
+    to.chunks += from.chunks;
+    to.released += from.released;
+    to.large += from.large;
+}
+
+// Takes the heap of a thread out of the registry when the thread ends
+struct Registration
+{
+    ~Registration()
+    {
+        std::lock_guard<std::mutex> lock(heaps_mutex);
+        heaps.erase(std::find(heaps.begin(), heaps.end(), &heap));
+        Splice(retired, heap);
+        Add(retired.stats, heap.stats);
+        heap.stats = HeapStats();
+    }
+};
+
+void Register()
+{
+    static thread_local Registration registration;
+    std::lock_guard<std::mutex> lock(heaps_mutex);
+    heaps.push_back(&heap);
+    registered = true;
+}
+
+// Carve a new chunk into blocks of the size class
+void Refill(size_t cls)
+{
+    size_t block = (cls + 1) * SIZE_CLASS_BYTES;
+    void *p;
+    if (posix_memalign(&p, CHUNK_BYTES, CHUNK_BYTES) != 0)
+        throw std::bad_alloc();
+    char *chunk = (char *)p;
+    ++heap.stats.chunks;
+    heap.tails[cls] = (FreeBlock *)chunk;
+    for (size_t off = 0; off + block <= CHUNK_BYTES; off += block)
+    {
+        FreeBlock *fb = (FreeBlock *)(chunk + off);
+        fb->next = heap.lists[cls];
+        heap.lists[cls] = fb;
+        ++heap.counts[cls];
+    }
+}
+
+// Give the chunks of a size class whose blocks are all free back to
+// the system, returns the free bytes left in the class
+size_t Trim(Heap& h, size_t cls)
+{
+    size_t block = (cls + 1) * SIZE_CLASS_BYTES;
+    std::unordered_map<uintptr_t, size_t> free_blocks;
+    for (FreeBlock *fb = h.lists[cls]; fb; fb = fb->next)
+        ++free_blocks[(uintptr_t)fb & ~(CHUNK_BYTES - 1)];
+
+    size_t per_chunk = CHUNK_BYTES / block;
+    auto unused = [&](FreeBlock *fb) {
+        return free_blocks[(uintptr_t)fb & ~(CHUNK_BYTES - 1)] == per_chunk;
+    };
+    FreeBlock **link = &h.lists[cls];
+    h.tails[cls] = nullptr;
+    while (*link)
+    {
+        if (unused(*link))
+        {
+            *link = (*link)->next;
+            --h.counts[cls];
+        }
+        else
+        {
+            h.tails[cls] = *link;
+            link = &(*link)->next;
+        }
+    }
+    for (auto& chunk : free_blocks)
+    {
+        if (chunk.second == per_chunk)
+        {
+            free((void *)chunk.first);
+            ++h.stats.released;
+        }
+    }
+    return h.counts[cls] * block;
+}
+
+} // namespace
+
+void *Object::operator new(size_t size)
+{
+    if (!registered)
+        Register();
+    ++heap.stats.allocated;
+    size_t cls = (size - 1) / SIZE_CLASS_BYTES;
+    if (cls >= SIZE_CLASSES)
+    {
+        ++heap.stats.large;
+        return ::operator new(size);
+    }
+    if (heap.lists[cls])
+        ++heap.stats.reused;
+    else
+        Refill(cls);
+    FreeBlock *fb = heap.lists[cls];
+    heap.lists[cls] = fb->next;
+    --heap.counts[cls];
+    return fb;
+}
+
+void Object::operator delete(void *p, size_t size)
+{
+    if (!registered)
+        Register();
+    ++heap.stats.freed;
+    size_t cls = (size - 1) / SIZE_CLASS_BYTES;
+    if (cls >= SIZE_CLASSES)
+    {
+        ::operator delete(p);
+        return;
+    }
+    FreeBlock *fb = (FreeBlock *)p;
+    if (!heap.lists[cls])
+        heap.tails[cls] = fb;
+    fb->next = heap.lists[cls];
+    heap.lists[cls] = fb;
+    ++heap.counts[cls];
+}
+
+HeapStats TotalHeapStats()
+{
+    std::lock_guard<std::mutex> lock(heaps_mutex);
+    HeapStats total = retired.stats;
+    for (Heap *h : heaps)
+        Add(total, h->stats);
+    return total;
+}
+
+void TrimHeaps()
+{
+    if (!registered)
+        Register();
+    std::lock_guard<std::mutex> lock(heaps_mutex);
+    for (Heap *h : heaps)
+    {
+        if (h != &heap)
+            Splice(heap, *h);
+    }
+    Splice(heap, retired);
+
+    // Walking the lists costs time in proportion to the free blocks,
+    // so only trim once they have grown well past the last trim
+    size_t free_bytes = 0;
+    for (size_t cls = 0; cls < SIZE_CLASSES; ++cls)
+        free_bytes += heap.counts[cls] * (cls + 1) * SIZE_CLASS_BYTES;
+    if (free_bytes < 2 * trimmed_bytes + 16 * CHUNK_BYTES)
+        return;
+
+    try
+    {
+        trimmed_bytes = 0;
+        for (size_t cls = 0; cls < SIZE_CLASSES; ++cls)
+            trimmed_bytes += Trim(heap, cls);
+    }
+    catch (const std::bad_alloc&)
+    {
+        // Keep the chunks, the next trim tries again
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (mapped_)
+        munmap((void *)data, size);
+    else
+        delete[] data;
+}
+
+namespace
+{
+// Worker threads can share a slice, the first get() copies it
+std::mutex slice_mutex;
+}
+
+String::String(const String& s)
+: Object(OBJECT_STRING)
+, word(false)
+, begin_(nullptr)
+, end_(nullptr)
+, hash_(s.hash_.load(std::memory_order_relaxed))
+{
+    if (s.begin_.load(std::memory_order_acquire))
+    {
+        // a copy of a slice is another slice of the same file
+        std::lock_guard<std::mutex> lock(slice_mutex);
+        const char *begin = s.begin_.load(std::memory_order_relaxed);
+        if (begin)
+        {
+            begin_.store(begin, std::memory_order_relaxed);
+            end_ = s.end_;
+            file_ = s.file_;
+            return;
+        }
+    }
+    value = s.value;
+}
+
+void String::Own() const
+{
+    std::lock_guard<std::mutex> lock(slice_mutex);
+    const char *begin = begin_.load(std::memory_order_relaxed);
+    if (begin == nullptr)
+        return;
+    value.assign(begin, end_);
+    file_.reset();
+    begin_.store(nullptr, std::memory_order_release);
+}
+
+bool String::Slice(const char *& begin, const char *& end, MappedFilePtr& file) const
+{
+    if (begin_.load(std::memory_order_acquire) == nullptr)
+        return false;
+    std::lock_guard<std::mutex> lock(slice_mutex);
+    begin = begin_.load(std::memory_order_relaxed);
+    if (begin == nullptr)
+        return false;
+    end = end_;
+    file = file_;
+    return true;
+}
+
 void String::set(const std::string& s)
 {
+    if (begin_.load(std::memory_order_acquire))
+    {
+        std::lock_guard<std::mutex> lock(slice_mutex);
+        file_.reset();
+        begin_.store(nullptr, std::memory_order_release);
+    }
     value = s;
+    hash_.store(0, std::memory_order_relaxed);
+}
+
+// Returns local_names.size() if the name has no slot
+size_t Program::FindLocal(const std::string& name) const
+{
+    size_t slot = 0;
+    while (slot < local_names.size() && local_names[slot] != name)
+        ++slot;
+    return slot;
+}
+
+size_t Program::AddLocal(const std::string& name)
+{
+    size_t slot = FindLocal(name);
+    if (slot == local_names.size())
+        local_names.push_back(name);
+    return slot;
+}
+
+namespace
+{
+
+const size_t MAP_MIN_ENTRIES = 8;   // room made by the first insert into a Map
+
+// Spread the bits of an integer or a pointer over the whole hash, the
+// table is indexed by its low bits
+size_t Mix(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Eight bytes at a time, the tail is padded with zeros
+size_t HashBytes(const char *p, size_t n)
+{
+    uint64_t h = Mix(n + 0x9e3779b97f4a7c15ULL);
+    for (; n >= 8; p += 8, n -= 8)
+    {
+        uint64_t word;
+        memcpy(&word, p, 8);
+        h = Mix(h ^ word);
+    }
+    if (n)
+    {
+        uint64_t word = 0;
+        memcpy(&word, p, n);
+        h = Mix(h ^ word);
+    }
+    return h;
+}
+
+} // namespace
+
+// A slice is hashed where it is, it is not copied
+size_t String::Hash() const
+{
+    const char *begin, *end;
+    MappedFilePtr file;
+    size_t h;
+    if (Slice(begin, end, file))
+        h = HashBytes(begin, end - begin);
+    else
+        h = HashBytes(value.data(), value.size());
+    if (h == 0)
+        h = 1;
+    hash_.store(h, std::memory_order_relaxed);
+    return h;
+}
+
+size_t KeyHash(const Object *key)
+{
+    switch (key->type)
+    {
+    case OBJECT_STRING:
+        return ((const String *)key)->hash();
+    case OBJECT_INTEGER:
+        return Mix(((const Integer *)key)->value);
+    default:
+        return Mix((uintptr_t)key);
+    }
+}
+
+bool KeyEqual(const Object *a, const Object *b)
+{
+    if (a == b)
+        return true;
+    if (a->type != b->type)
+        return false;
+    if (a->type == OBJECT_STRING)
+        return ((const String *)a)->get() == ((const String *)b)->get();
+    if (a->type == OBJECT_INTEGER)
+        return ((const Integer *)a)->value == ((const Integer *)b)->value;
+    return false;
+}
+
+size_t MapItems::Lookup(const Object *key, size_t hash) const
+{
+    size_t mask = slots_.size() - 1;
+    uint32_t bits = (uint32_t)hash;
+    for (size_t i = hash & mask; ; i = (i + 1) & mask)
+    {
+        const Slot& slot = slots_[i];
+        if (slot.entry == EMPTY)
+            return i;
+        if (slot.hash == bits && KeyEqual(entries_[slot.entry].first.get(), key))
+            return i;
+    }
+}
+
+void MapItems::Rehash(size_t slots)
+{
+    slots_.assign(slots, Slot{EMPTY, 0});
+    for (size_t e = 0; e < entries_.size(); ++e)
+    {
+        const Object *key = entries_[e].first.get();
+        size_t hash = KeyHash(key);
+        size_t i = Lookup(key, hash);
+        slots_[i].entry = (uint32_t)e;
+        slots_[i].hash = (uint32_t)hash;
+    }
+}
+
+MapItems::iterator MapItems::find(const ObjectPtr& key)
+{
+    if (entries_.empty())
+        return end();
+    uint32_t e = slots_[Lookup(key.get(), KeyHash(key.get()))].entry;
+    return e == EMPTY ? end() : begin() + e;
+}
+
+MapItems::const_iterator MapItems::find(const ObjectPtr& key) const
+{
+    if (entries_.empty())
+        return end();
+    uint32_t e = slots_[Lookup(key.get(), KeyHash(key.get()))].entry;
+    return e == EMPTY ? end() : begin() + e;
+}
+
+std::pair<MapItems::iterator, bool> MapItems::emplace(const ObjectPtr& key, const ObjectPtr& value)
+{
+    if (slots_.empty())
+        reserve(MAP_MIN_ENTRIES);
+    else if ((entries_.size() + 1) * 2 > slots_.size())
+        Rehash(slots_.size() * 2);
+    size_t hash = KeyHash(key.get());
+    size_t i = Lookup(key.get(), hash);
+    if (slots_[i].entry != EMPTY)
+        return std::make_pair(begin() + slots_[i].entry, false);
+    slots_[i].entry = (uint32_t)entries_.size();
+    slots_[i].hash = (uint32_t)hash;
+    entries_.emplace_back(key, value);
+    return std::make_pair(end() - 1, true);
+}
+
+ObjectPtr& MapItems::operator[](const ObjectPtr& key)
+{
+    return emplace(key, ObjectPtr()).first->second;
+}
+
+size_t MapItems::erase(const ObjectPtr& key)
+{
+    if (entries_.empty())
+        return 0;
+    size_t mask = slots_.size() - 1;
+    size_t hole = Lookup(key.get(), KeyHash(key.get()));
+    uint32_t e = slots_[hole].entry;
+    if (e == EMPTY)
+        return 0;
+
+    // shift back the slots after the hole that would not be found
+    // past it once it is free
+    for (size_t i = (hole + 1) & mask; slots_[i].entry != EMPTY; i = (i + 1) & mask)
+    {
+        size_t home = slots_[i].hash & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask))
+        {
+            slots_[hole] = slots_[i];
+            hole = i;
+        }
+    }
+    slots_[hole].entry = EMPTY;
+
+    // move the last entry into the place of the erased one
+    uint32_t last = (uint32_t)entries_.size() - 1;
+    if (e != last)
+    {
+        const Object *moved = entries_[last].first.get();
+        size_t i = KeyHash(moved) & mask;
+        while (slots_[i].entry != last)
+            i = (i + 1) & mask;
+        slots_[i].entry = e;
+        entries_[e] = std::move(entries_[last]);
+    }
+    entries_.pop_back();
+    return 1;
+}
+
+void MapItems::clear()
+{
+    entries_.clear();
+    slots_.clear();
+}
+
+void MapItems::reserve(size_t n)
+{
+    entries_.reserve(n);
+    size_t slots = MAP_MIN_ENTRIES * 2;
+    while (slots < n * 2)
+        slots *= 2;
+    if (slots > slots_.size())
+        Rehash(slots);
 }
 
 } // namespace rps
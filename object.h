@@ -1,7 +1,12 @@
 #pragma once
 #include <memory>
+#include <string>
 #include <vector>
 #include <unordered_map>
+#include <functional>
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
 #include "token.h"
 
 namespace rps
@@ -9,20 +14,185 @@ namespace rps
 
 class Machine;
 
+// Set while PAPPLY, PFILTER or PREDUCE run programs on worker threads
+extern bool atomic_refs;
+
+/*
+ * Objects are allocated from per size class free lists and carry their
+ * own reference count, so an object costs a single allocation and
+ * copying a Ref is a plain increment. The count is only updated with
+ * atomic instructions while worker threads are running.
+ */
 class Object
 {
 public:
     Object(ObjectType t)
     :type(t)
+    ,refs_(0)
+    {}
+    Object(const Object& o)
+    :type(o.type)
+    ,refs_(0)
     {}
+    Object& operator=(const Object& o)
+    {
+        type = o.type;
+        return *this;
+    }
+
+    virtual ~Object() {}
 
-    ~Object() {}
+    static void *operator new(size_t size);
+    static void operator delete(void *p, size_t size);
+
+    void AddRef()
+    {
+        if (atomic_refs)
+            refs_.fetch_add(1, std::memory_order_relaxed);
+        else
+            refs_.store(refs_.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+    // true when the last reference is gone
+    bool Release()
+    {
+        if (atomic_refs)
+            return refs_.fetch_sub(1, std::memory_order_acq_rel) == 1;
+        uint32_t n = refs_.load(std::memory_order_relaxed) - 1;
+        refs_.store(n, std::memory_order_relaxed);
+        return n == 0;
+    }
 
     ObjectType type;
+    std::atomic<uint32_t> refs_;
     virtual bool IsToken(TokenType t) {return false;}
 };
 
-typedef std::shared_ptr<Object> ObjectPtr;
+// Counters of the object heap, shown by HEAPSTATS
+struct HeapStats
+{
+    uint64_t allocated;     // objects created
+    uint64_t freed;         // objects destroyed
+    uint64_t reused;        // allocations served from a free list
+    uint64_t chunks;        // chunks requested from the system
+    uint64_t released;      // chunks given back to the system
+    uint64_t large;         // objects too big for a size class
+};
+
+// The counters of all threads added up
+HeapStats TotalHeapStats();
+
+// Gather the free blocks of all threads on the calling thread and give
+// chunks that are entirely free back to the system. The other threads
+// must not allocate or free objects meanwhile.
+void TrimHeaps();
+
+// Intrusive reference counted pointer to an Object
+template <class T>
+class Ref
+{
+public:
+    Ref() : p_(nullptr) {}
+    Ref(std::nullptr_t) : p_(nullptr) {}
+    explicit Ref(T *p) : p_(p) { acquire(); }
+    Ref(const Ref& r) : p_(r.p_) { acquire(); }
+    Ref(Ref&& r) : p_(r.p_) { r.p_ = nullptr; }
+    template <class U>
+    Ref(const Ref<U>& r) : p_(r.get()) { acquire(); }
+    template <class U>
+    Ref(Ref<U>&& r) : p_(r.release()) {}
+    ~Ref() { reset(); }
+
+    Ref& operator=(const Ref& r)
+    {
+        Ref(r).swap(*this);
+        return *this;
+    }
+    Ref& operator=(Ref&& r)
+    {
+        Ref(std::move(r)).swap(*this);
+        return *this;
+    }
+    template <class U>
+    Ref& operator=(const Ref<U>& r)
+    {
+        Ref(r).swap(*this);
+        return *this;
+    }
+
+    void reset()
+    {
+        if (p_ && p_->Release())
+            delete p_;
+        p_ = nullptr;
+    }
+    void reset(T *p)
+    {
+        Ref(p).swap(*this);
+    }
+    void swap(Ref& r)
+    {
+        T *p = p_;
+        p_ = r.p_;
+        r.p_ = p;
+    }
+    // Give up the reference without releasing it
+    T *release()
+    {
+        T *p = p_;
+        p_ = nullptr;
+        return p;
+    }
+
+    T *get() const { return p_; }
+    T& operator*() const { return *p_; }
+    T *operator->() const { return p_; }
+    explicit operator bool() const { return p_ != nullptr; }
+    size_t use_count() const { return p_ ? p_->refs_.load() : 0; }
+
+private:
+    void acquire()
+    {
+        if (p_)
+            p_->AddRef();
+    }
+
+    T *p_;
+};
+
+template <class T, class U>
+bool operator==(const Ref<T>& a, const Ref<U>& b) { return a.get() == b.get(); }
+template <class T, class U>
+bool operator!=(const Ref<T>& a, const Ref<U>& b) { return a.get() != b.get(); }
+template <class T, class U>
+bool operator<(const Ref<T>& a, const Ref<U>& b)
+{
+    return std::less<typename std::common_type<T *, U *>::type>()(a.get(), b.get());
+}
+
+template <class T, class U>
+Ref<T> static_pointer_cast(const Ref<U>& r)
+{
+    return Ref<T>(static_cast<T *>(r.get()));
+}
+
+typedef Ref<Object> ObjectPtr;
+
+} // namespace rps
+
+namespace std
+{
+    template <class T>
+    struct hash<rps::Ref<T>>
+    {
+        size_t operator()(const rps::Ref<T>& r) const
+        {
+            return hash<T *>()(r.get());
+        }
+    };
+}
+
+namespace rps
+{
 
 class Token : public Object
 {
@@ -39,31 +209,100 @@ public:
     TokenType tok_type;
 };
 
-typedef std::shared_ptr<Token> TokenPtr;
+typedef Ref<Token> TokenPtr;
+
+// Text of a file that Strings can be slices of, either a read only
+// mapping of the file or a chunk of it read into memory allocated with
+// new[]. It is released with the last String referring to it.
+class MappedFile
+{
+public:
+    MappedFile(const char *data, size_t size, bool mapped = true)
+    : data(data), size(size), mapped_(mapped) {}
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char * const data;
+    const size_t size;
+
+private:
+    const bool mapped_;
+};
+
+typedef std::shared_ptr<MappedFile> MappedFilePtr;
 
 class String : public Object
 {
 public:
     String(const std::string&s) 
     : Object(OBJECT_STRING)
+    , word(false)
     , value(s)
+    , begin_(nullptr)
+    , end_(nullptr)
+    , hash_(0)
+    {}
+    String(const char *begin, const char *end)
+    : Object(OBJECT_STRING)
+    , word(false)
+    , value(begin, end)
+    , begin_(nullptr)
+    , end_(nullptr)
+    , hash_(0)
+    {}
+    // A slice of a mapped file, copied into value on first use
+    String(const char *begin, const char *end, const MappedFilePtr& file)
+    : Object(OBJECT_STRING)
+    , word(false)
+    , begin_(begin)
+    , end_(end)
+    , file_(file)
+    , hash_(0)
     {}
+    String(const String& s);
     void set(const std::string&);
-    const std::string& get() const { return value;}
+    const std::string& get() const
+    {
+        if (begin_.load(std::memory_order_acquire))
+            Own();
+        return value;
+    }
+    // If the string is still a slice of a mapped file, set begin, end
+    // and file to it and return true
+    bool Slice(const char *& begin, const char *& end, MappedFilePtr& file) const;
+    // The hash of the string, worked out the first time it is needed
+    size_t hash() const
+    {
+        size_t h = hash_.load(std::memory_order_relaxed);
+        return h ? h : Hash();
+    }
 
-    std::string value;
+    // A bare word that named no command when the module was parsed, the
+    // module cache looks it up again when the module is imported
+    bool word;
+
+private:
+    void Own() const;
+    size_t Hash() const;
+
+    mutable std::string value;
+    mutable std::atomic<const char *> begin_;   // nullptr once value holds the string
+    const char *end_;
+    mutable MappedFilePtr file_;
+    mutable std::atomic<size_t> hash_;          // 0 until hash() is called
 };
 
-typedef std::shared_ptr<String> StringPtr;
+typedef Ref<String> StringPtr;
 
 class Integer : public Object
 {
 public:
     Integer(int64_t n) : Object(OBJECT_INTEGER), value(n) {}
-    int64_t value;
+    const int64_t value;        // small integers are shared, see MakeInteger
 };
 
-typedef std::shared_ptr<Integer> IntegerPtr;
+typedef Ref<Integer> IntegerPtr;
 
 class None : public Object
 {
@@ -71,7 +310,7 @@ public:
     None() : Object(OBJECT_NONE) {}
 };
 
-typedef std::shared_ptr<None> NonePtr;
+typedef Ref<None> NonePtr;
 
 class List : public Object
 {
@@ -80,35 +319,93 @@ public:
     std::vector<ObjectPtr> items;
 };
 
-typedef std::shared_ptr<List> ListPtr;
+typedef Ref<List> ListPtr;
+
+// Map keys: Strings and Integers are equal if their values are, other
+// objects only to themselves
+size_t KeyHash(const Object *key);
+bool KeyEqual(const Object *a, const Object *b);
+
+/*
+ * The items of a Map, a flat hash table. The entries are kept together
+ * in a vector in the order they were added, erasing one moves the last
+ * into its place. They are found through an index of positions in the
+ * vector, probed linearly, that holds part of each hash so most keys
+ * that do not match are passed over without being looked at.
+ */
+class MapItems
+{
+public:
+    typedef std::pair<ObjectPtr, ObjectPtr> value_type;
+    typedef std::vector<value_type>::iterator iterator;
+    typedef std::vector<value_type>::const_iterator const_iterator;
+
+    iterator begin() { return entries_.begin(); }
+    iterator end() { return entries_.end(); }
+    const_iterator begin() const { return entries_.begin(); }
+    const_iterator end() const { return entries_.end(); }
+    size_t size() const { return entries_.size(); }
+    bool empty() const { return entries_.empty(); }
+
+    iterator find(const ObjectPtr& key);
+    const_iterator find(const ObjectPtr& key) const;
+    // Add key if it is not there, the bool is false if it was
+    std::pair<iterator, bool> emplace(const ObjectPtr& key, const ObjectPtr& value);
+    ObjectPtr& operator[](const ObjectPtr& key);
+    size_t erase(const ObjectPtr& key);
+    void clear();
+    void reserve(size_t n);
+
+private:
+    static const uint32_t EMPTY = UINT32_MAX;
+
+    struct Slot
+    {
+        uint32_t entry;     // index into entries_, EMPTY if the slot is free
+        uint32_t hash;      // low bits of the hash of the key
+    };
+
+    // The slot holding key, or the free slot where it would go
+    size_t Lookup(const Object *key, size_t hash) const;
+    void Rehash(size_t slots);
+
+    std::vector<value_type> entries_;
+    std::vector<Slot> slots_;   // a power of 2 in size, at most half used
+};
 
 class Map : public Object
 {
 public:
     Map() : Object(OBJECT_MAP) {}
-    std::unordered_map<ObjectPtr, ObjectPtr> items;
+    MapItems items;
 };
 
-typedef std::shared_ptr<Map> MapPtr;
+typedef Ref<Map> MapPtr;
 
 class Program;
-typedef std::shared_ptr<Program> ProgramPtr;
+typedef Ref<Program> ProgramPtr;
+class Code;
+typedef std::shared_ptr<Code> CodePtr;
+
+struct CommandInfo;
 
 class Command : public Object
 {
 public:
-    Command(const std::string& cmd, void (*f)(Machine&)) 
+    Command(const std::string& cmd, const CommandInfo *i, void (*f)(Machine&)) 
     : Object(OBJECT_COMMAND)
     , value(cmd)
+    , info(i)
     , funcptr(f)
     {}
     std::string value;
+    const CommandInfo *info;        // nullptr for registered programs
     void (*funcptr)(Machine&);
 
     ProgramPtr program;
 };
 
-typedef std::shared_ptr<Command> CommandPtr;
+typedef Ref<Command> CommandPtr;
 
 class Program : public Object
 {
@@ -116,8 +413,12 @@ public:
     Program() : Object(OBJECT_PROGRAM) {}
     std::vector<ObjectPtr> program;
     std::string module_name;
-    std::unordered_map<std::string, ObjectPtr> *pLocals;
+    std::vector<std::string> local_names;   // frame slot of each local variable
     ProgramPtr enclosingProgram;
+    CodePtr code;       // compiled on first EVAL
+
+    size_t FindLocal(const std::string& name) const;
+    size_t AddLocal(const std::string& name);
 };
 
 
@@ -130,7 +431,7 @@ public:
     std::vector<ObjectPtr> els;
 };
 
-typedef std::shared_ptr<If> IfPtr;
+typedef Ref<If> IfPtr;
 
 class For : public Object
 {
@@ -139,7 +440,7 @@ public:
     std::vector<ObjectPtr> program;
 };
 
-typedef std::shared_ptr<For> ForPtr;
+typedef Ref<For> ForPtr;
 
 class While : public Object
 {
@@ -149,7 +450,22 @@ public:
     std::vector<ObjectPtr> cond;
 };
 
-typedef std::shared_ptr<While> WhilePtr;
+typedef Ref<While> WhilePtr;
+
+/*
+ * A sequence of items that is produced on demand and can be read once,
+ * such as the lines of FREAD --lazy. FOR, APPLY, FILTER, MAP and REDUCE
+ * pull the items one at a time, COLLECT reads the rest into a List.
+ */
+class Stream : public Object
+{
+public:
+    Stream() : Object(OBJECT_STREAM) {}
+    virtual bool Next(Machine&, ObjectPtr& out) = 0;   // false at the end
+    virtual std::string Describe() const = 0;
+};
+
+typedef Ref<Stream> StreamPtr;
 
 } // namespace rps
 
@@ -3,24 +3,45 @@
 namespace rps
 {
 
+/*
+ * Input to the parsers. Files are read whole and scanned in place,
+ * the terminal and pipes are read a line at a time. In both cases
+ * [it, end) is the unread text and always ends with '\n'.
+ */
 struct Source
 {
     Source(std::istream& is);
+    Source(std::string&& data);
     void Read();
     bool iseof();
-    std::string line;
-    std::string::iterator it;
-    std::istream& istrm;
+    void SkipLine();
+    void GetLine(std::string& out);
+    std::string buffer;
+    const char *it;
+    const char *end;
+    std::istream *istrm;        // nullptr when scanning buffer
     std::string prompt;
     bool interactive;
     size_t lineno;
 };
 
+// A token as a span of the Source, or of the parser's scratch string
+// when a quoted string had escapes or ran over more than one line
+struct Lexeme
+{
+    TokenType type;
+    const char *begin;
+    const char *end;
+};
+
 class RPNParser
 {
 public:
     RPNParser(Machine&);
+    bool Lex(Source&, Lexeme&);
     bool GetObject(Machine&, Source&, ObjectPtr& optr);
+    bool GetItem(Machine&, Source&, ObjectPtr& optr);
+    void Dispatch(Machine&, ObjectPtr& optr, bool interactive);
     void Parse(Machine& machine, Source&, std::string& exit);
     void ParseProgram(Machine&, ProgramPtr& pptr, Source& src);
     void ParseList(Machine&, ListPtr& pptr, Source& src);
@@ -28,6 +49,8 @@ public:
     void ParseFor(Machine&, ForPtr& forptr, Source& src);
     void ParseWhile(Machine&, WhilePtr& whileptr, Source& src);
     ProgramPtr enclosingProgram;
+    std::string scratch;
+    std::string *record;        // items are appended here when IMPORT builds a module cache
 };
 
 class ShellParser
@@ -37,7 +60,10 @@ public:
     // false at EOL and no data has been read
     void Parse(Machine&, Source&, std::string& exit);
     void Parse(Machine&, const std::string&);
+    std::string *record;
 };
 
+ObjectPtr SharedToken(TokenType type, const char *begin, const char *end);
+
 } // namespace rps
 
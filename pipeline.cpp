@@ -0,0 +1,122 @@
+#include <vector>
+#include <string>
+#include <sstream>
+#include "token.h"
+#include "object.h"
+#include "module.h"
+#include "machine.h"
+#include "commands.h"
+#include "utilities.h"
+#include "pipeline.h"
+
+namespace rps
+{
+
+Pipeline::Pipeline(ObjectPtr src)
+: src_(src)
+, items_(src)
+, done_(false)
+{}
+
+bool Pipeline::Next(Machine& machine, ObjectPtr& out)
+{
+    ObjectPtr item;
+    ObjectPtr result;
+    while (!done_ && !bInterrupt)
+    {
+        // once a HEAD or SUBLIST is used up nothing more gets through
+        for (PipelineStep& step : steps)
+        {
+            if (step.kind == PipelineStep::STEP_TAKE && step.count <= 0)
+                done_ = true;
+        }
+        if (done_ || !items_.Next(machine, item))
+            break;
+        bool keep = true;
+        for (PipelineStep& step : steps)
+        {
+            switch (step.kind)
+            {
+            case PipelineStep::STEP_APPLY:
+                machine.push(item);
+                if (step.arg)
+                    machine.push(step.arg);
+                EVAL(machine, step.program);
+                machine.pop(item);
+                break;
+            case PipelineStep::STEP_FILTER:
+                machine.push(item);
+                if (step.arg)
+                    machine.push(step.arg);
+                EVAL(machine, step.program);
+                machine.pop(result);
+                keep = ToBool(machine, result) == false;
+                break;
+            case PipelineStep::STEP_SKIP:
+                if (step.count > 0)
+                {
+                    --step.count;
+                    keep = false;
+                }
+                break;
+            case PipelineStep::STEP_TAKE:
+                --step.count;
+                break;
+            }
+            if (!keep)
+                break;
+        }
+        if (keep)
+        {
+            out = item;
+            return true;
+        }
+    }
+    done_ = true;
+    return false;
+}
+
+std::string Pipeline::Describe() const
+{
+    std::stringstream strm;
+    if (src_ && src_->type == OBJECT_STREAM)
+        strm << ((Stream *)src_.get())->Describe();
+    else
+        strm << "List";
+    for (const PipelineStep& step : steps)
+    {
+        switch (step.kind)
+        {
+        case PipelineStep::STEP_APPLY:
+            strm << " | APPLY";
+            break;
+        case PipelineStep::STEP_FILTER:
+            strm << " | FILTER";
+            break;
+        case PipelineStep::STEP_SKIP:
+            strm << " | SKIP " << step.count;
+            break;
+        case PipelineStep::STEP_TAKE:
+            strm << " | HEAD " << step.count;
+            break;
+        }
+    }
+    return strm.str();
+}
+
+PipelinePtr ExtendPipeline(ObjectPtr& src)
+{
+    if (src.use_count() == 1 && dynamic_cast<Pipeline *>(src.get()) != nullptr)
+        return static_pointer_cast<Pipeline>(src);
+    return PipelinePtr(new Pipeline(src));
+}
+
+void PushStep(Machine& machine, ObjectPtr& src, const PipelineStep& step)
+{
+    PipelinePtr pl = ExtendPipeline(src);
+    pl->steps.push_back(step);
+    ObjectPtr optr(pl);
+    machine.push(optr);
+}
+
+} // namespace rps
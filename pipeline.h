@@ -0,0 +1,56 @@
+#pragma once
+#include <vector>
+#include <string>
+
+namespace rps
+{
+
+/*
+ * FILTER, SELECT, APPLY, HEAD and SUBLIST given a Stream do not read it,
+ * they return a Pipeline that records the step. The steps run together
+ * on one item at a time when the Pipeline is read, and nothing is read
+ * from the source after the last HEAD or SUBLIST step is satisfied.
+ * A List is turned into a Stream with LAZY.
+ */
+struct PipelineStep
+{
+    enum Kind
+    {
+        STEP_APPLY          // replace the item with the result of program
+        , STEP_FILTER       // drop the item if program returns true
+        , STEP_SKIP         // drop the first count items
+        , STEP_TAKE         // end the pipeline after count items
+    };
+
+    Kind kind;
+    ProgramPtr program;
+    ObjectPtr arg;          // pushed after the item by APPLY1 and SELECT
+    int64_t count;
+};
+
+class Pipeline : public Stream
+{
+public:
+    explicit Pipeline(ObjectPtr src);
+
+    bool Next(Machine& machine, ObjectPtr& out) override;
+    std::string Describe() const override;
+
+    std::vector<PipelineStep> steps;
+
+private:
+    ObjectPtr src_;
+    ItemReader items_;
+    bool done_;
+};
+
+typedef Ref<Pipeline> PipelinePtr;
+
+// The Pipeline to add a step to: src itself when it is a Pipeline no one
+// else holds, otherwise a new one reading src
+PipelinePtr ExtendPipeline(ObjectPtr& src);
+
+// Add step to the Pipeline over src and push the Pipeline
+void PushStep(Machine& machine, ObjectPtr& src, const PipelineStep& step);
+
+} // namespace rps
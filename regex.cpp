@@ -0,0 +1,1040 @@
+#include <cstring>
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <mutex>
+#include "token.h"
+#include "object.h"
+#include "module.h"
+#include "machine.h"
+#include "regex.h"
+
+namespace rps
+{
+
+namespace
+{
+
+const int REGEX_MAX_REPEAT = 1000;
+const size_t REGEX_MAX_PROGRAM = 100000;
+const size_t REGEX_CACHE_SIZE = 256;
+const size_t DFA_MAX_STATES = 1024;     // per pattern, the DFA starts again after this
+const size_t DFA_MAX_PATTERNS = 64;     // per thread
+
+std::atomic<uint64_t> next_regex_id(1);
+
+bool IsWord(unsigned char ch)
+{
+    return isalnum(ch) || ch == '_';
+}
+
+struct Node;
+typedef std::unique_ptr<Node> NodePtr;
+
+struct Node
+{
+    enum Kind
+    {
+        N_CHAR, N_ANY, N_CLASS, N_BOL, N_EOL, N_WORDB, N_NWORDB,
+        N_EMPTY, N_GROUP, N_CONCAT, N_ALT, N_REPEAT
+    };
+
+    explicit Node(Kind k) : kind(k), c(0), min(0), max(0), greedy(true) {}
+
+    Kind kind;
+    int c;                  // char, class index or group number (-1 if not capturing)
+    int min;
+    int max;                // -1 for no limit
+    bool greedy;
+    std::vector<NodePtr> kids;
+};
+
+class Parser
+{
+public:
+    Parser(const std::string& pattern, std::vector<Regex::CharClass>& classes)
+    : pattern_(pattern)
+    , p_(pattern.data())
+    , end_(pattern.data() + pattern.size())
+    , classes_(classes)
+    , groups_(0)
+    {}
+
+    NodePtr Parse()
+    {
+        NodePtr node = Alternation();
+        if (p_ != end_)
+            Error("unmatched )");
+        return node;
+    }
+
+    size_t groups() const { return groups_; }
+
+private:
+    [[noreturn]] void Error(const char *what)
+    {
+        std::stringstream strm;
+        strm << "Regex: " << what << " at " << (p_ - pattern_.data()) << " in \"" << pattern_ << "\"";
+        throw std::runtime_error(strm.str().c_str());
+    }
+
+    NodePtr Alternation()
+    {
+        NodePtr first = Concatenation();
+        if (p_ == end_ || *p_ != '|')
+            return first;
+        NodePtr alt(new Node(Node::N_ALT));
+        alt->kids.push_back(std::move(first));
+        while (p_ != end_ && *p_ == '|')
+        {
+            ++p_;
+            alt->kids.push_back(Concatenation());
+        }
+        return alt;
+    }
+
+    NodePtr Concatenation()
+    {
+        NodePtr cat(new Node(Node::N_CONCAT));
+        while (p_ != end_ && *p_ != '|' && *p_ != ')')
+            cat->kids.push_back(Repetition());
+        if (cat->kids.empty())
+            return NodePtr(new Node(Node::N_EMPTY));
+        if (cat->kids.size() == 1)
+            return std::move(cat->kids[0]);
+        return cat;
+    }
+
+    // Parse {n}, {n,} or {n,m} at p_, false if it is not one
+    bool Counts(int& min, int& max)
+    {
+        const char *p = p_ + 1;
+        if (p == end_ || !isdigit((unsigned char)*p))
+            return false;
+        min = 0;
+        while (p != end_ && isdigit((unsigned char)*p))
+            min = std::min(min * 10 + (*p++ - '0'), REGEX_MAX_REPEAT + 1);
+        max = min;
+        if (p != end_ && *p == ',')
+        {
+            ++p;
+            max = -1;
+            if (p != end_ && isdigit((unsigned char)*p))
+            {
+                max = 0;
+                while (p != end_ && isdigit((unsigned char)*p))
+                    max = std::min(max * 10 + (*p++ - '0'), REGEX_MAX_REPEAT + 1);
+            }
+        }
+        if (p == end_ || *p != '}')
+            return false;
+        if (min > REGEX_MAX_REPEAT || max > REGEX_MAX_REPEAT)
+            Error("repeat count too large");
+        if (max != -1 && max < min)
+            Error("bad repeat count");
+        p_ = p + 1;
+        return true;
+    }
+
+    NodePtr Repetition()
+    {
+        NodePtr atom = Atom();
+        for (;;)
+        {
+            int min, max;
+            if (p_ == end_)
+                break;
+            if (*p_ == '*')
+            {
+                min = 0; max = -1; ++p_;
+            }
+            else if (*p_ == '+')
+            {
+                min = 1; max = -1; ++p_;
+            }
+            else if (*p_ == '?')
+            {
+                min = 0; max = 1; ++p_;
+            }
+            else if (*p_ == '{' && Counts(min, max))
+                ;
+            else
+                break;
+            switch (atom->kind)
+            {
+            case Node::N_BOL:
+            case Node::N_EOL:
+            case Node::N_WORDB:
+            case Node::N_NWORDB:
+            case Node::N_EMPTY:
+                Error("nothing to repeat");
+            default:
+                break;
+            }
+            NodePtr rep(new Node(Node::N_REPEAT));
+            rep->min = min;
+            rep->max = max;
+            if (p_ != end_ && *p_ == '?')
+            {
+                rep->greedy = false;
+                ++p_;
+            }
+            rep->kids.push_back(std::move(atom));
+            atom = std::move(rep);
+        }
+        return atom;
+    }
+
+    NodePtr Char(int c)
+    {
+        NodePtr node(new Node(Node::N_CHAR));
+        node->c = (unsigned char)c;
+        return node;
+    }
+
+    // Add the class escape \d \w \s (or their negation) to cls,
+    // false if ch is not one
+    bool ClassEscape(char ch, Regex::CharClass& cls)
+    {
+        int (*test)(int);
+        switch (ch)
+        {
+        case 'd': case 'D': test = isdigit; break;
+        case 's': case 'S': test = isspace; break;
+        case 'w': case 'W': test = nullptr; break;
+        default:
+            return false;
+        }
+        bool negate = isupper((unsigned char)ch);
+        for (int c = 0; c < 256; ++c)
+        {
+            bool in = test ? test(c) != 0 : IsWord(c);
+            if (in != negate)
+                cls.set(c);
+        }
+        return true;
+    }
+
+    char Escaped(char ch)
+    {
+        switch (ch)
+        {
+        case 'n': return '\n';
+        case 't': return '\t';
+        case 'r': return '\r';
+        case 'f': return '\f';
+        case 'v': return '\v';
+        default: return ch;
+        }
+    }
+
+    NodePtr Class()
+    {
+        // p_ is after the [
+        Regex::CharClass cls;
+        memset(cls.bits, 0, sizeof(cls.bits));
+        bool negate = false;
+        if (p_ != end_ && *p_ == '^')
+        {
+            negate = true;
+            ++p_;
+        }
+        bool first = true;
+        while (p_ != end_ && (*p_ != ']' || first))
+        {
+            first = false;
+            unsigned char lo = *p_++;
+            if (lo == '\\')
+            {
+                if (p_ == end_)
+                    break;
+                if (ClassEscape(*p_, cls))
+                {
+                    ++p_;
+                    continue;
+                }
+                lo = Escaped(*p_++);
+            }
+            unsigned char hi = lo;
+            if (p_ + 1 < end_ && *p_ == '-' && p_[1] != ']')
+            {
+                ++p_;
+                hi = *p_++;
+                if (hi == '\\' && p_ != end_)
+                    hi = Escaped(*p_++);
+                if (hi < lo)
+                    Error("bad character range");
+            }
+            for (int c = lo; c <= hi; ++c)
+                cls.set(c);
+        }
+        if (p_ == end_)
+            Error("missing ]");
+        ++p_;
+        if (negate)
+        {
+            for (int i = 0; i < 4; ++i)
+                cls.bits[i] = ~cls.bits[i];
+        }
+        return AddClass(cls);
+    }
+
+    NodePtr AddClass(const Regex::CharClass& cls)
+    {
+        NodePtr node(new Node(Node::N_CLASS));
+        node->c = classes_.size();
+        classes_.push_back(cls);
+        return node;
+    }
+
+    NodePtr Atom()
+    {
+        char ch = *p_++;
+        switch (ch)
+        {
+        case '.':
+            return NodePtr(new Node(Node::N_ANY));
+        case '^':
+            return NodePtr(new Node(Node::N_BOL));
+        case '$':
+            return NodePtr(new Node(Node::N_EOL));
+        case '[':
+            return Class();
+        case '(':
+            {
+                NodePtr group(new Node(Node::N_GROUP));
+                group->c = -1;
+                if (end_ - p_ >= 2 && p_[0] == '?' && p_[1] == ':')
+                    p_ += 2;
+                else
+                    group->c = ++groups_;
+                group->kids.push_back(Alternation());
+                if (p_ == end_ || *p_ != ')')
+                    Error("missing )");
+                ++p_;
+                return group;
+            }
+        case '*':
+        case '+':
+        case '?':
+            --p_;
+            Error("nothing to repeat");
+        case '\\':
+            {
+                if (p_ == end_)
+                    Error("trailing \\");
+                ch = *p_++;
+                if (ch == 'b')
+                    return NodePtr(new Node(Node::N_WORDB));
+                if (ch == 'B')
+                    return NodePtr(new Node(Node::N_NWORDB));
+                Regex::CharClass cls;
+                memset(cls.bits, 0, sizeof(cls.bits));
+                if (ClassEscape(ch, cls))
+                    return AddClass(cls);
+                return Char(Escaped(ch));
+            }
+        default:
+            return Char(ch);
+        }
+    }
+
+    const std::string& pattern_;
+    const char *p_;
+    const char *end_;
+    std::vector<Regex::CharClass>& classes_;
+    size_t groups_;
+};
+
+class Compiler
+{
+public:
+    explicit Compiler(std::vector<Regex::Inst>& prog) : prog_(prog) {}
+
+    void Emit(const Node *node)
+    {
+        switch (node->kind)
+        {
+        case Node::N_CHAR:
+            Add(Regex::RE_CHAR, node->c);
+            break;
+        case Node::N_ANY:
+            Add(Regex::RE_ANY);
+            break;
+        case Node::N_CLASS:
+            Add(Regex::RE_CLASS, node->c);
+            break;
+        case Node::N_BOL:
+            Add(Regex::RE_BOL);
+            break;
+        case Node::N_EOL:
+            Add(Regex::RE_EOL);
+            break;
+        case Node::N_WORDB:
+            Add(Regex::RE_WORDB);
+            break;
+        case Node::N_NWORDB:
+            Add(Regex::RE_NWORDB);
+            break;
+        case Node::N_EMPTY:
+            break;
+        case Node::N_GROUP:
+            if (node->c >= 0)
+                Add(Regex::RE_SAVE, 2 * node->c);
+            Emit(node->kids[0].get());
+            if (node->c >= 0)
+                Add(Regex::RE_SAVE, 2 * node->c + 1);
+            break;
+        case Node::N_CONCAT:
+            for (const NodePtr& kid : node->kids)
+                Emit(kid.get());
+            break;
+        case Node::N_ALT:
+            {
+                std::vector<size_t> jumps;
+                for (size_t i = 0; i < node->kids.size(); ++i)
+                {
+                    size_t split = 0;
+                    if (i + 1 < node->kids.size())
+                    {
+                        split = Add(Regex::RE_SPLIT);
+                        prog_[split].x = prog_.size();
+                    }
+                    Emit(node->kids[i].get());
+                    if (i + 1 < node->kids.size())
+                    {
+                        jumps.push_back(Add(Regex::RE_JMP));
+                        prog_[split].y = prog_.size();
+                    }
+                }
+                for (size_t j : jumps)
+                    prog_[j].x = prog_.size();
+            }
+            break;
+        case Node::N_REPEAT:
+            Repeat(node);
+            break;
+        }
+        if (prog_.size() > REGEX_MAX_PROGRAM)
+            throw std::runtime_error("Regex: pattern too large");
+    }
+
+private:
+    size_t Add(Regex::OpCode op, int c = 0)
+    {
+        prog_.push_back(Regex::Inst{op, c, 0, 0});
+        return prog_.size() - 1;
+    }
+
+    void Patch(size_t split, bool greedy, size_t body, size_t out)
+    {
+        prog_[split].x = greedy ? body : out;
+        prog_[split].y = greedy ? out : body;
+    }
+
+    void Repeat(const Node *node)
+    {
+        const Node *body = node->kids[0].get();
+        for (int i = 0; i < node->min; ++i)
+            Emit(body);
+        if (node->max == -1)
+        {
+            // L: split body, out; body; jmp L
+            size_t split = Add(Regex::RE_SPLIT);
+            Emit(body);
+            size_t jmp = Add(Regex::RE_JMP);
+            prog_[jmp].x = split;
+            Patch(split, node->greedy, split + 1, prog_.size());
+            return;
+        }
+        // each optional copy is skipped to the end
+        std::vector<size_t> splits;
+        for (int i = node->min; i < node->max; ++i)
+        {
+            splits.push_back(Add(Regex::RE_SPLIT));
+            Emit(body);
+        }
+        for (size_t split : splits)
+            Patch(split, node->greedy, split + 1, prog_.size());
+    }
+
+    std::vector<Regex::Inst>& prog_;
+};
+
+// The literal every match starts with, and whether that is the whole pattern
+void Prefix(const Node *node, std::string& prefix, bool& literal)
+{
+    literal = false;
+    if (node->kind == Node::N_CHAR)
+    {
+        prefix.push_back(node->c);
+        literal = true;
+        return;
+    }
+    if (node->kind != Node::N_CONCAT)
+        return;
+    for (const NodePtr& kid : node->kids)
+    {
+        if (kid->kind != Node::N_CHAR)
+            return;
+        prefix.push_back(kid->c);
+    }
+    literal = true;
+}
+
+// Follow the jumps from the pcs on stack and add the ones that consume
+// input, match or wait for the end of the text to set, sorted
+void Closure(const std::vector<Regex::Inst>& prog, std::vector<int>& stack,
+             bool at_begin, bool at_end, std::vector<int>& set)
+{
+    std::vector<bool> seen(prog.size());
+    set.clear();
+    while (!stack.empty())
+    {
+        int pc = stack.back();
+        stack.pop_back();
+        if (seen[pc])
+            continue;
+        seen[pc] = true;
+        const Regex::Inst& in = prog[pc];
+        switch (in.op)
+        {
+        case Regex::RE_JMP:
+            stack.push_back(in.x);
+            break;
+        case Regex::RE_SPLIT:
+            stack.push_back(in.y);
+            stack.push_back(in.x);
+            break;
+        case Regex::RE_SAVE:
+            stack.push_back(pc + 1);
+            break;
+        case Regex::RE_BOL:
+            if (at_begin)
+                stack.push_back(pc + 1);
+            break;
+        case Regex::RE_WORDB:
+        case Regex::RE_NWORDB:
+            // only when working out first_, the DFA does not take these
+            stack.push_back(pc + 1);
+            break;
+        case Regex::RE_EOL:
+            if (at_end)
+                stack.push_back(pc + 1);
+            else
+                set.push_back(pc);
+            break;
+        default:
+            set.push_back(pc);
+            break;
+        }
+    }
+    std::sort(set.begin(), set.end());
+}
+
+/*
+ * The thread lists of the VM. A list holds each pc at most once, in
+ * priority order, with the captures of the thread that got there first.
+ */
+struct ThreadList
+{
+    std::vector<int> pcs;
+    std::vector<const char *> caps;     // ncaps per thread
+    std::vector<uint32_t> marks;        // marks[pc] == stamp if pc was added
+    uint32_t stamp;
+
+    void Reset(size_t size, size_t ncaps)
+    {
+        if (marks.size() < size)
+        {
+            marks.assign(size, 0);
+            stamp = 0;
+        }
+        if (caps.size() < size * ncaps)
+            caps.resize(size * ncaps);
+        pcs.clear();
+        if (++stamp == 0)
+        {
+            std::fill(marks.begin(), marks.end(), 0);
+            stamp = 1;
+        }
+    }
+};
+
+struct AddEntry
+{
+    int pc;
+    int slot;               // >= 0 to restore caps[slot] to old
+    const char *old;
+};
+
+struct Scratch
+{
+    ThreadList lists[2];
+    std::vector<AddEntry> stack;
+    std::vector<const char *> caps;
+};
+
+thread_local Scratch scratch;
+
+} // namespace
+
+Regex::Regex(const std::string& pattern)
+: groups_(0)
+, anchored_(false)
+, literal_(false)
+, finder_(std::string())
+{
+    Parser parser(pattern, classes_);
+    NodePtr root = parser.Parse();
+    groups_ = parser.groups();
+
+    Compiler compiler(prog_);
+    compiler.Emit(root.get());
+    prog_.push_back(Inst{RE_MATCH, 0, 0, 0});
+
+    Prefix(root.get(), prefix_, literal_);
+    finder_ = Finder(prefix_);
+    const Node *first = root.get();
+    if (first->kind == Node::N_CONCAT)
+        first = first->kids[0].get();
+    anchored_ = first->kind == Node::N_BOL;
+
+    dfa_ = true;
+    for (const Inst& in : prog_)
+        if (in.op == RE_WORDB || in.op == RE_NWORDB)
+            dfa_ = false;
+    id_ = next_regex_id++;
+
+    // the bytes a match can start with
+    std::vector<int> stack(1, 0);
+    std::vector<int> set;
+    Closure(prog_, stack, true, true, set);
+    first_ = CharClass{{0, 0, 0, 0}};
+    empty_ = false;
+    for (int pc : set)
+    {
+        const Inst& in = prog_[pc];
+        if (in.op == RE_CHAR)
+            first_.set(in.c);
+        else if (in.op == RE_CLASS)
+        {
+            for (int i = 0; i < 4; ++i)
+                first_.bits[i] |= classes_[in.c].bits[i];
+        }
+        else if (in.op == RE_ANY)
+        {
+            for (int i = 0; i < 4; ++i)
+                first_.bits[i] = ~uint64_t(0);
+        }
+        else if (in.op == RE_MATCH)
+            empty_ = true;
+    }
+    if (empty_)
+    {
+        for (int i = 0; i < 4; ++i)
+            first_.bits[i] = ~uint64_t(0);
+    }
+}
+
+namespace
+{
+
+// Follow the jumps from pc and add the threads that reach an instruction
+// consuming input, or the match, to list. Only the second branch of a
+// split and the captures to restore go on the stack.
+void AddThread(const std::vector<Regex::Inst>& prog, ThreadList& list,
+               std::vector<AddEntry>& stack, int pc, const char **caps, size_t ncaps,
+               const char *begin, const char *end, const char *sp)
+{
+    stack.clear();
+    for (;;)
+    {
+        while (pc >= 0 && list.marks[pc] != list.stamp)
+        {
+            list.marks[pc] = list.stamp;
+            const Regex::Inst& in = prog[pc];
+            switch (in.op)
+            {
+            case Regex::RE_JMP:
+                pc = in.x;
+                continue;
+            case Regex::RE_SPLIT:
+                stack.push_back(AddEntry{in.y, -1, nullptr});
+                pc = in.x;
+                continue;
+            case Regex::RE_SAVE:
+                if ((size_t)in.c < ncaps)
+                {
+                    stack.push_back(AddEntry{0, in.c, caps[in.c]});
+                    caps[in.c] = sp;
+                }
+                ++pc;
+                continue;
+            case Regex::RE_BOL:
+                pc = sp == begin ? pc + 1 : -1;
+                continue;
+            case Regex::RE_EOL:
+                pc = sp == end ? pc + 1 : -1;
+                continue;
+            case Regex::RE_WORDB:
+            case Regex::RE_NWORDB:
+                {
+                    bool before = sp > begin && IsWord(sp[-1]);
+                    bool after = sp < end && IsWord(*sp);
+                    bool at = before != after;
+                    pc = at == (in.op == Regex::RE_WORDB) ? pc + 1 : -1;
+                }
+                continue;
+            default:
+                {
+                    size_t n = list.pcs.size();
+                    list.pcs.push_back(pc);
+                    if (ncaps)
+                        std::copy(caps, caps + ncaps, list.caps.begin() + n * ncaps);
+                }
+                pc = -1;
+                continue;
+            }
+        }
+        // restore the captures saved since the split being resumed
+        for (;;)
+        {
+            if (stack.empty())
+                return;
+            AddEntry e = stack.back();
+            stack.pop_back();
+            if (e.slot < 0)
+            {
+                pc = e.pc;
+                break;
+            }
+            caps[e.slot] = e.old;
+        }
+    }
+}
+
+} // namespace
+
+bool Regex::Run(const char *begin, const char *end, const char *start,
+                const char **caps, size_t ncaps) const
+{
+    Scratch& s = scratch;
+    ThreadList *clist = &s.lists[0];
+    ThreadList *nlist = &s.lists[1];
+    clist->Reset(prog_.size(), ncaps);
+    s.caps.assign(ncaps, nullptr);
+    bool matched = false;
+
+    for (const char *sp = start; ; ++sp)
+    {
+        if (!matched && (!anchored_ || sp == begin))
+        {
+            // a match can only start where prefix_ is, or a byte in first_
+            bool here = true;
+            if (!prefix_.empty() && clist->pcs.empty())
+            {
+                // nothing is running, skip ahead to the next possible start
+                sp = finder_.Find(sp, end);
+                if (sp == nullptr)
+                    break;
+            }
+            else if (!prefix_.empty())
+                here = (size_t)(end - sp) >= prefix_.size()
+                    && memcmp(sp, prefix_.data(), prefix_.size()) == 0;
+            else if (clist->pcs.empty())
+            {
+                while (sp < end && !first_.test(*sp))
+                    ++sp;
+                here = sp < end || empty_;
+            }
+            else
+                here = sp < end ? first_.test(*sp) : empty_;
+            if (here)
+            {
+                std::fill(s.caps.begin(), s.caps.end(), nullptr);
+                if (ncaps)
+                    s.caps[0] = sp;
+                AddThread(prog_, *clist, s.stack, 0, s.caps.data(), ncaps, begin, end, sp);
+            }
+        }
+        if (clist->pcs.empty())
+        {
+            // the pattern can not match here, try the next start
+            if (matched || anchored_ || sp >= end)
+                break;
+            clist->Reset(prog_.size(), ncaps);
+            continue;
+        }
+
+        nlist->Reset(prog_.size(), ncaps);
+        for (size_t i = 0; i < clist->pcs.size(); ++i)
+        {
+            const Inst& in = prog_[clist->pcs[i]];
+            const char **tcaps = ncaps ? &clist->caps[i * ncaps] : nullptr;
+            bool step = false;
+            switch (in.op)
+            {
+            case RE_CHAR:
+                step = sp < end && (unsigned char)*sp == in.c;
+                break;
+            case RE_ANY:
+                step = sp < end && *sp != '\n';
+                break;
+            case RE_CLASS:
+                step = sp < end && classes_[in.c].test(*sp);
+                break;
+            case RE_MATCH:
+                if (ncaps == 0)
+                    return true;
+                matched = true;
+                std::copy(tcaps, tcaps + ncaps, caps);
+                caps[1] = sp;
+                // threads after this one have a lower priority
+                i = clist->pcs.size();
+                continue;
+            default:
+                break;
+            }
+            if (step)
+                AddThread(prog_, *nlist, s.stack, clist->pcs[i] + 1, tcaps, ncaps, begin, end, sp + 1);
+        }
+        std::swap(clist, nlist);
+        if (sp >= end)
+            break;
+    }
+    return matched;
+}
+
+/*
+ * A DFA state is the sorted set of pcs the Pike VM would have in its
+ * thread list, without the captures. The states and the transitions out
+ * of them are made the first time they are needed.
+ */
+struct Regex::Dfa
+{
+    std::vector<std::vector<int>> sets;
+    std::map<std::vector<int>, int> index;
+    std::vector<int> next;          // 256 per state, -1 if not made yet
+    std::vector<uint8_t> flags;     // DFA_MATCH, DFA_MATCH_AT_END
+    int start[2];                   // at the start of the text, and after it
+};
+
+namespace
+{
+
+enum
+{
+    DFA_MATCH = 1           // a thread has matched
+    , DFA_MATCH_AT_END = 2  // a thread matches if the text ends here
+    , DFA_DEAD = 4          // there are no threads
+};
+
+thread_local std::unordered_map<uint64_t, Regex::Dfa> dfas;
+
+} // namespace
+
+// The state at the beginning of the text is kept apart from one with
+// the same threads elsewhere, if the text ends there ^ matches too
+int Regex::DfaState(Dfa& dfa, std::vector<int>& set, bool at_begin) const
+{
+    if (at_begin)
+        set.push_back(-1);
+    auto it = dfa.index.find(set);
+    if (it != dfa.index.end())
+    {
+        if (at_begin)
+            set.pop_back();
+        return it->second;
+    }
+    std::vector<int> key(set);
+    if (at_begin)
+        set.pop_back();
+
+    uint8_t flags = 0;
+    std::vector<int> stack;
+    for (int pc : set)
+    {
+        if (prog_[pc].op == RE_MATCH)
+            flags |= DFA_MATCH;
+        else if (prog_[pc].op == RE_EOL)
+            stack.push_back(pc + 1);
+    }
+    if (set.empty())
+        flags = DFA_DEAD;
+    else if (flags)
+        flags |= DFA_MATCH_AT_END;
+    else if (!stack.empty())
+    {
+        std::vector<int> end_set;
+        Closure(prog_, stack, at_begin, true, end_set);
+        for (int pc : end_set)
+            if (prog_[pc].op == RE_MATCH)
+                flags |= DFA_MATCH_AT_END;
+    }
+
+    int state = dfa.sets.size();
+    dfa.index.emplace(std::move(key), state);
+    dfa.sets.push_back(set);
+    dfa.next.resize(dfa.next.size() + 256, -1);
+    dfa.flags.push_back(flags);
+    return state;
+}
+
+int Regex::DfaStep(Dfa& dfa, int state, unsigned char ch) const
+{
+    std::vector<int> stack;
+    for (int pc : dfa.sets[state])
+    {
+        const Inst& in = prog_[pc];
+        bool step = false;
+        switch (in.op)
+        {
+        case RE_CHAR:
+            step = in.c == ch;
+            break;
+        case RE_ANY:
+            step = ch != '\n';
+            break;
+        case RE_CLASS:
+            step = classes_[in.c].test(ch);
+            break;
+        default:
+            break;
+        }
+        if (step)
+            stack.push_back(pc + 1);
+    }
+    // a match can start at every position
+    if (!anchored_)
+        stack.push_back(0);
+    std::vector<int> set;
+    Closure(prog_, stack, false, false, set);
+
+    if (dfa.sets.size() >= DFA_MAX_STATES)
+    {
+        // too many states, throw them away and start again
+        dfa.sets.clear();
+        dfa.index.clear();
+        dfa.next.clear();
+        dfa.flags.clear();
+        dfa.start[0] = dfa.start[1] = -1;
+        int next = DfaState(dfa, set, false);
+        std::vector<int> start;
+        stack.assign(1, 0);
+        Closure(prog_, stack, false, false, start);
+        dfa.start[1] = DfaState(dfa, start, false);
+        return next;
+    }
+    int next = DfaState(dfa, set, false);
+    dfa.next[state * 256 + ch] = next;
+    return next;
+}
+
+bool Regex::RunDfa(const char *begin, const char *end, const char *start) const
+{
+    if (anchored_ && start != begin)
+        return false;
+    auto it = dfas.find(id_);
+    if (it == dfas.end())
+    {
+        if (dfas.size() >= DFA_MAX_PATTERNS)
+            dfas.clear();
+        it = dfas.emplace(id_, Dfa()).first;
+        it->second.start[0] = it->second.start[1] = -1;
+    }
+    Dfa& dfa = it->second;
+    for (int i = 0; i < 2; ++i)
+    {
+        if (dfa.start[i] >= 0)
+            continue;
+        std::vector<int> stack(1, 0);
+        std::vector<int> set;
+        Closure(prog_, stack, i == 0, false, set);
+        dfa.start[i] = DfaState(dfa, set, i == 0);
+    }
+
+    int state = dfa.start[start == begin ? 0 : 1];
+    for (const char *sp = start; ; ++sp)
+    {
+        uint8_t flags = dfa.flags[state];
+        if (flags & DFA_MATCH)
+            return true;
+        if (sp == end)
+            return flags & DFA_MATCH_AT_END;
+        if (flags & DFA_DEAD)
+            return false;
+        if (state == dfa.start[1])
+        {
+            // nothing is running, skip ahead to the next possible start
+            if (!prefix_.empty())
+                sp = finder_.Find(sp, end);
+            else
+            {
+                while (sp < end && !first_.test(*sp))
+                    ++sp;
+            }
+            if (sp == nullptr || sp == end)
+                return sp != nullptr && (flags & DFA_MATCH_AT_END);
+        }
+        unsigned char ch = *sp;
+        int next = dfa.next[state * 256 + ch];
+        state = next >= 0 ? next : DfaStep(dfa, state, ch);
+    }
+}
+
+bool Regex::Search(const char *begin, const char *end, const char *start,
+                   std::vector<const char *>& caps) const
+{
+    size_t ncaps = 2 * (groups_ + 1);
+    caps.assign(ncaps, nullptr);
+    if (literal_)
+    {
+        const char *p = finder_.Find(start, end);
+        if (p == nullptr)
+            return false;
+        caps[0] = p;
+        caps[1] = p + prefix_.size();
+        return true;
+    }
+    // most texts searched do not match, and the DFA finds that faster
+    if (dfa_ && !RunDfa(begin, end, start))
+        return false;
+    return Run(begin, end, start, caps.data(), ncaps);
+}
+
+bool Regex::Search(const char *begin, const char *end) const
+{
+    if (literal_)
+        return finder_.Find(begin, end) != nullptr;
+    if (dfa_)
+        return RunDfa(begin, end, begin);
+    return Run(begin, end, begin, nullptr, 0);
+}
+
+namespace
+{
+std::mutex regex_mutex;
+}
+
+RegexPtr GetRegex(Machine& machine, const std::string& pattern)
+{
+    if (machine.parent_)
+    {
+        std::lock_guard<std::mutex> lock(regex_mutex);
+        return GetRegex(*machine.parent_, pattern);
+    }
+    auto it = machine.regexes_.find(pattern);
+    if (it != machine.regexes_.end())
+        return it->second;
+    RegexPtr re = std::make_shared<const Regex>(pattern);
+    if (machine.regexes_.size() >= REGEX_CACHE_SIZE)
+        machine.regexes_.clear();
+    machine.regexes_.emplace(pattern, re);
+    return re;
+}
+
+} // namespace rps
@@ -0,0 +1,99 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+#include "search.h"
+
+namespace rps
+{
+
+class Machine;
+
+/*
+ * Regular expressions run on a Pike VM: the pattern is compiled into a
+ * small program and all the ways it can match are followed in step
+ * through the text, so a search takes time linear in the text whatever
+ * the pattern. Matches are leftmost first, as in Perl.
+ *
+ * Whether there is a match at all is answered by a DFA built from the
+ * same program as the text is read, one state per set of threads, so
+ * most bytes cost a single table lookup. Each thread has its own DFAs.
+ *
+ * Syntax: literals, . [abc] [^a-z] \d \w \s \D \W \S \b \B ^ $
+ * ( ) (?: ) | * + ? {n} {n,} {n,m} and the lazy forms *? +? ?? {}?
+ */
+class Regex
+{
+public:
+    explicit Regex(const std::string& pattern);
+
+    // Find the leftmost match in [begin, end) starting at or after start.
+    // caps is set to 2 * (groups() + 1) pointers, begin and end of the
+    // whole match followed by each group, nullptr for a group not used.
+    bool Search(const char *begin, const char *end, const char *start,
+                std::vector<const char *>& caps) const;
+    // Whether there is a match anywhere in [begin, end)
+    bool Search(const char *begin, const char *end) const;
+
+    size_t groups() const { return groups_; }
+
+    enum OpCode : uint8_t
+    {
+        RE_CHAR         // match c
+        , RE_ANY        // any byte but a newline
+        , RE_CLASS      // byte in classes_[c]
+        , RE_MATCH
+        , RE_JMP        // continue at x
+        , RE_SPLIT      // continue at x, or at y with a lower priority
+        , RE_SAVE       // caps[c] = position
+        , RE_BOL        // at the start of the text
+        , RE_EOL        // at the end of the text
+        , RE_WORDB      // at a word boundary
+        , RE_NWORDB     // not at a word boundary
+    };
+
+    struct Inst
+    {
+        OpCode op;
+        int c;
+        int x;
+        int y;
+    };
+
+    struct CharClass
+    {
+        uint64_t bits[4];
+        bool test(unsigned char ch) const { return (bits[ch >> 6] >> (ch & 63)) & 1; }
+        void set(unsigned char ch) { bits[ch >> 6] |= uint64_t(1) << (ch & 63); }
+    };
+
+    struct Dfa;
+
+private:
+    bool Run(const char *begin, const char *end, const char *start,
+             const char **caps, size_t ncaps) const;
+    bool RunDfa(const char *begin, const char *end, const char *start) const;
+    int DfaState(Dfa& dfa, std::vector<int>& set, bool at_begin) const;
+    int DfaStep(Dfa& dfa, int state, unsigned char ch) const;
+
+    std::vector<Inst> prog_;
+    std::vector<CharClass> classes_;
+    size_t groups_;
+    bool anchored_;         // every match starts at the beginning of the text
+    bool literal_;          // the pattern is prefix_ and nothing else
+    std::string prefix_;    // every match starts with this
+    Finder finder_;         // searches for prefix_
+    CharClass first_;       // the bytes a match can start with
+    bool empty_;            // a match can be empty
+    bool dfa_;              // RunDfa can be used, there is no \b or \B
+    uint64_t id_;           // names the DFAs of this pattern
+};
+
+typedef std::shared_ptr<const Regex> RegexPtr;
+
+// The compiled pattern from the cache of the machine, compiled and
+// added if it is not there. Throws on a bad pattern.
+RegexPtr GetRegex(Machine& machine, const std::string& pattern);
+
+} // namespace rps
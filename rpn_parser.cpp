@@ -1,6 +1,7 @@
 #include <vector>
 #include <unordered_map>
 #include <cassert>
+#include <cstring>
 #include <iostream>
 #include <fstream>
 #include <sstream>
@@ -14,15 +15,102 @@
 #include "commands.h"
 #include "utilities.h"
 #include "shell.h"
+#include "module_cache.h"
 
 namespace rps
 {
 
+/*
+ * Keywords are found with a perfect hash of the length and the first
+ * and last characters, the static_assert checks every keyword sits in
+ * its own slot.
+ */
+struct Keyword
+{
+    const char *name;
+    size_t len;
+    TokenType type;
+};
+
+const size_t keyword_slots = 32;
+
+constexpr size_t KeywordHash(const char *s, size_t len)
+{
+    return (len + (unsigned char)s[0] + 5 * (unsigned char)s[len-1]) % keyword_slots;
+}
+
+constexpr Keyword keywords[keyword_slots] = {
+    {"", 0, TOKEN_NOTOKEN}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"ELSE", 4, TOKEN_ELSE}           // 2
+    , {"FOR", 3, TOKEN_FOR}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"ENDFOR", 6, TOKEN_ENDFOR}       // 5
+    , {"ENDWHILE", 8, TOKEN_ENDWHILE}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"ENDIF", 5, TOKEN_ENDIF}
+    , {"IF", 2, TOKEN_IF}
+    , {"", 0, TOKEN_NOTOKEN}            // 10
+    , {"None", 4, TOKEN_NONE}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"EXIT", 4, TOKEN_EXIT}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"", 0, TOKEN_NOTOKEN}            // 15
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"SHELL", 5, TOKEN_SHELL}         // 20
+    , {"WHILE", 5, TOKEN_WHILE}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"", 0, TOKEN_NOTOKEN}            // 25
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"REPEAT", 6, TOKEN_REPEAT}
+    , {"", 0, TOKEN_NOTOKEN}
+    , {"THEN", 4, TOKEN_THEN}           // 30
+    , {"", 0, TOKEN_NOTOKEN}
+};
+
+constexpr bool KeywordsPlaced(size_t slot)
+{
+    return slot == keyword_slots
+        || ((keywords[slot].len == 0 || KeywordHash(keywords[slot].name, keywords[slot].len) == slot)
+            && KeywordsPlaced(slot + 1));
+}
+
+static_assert(KeywordsPlaced(0), "keyword table is not a perfect hash");
+
+TokenType FindKeyword(const char *begin, const char *end)
+{
+    size_t len = end - begin;
+    const Keyword& kw = keywords[KeywordHash(begin, len)];
+    if (kw.len == len && memcmp(kw.name, begin, len) == 0)
+        return kw.type;
+    return TOKEN_COMMAND;
+}
+
+// EOL, brackets and keywords carry no data, so one Token of each is shared
+ObjectPtr SharedToken(TokenType type, const char *begin, const char *end)
+{
+    static ObjectPtr tokens[TOKEN_SHELL + 1];
+    if (!tokens[type])
+        tokens[type].reset(new Token(type, std::string(begin, end)));
+    return tokens[type];
+}
+
+inline bool IsIdentifierChar(char c)
+{
+    return isalnum((unsigned char)c) || c == '.' || c == '_' || c == '/' || c == '-';
+}
+
 void SkipWhitespace(Source& src)
 {
-    while(!src.istrm.eof())
+    while(!src.iseof())
     {
-        while (src.it != src.line.end())
+        while (src.it != src.end)
         {
             if (*src.it == ' ' || *src.it == '\t')
                 ++src.it;
@@ -33,14 +121,28 @@ void SkipWhitespace(Source& src)
     }
 }
 
-bool CollectDelimited(Source& src, std::string& out, char delim)
+// Strings without escapes that end on the same line are returned as a
+// span of the source, the rest are copied into out.
+void CollectDelimited(Source& src, std::string& out, char delim, Lexeme& lex)
 {
-    out.clear();
     assert(*src.it == delim);
     ++src.it;
-    while(!src.istrm.eof())
+    const char *p = src.it;
+    while (p != src.end && *p != delim && *p != '\\')
+        ++p;
+    if (p != src.end && *p == delim)
     {
-        while (src.it != src.line.end())
+        lex.begin = src.it;
+        lex.end = p;
+        src.it = p + 1;
+        return;
+    }
+
+    out.assign(src.it, p);
+    src.it = p;
+    while(!src.iseof())
+    {
+        while (src.it != src.end)
         {
             if (*src.it == '\\')
             {
@@ -49,13 +151,22 @@ bool CollectDelimited(Source& src, std::string& out, char delim)
                     out.push_back('\n');
                 else if (*src.it == 't')
                     out.push_back('\t');
+                else if (*src.it == '\\' || *src.it == delim)
+                    out.push_back(*src.it);
                 else
+                {
+                    // other escapes are kept for the regular expression
+                    // commands, "\d" is \d
+                    out.push_back('\\');
                     out.push_back(*src.it);
+                }
             }
             else if (*src.it == delim)
             {
                 ++src.it;
-                return true;
+                lex.begin = out.data();
+                lex.end = out.data() + out.size();
+                return;
             }
             else
                 out.push_back(*src.it);
@@ -63,200 +174,137 @@ bool CollectDelimited(Source& src, std::string& out, char delim)
         }
         src.Read();
     }
-    if (out.size())
-        return true;
-    return false;
+    lex.begin = out.data();
+    lex.end = out.data() + out.size();
 }
 
-bool CollectIdentifier(Source& src, std::string& out)
+// Punctuation and keywords are returned as their own type, everything
+// else as TOKEN_STRING, TOKEN_INTEGER or TOKEN_COMMAND (an identifier).
+// Comments are skipped. False at the end of input, or TOKEN_INVALID.
+bool RPNParser::Lex(Source& src, Lexeme& lex)
 {
-    out.clear();
-
-    if (*src.it == '(' and *(src.it+1) == ')')
-    {
-        out = "()";
-        src.it += 2;
-        return true;
-    }
-    if (*src.it == '-' && isdigit(*(src.it+1)))
-        return false;
-    if (isdigit(*src.it))
-        return false;
-    while (src.it != src.line.end())
+    while (true)
     {
-        if (isalnum(*src.it))
-            out.push_back(*src.it);
-        else if (isdigit(*src.it))
-            out.push_back(*src.it);
-        else if (*src.it == '.')
-            out.push_back(*src.it);
-        else if (*src.it == '_')
-            out.push_back(*src.it);
-        else if (*src.it == '/')
-            out.push_back(*src.it);
-        else if (*src.it == '-')
-            out.push_back(*src.it);
-        else
-            break;
-        ++src.it;
-    }
-    if (out.size())
-        return true;
-    return false;
-}
+        SkipWhitespace(src);
+        if(src.iseof())
+            return false;
 
-bool CollectInteger(Source& src, std::string& out)
-{
-    out.clear();
-    if (*src.it == '-')
-    {
-        ++src.it;
-        if (isdigit(*src.it) == false)
+        const char *p = src.it;
+        lex.begin = p;
+        lex.end = p + 1;
+        switch (*p)
         {
-            --src.it;
-            return false;
-        }
-        out.push_back('-');
-    }
-    while (src.it != src.line.end())
-    {
-        if (isdigit(*src.it))
-            out.push_back(*src.it);
-        else
-            break;
+        case '\n':
+            lex.type = TOKEN_EOL;
+            ++src.it;
+            return true;
+        case '\"':
+        case '\'':
+            lex.type = TOKEN_STRING;
+            CollectDelimited(src, scratch, *p, lex);
+            return true;
+        case '[':
+            lex.type = TOKEN_START_LIST;
+            ++src.it;
+            return true;
+        case '{':
+            lex.type = TOKEN_START_MAP;
+            ++src.it;
+            return true;
+        case ']':
+            lex.type = TOKEN_END_LIST;
+            ++src.it;
+            return true;
+        case '}':
+            lex.type = TOKEN_END_MAP;
+            ++src.it;
+            return true;
+        case '<':
+            if (p[1] != '<')
+                throw std::runtime_error("Expected \'<\' in input");
+            lex.type = TOKEN_START_PROGRAM;
+            lex.end = src.it = p + 2;
+            return true;
+        case '>':
+            if (p[1] != '>')
+                throw std::runtime_error("Expected \'>\' in input");
+            lex.type = TOKEN_END_PROGRAM;
+            lex.end = src.it = p + 2;
+            return true;
+        case '#':
+            src.SkipLine();
+            continue;
+        }
+
+        if (p[0] == '(' && p[1] == ')')
+        {
+            lex.type = TOKEN_COMMAND;
+            lex.end = src.it = p + 2;
+            return true;
+        }
+        if (isdigit((unsigned char)p[0]) || (p[0] == '-' && isdigit((unsigned char)p[1])))
+        {
+            ++p;
+            while (isdigit((unsigned char)*p))
+                ++p;
+            lex.type = TOKEN_INTEGER;
+            lex.end = src.it = p;
+            return true;
+        }
+        if (IsIdentifierChar(*p))
+        {
+            while (IsIdentifierChar(*p))
+                ++p;
+            lex.type = FindKeyword(src.it, p);
+            lex.end = src.it = p;
+            return true;
+        }
+        lex.type = TOKEN_INVALID;
         ++src.it;
+        return false;
     }
-    if (out.size())
-        return true;
-    return false;
 }
 
 bool RPNParser::GetObject(Machine& machine, Source& src, ObjectPtr& optr)
 {
-    std::string out;
-    SkipWhitespace(src);
-    if(src.iseof())
+    Lexeme lex;
+    if (!Lex(src, lex))
     {
+        if (lex.type == TOKEN_INVALID)
+            optr.reset(new Token(TOKEN_INVALID, std::string(lex.begin, lex.end)));
         return false;
     }
 
-    if (*src.it == '\n')
-    {
-        optr.reset(new Token(TOKEN_EOL, "\n"));
-        ++src.it;
-        return true;
-    }
-    if (*src.it == '\"')
+    switch (lex.type)
     {
-        CollectDelimited(src, out, '\"');
-        String *sp = new String(out);
-        optr.reset(sp);
-        return true;
-    }
-    if (*src.it == '\'')
-    {
-        CollectDelimited(src, out, '\'');
-        String *sp = new String(out);
-        optr.reset(sp);
-        return true;
-    }
-    if (*src.it == '[')
-    {
-        optr.reset(new Token(TOKEN_START_LIST, "["));
-        ++src.it;
-        return true;
-    }
-    if (*src.it == '{')
-    {
-        optr.reset(new Token(TOKEN_START_MAP, "{"));
-        ++src.it;
-        return true;
-    }
-    if (*src.it == ']')
-    {
-        optr.reset(new Token(TOKEN_END_LIST, "]"));
-        ++src.it;
-        return true;
-    }
-    if (*src.it == '}')
-    {
-        optr.reset(new Token(TOKEN_END_MAP, "}"));
-        ++src.it;
-        return true;
-    }
-    if (*src.it == '<')
-    {
-        ++src.it;
-        if (*src.it != '<')
-            throw std::runtime_error("Expected \'<\' in input");
-        optr.reset(new Token(TOKEN_START_PROGRAM, "<<"));
-        ++src.it;
-        return true;
-    }
-    if (*src.it == '>')
-    {
-        ++src.it;
-        if (*src.it != '>')
-            throw std::runtime_error("Expected \'>\' in input");
-        ++src.it;
-        optr.reset(new Token(TOKEN_END_PROGRAM, ">>"));
-        return true;
-    }
-    if (*src.it == '#')
-    {
-        src.it = src.line.end();
-        optr.reset(new Token(TOKEN_COMMENT, "#"));
-        return true;
-    }
-
-    if (CollectIdentifier(src, out))
-    {
-        if (out == "None")
-            optr.reset(new None());
-        else if (out == "EXIT")
-            optr.reset(new Token(TOKEN_EXIT, "EXIT"));
-        else if (out == "IF")
-            optr.reset(new Token(TOKEN_IF, "IF"));
-        else if (out == "THEN")
-            optr.reset(new Token(TOKEN_THEN, "THEN"));
-        else if (out == "ELSE")
-            optr.reset(new Token(TOKEN_ELSE, "ELSE"));
-        else if (out == "ENDIF")
-            optr.reset(new Token(TOKEN_ENDIF, "ENDIF"));
-        else if (out == "FOR")
-            optr.reset(new Token(TOKEN_FOR, "FOR"));
-        else if (out == "ENDFOR")
-            optr.reset(new Token(TOKEN_ENDFOR, "ENDFOR"));
-        else if (out == "WHILE")
-            optr.reset(new Token(TOKEN_WHILE, "WHILE"));
-        else if (out == "REPEAT")
-            optr.reset(new Token(TOKEN_REPEAT, "REPEAT"));
-        else if (out == "ENDWHILE")
-            optr.reset(new Token(TOKEN_ENDWHILE, "ENDWHILE"));
-        else if (out == "SHELL")
-            optr.reset(new Token(TOKEN_SHELL, "SHELL"));
-        else
-        {
-            auto it = machine.commands.find(out);
+    case TOKEN_STRING:
+        optr.reset(new String(lex.begin, lex.end));
+        break;
+    case TOKEN_INTEGER:
+        optr = MakeInteger(strtoll(lex.begin, nullptr, 10));
+        break;
+    case TOKEN_NONE:
+        optr = MakeNone();
+        break;
+    case TOKEN_COMMAND:
+        {
+            scratch.assign(lex.begin, lex.end);
+            auto it = machine.commands.find(scratch);
             if (it != machine.commands.end())
-            {
                 optr = it->second;
-                return true;
+            else
+            {
+                StringPtr sp(new String(scratch));
+                sp->word = true;
+                optr = sp;
             }
-            optr.reset(new String(out));
         }
-        return true;
-    }
-    if (CollectInteger(src, out))
-    {
-        optr.reset(new Integer(strtol(out.c_str(), nullptr, 10)));
-        return true;
+        break;
+    default:
+        optr = SharedToken(lex.type, lex.begin, lex.end);
+        break;
     }
-    std::string s;
-    s.push_back(*src.it);
-    optr.reset(new Token(TOKEN_INVALID, s));
-    ++src.it;
-    return false;
+    return true;
 }
 
 void RPNParser::ParseIf(Machine& machine, IfPtr& ifptr, Source& src)
@@ -591,17 +639,118 @@ void RPNParser::ParseProgram(Machine& machine, ProgramPtr& pptr, Source& src)
     }
 }
 
+// Read the next top level item. Lists, programs and control structures
+// are parsed whole. False at the end of the input.
+bool RPNParser::GetItem(Machine& machine, Source& src, ObjectPtr& optr)
+{
+    if (!GetObject(machine, src, optr))
+        return false;
+    if (optr->IsToken(TOKEN_START_LIST))
+    {
+        src.prompt = "[] ";
+        ListPtr lptr;
+        lptr.reset(new List());
+        ParseList(machine, lptr, src);
+        src.prompt = "> ";
+        optr = lptr;
+    }
+    else if (optr->IsToken(TOKEN_START_PROGRAM))
+    {
+        src.prompt = ">> ";
+        ProgramPtr pptr;
+        pptr.reset(new Program());
+        enclosingProgram = pptr;
+        ParseProgram(machine, pptr, src);
+        enclosingProgram.reset();
+        src.prompt = "> ";
+        optr = pptr;
+    }
+    else if (optr->IsToken(TOKEN_FOR))
+    {
+        src.prompt = "FOR: ";
+        ForPtr forptr;
+        forptr.reset(new For());
+        ParseFor(machine, forptr, src);
+        src.prompt = "> ";
+        optr = forptr;
+    }
+    else if (optr->IsToken(TOKEN_WHILE))
+    {
+        src.prompt = "WHILE: ";
+        WhilePtr whileptr;
+        whileptr.reset(new While());
+        ParseWhile(machine, whileptr, src);
+        src.prompt = "> ";
+        optr = whileptr;
+    }
+    else if (optr->IsToken(TOKEN_IF))
+    {
+        src.prompt = "IF: ";
+        IfPtr ifptr;
+        ifptr.reset(new If());
+        ParseIf(machine, ifptr, src);
+        src.prompt = "> ";
+        optr = ifptr;
+    }
+    return true;
+}
+
+// Run a top level item: commands and control structures are executed,
+// anything else is pushed on the stack
+void RPNParser::Dispatch(Machine& machine, ObjectPtr& optr, bool interactive)
+{
+    switch (optr->type)
+    {
+    case OBJECT_FOR:
+    case OBJECT_WHILE:
+    case OBJECT_IF:
+    case OBJECT_COMMAND:
+        try
+        {
+            Execute(machine, optr);
+        }
+        catch (std::exception& e)
+        {
+            std::cout << e.what() << std::endl;
+        }
+        break;
+    case OBJECT_TOKEN:
+        if (optr->IsToken(TOKEN_EOL))
+        {
+            if (interactive)
+            {
+                VIEW(machine, 4);
+            }
+        }
+        else
+            machine.push(optr);
+        break;
+    case OBJECT_STRING:
+        {
+            String *sp = (String *)optr.get();
+            if (sp->get()[0] == '&')
+            {
+                sp->set(sp->get().substr(1));
+            }
+            machine.push(optr);
+        }
+        break;
+    default:
+        machine.push(optr);
+        break;
+    }
+    bInterrupt = false;
+}
+
 void RPNParser::Parse(Machine& machine, Source& src, std::string& exit)
 {
     exit.clear();
     src.prompt = "> ";
-    while (!src.istrm.eof())
+    while (!src.iseof())
     {
         ObjectPtr optr;
-        while(GetObject(machine, src, optr))
+        while(GetItem(machine, src, optr))
         {
-            if (!optr)
-                continue;
             if (optr->IsToken(TOKEN_EXIT))
             {
                 return;
@@ -611,423 +760,112 @@ void RPNParser::Parse(Machine& machine, Source& src, std::string& exit)
                 exit = "shell";
                 return;
             }
-            if (optr->IsToken(TOKEN_START_LIST))
-            {
-                src.prompt = "[] ";
-                ListPtr lptr;
-                lptr.reset(new List());
-                ParseList(machine, lptr, src);
-                src.prompt = "> ";
-                optr = lptr;
-            }
-            if (optr->IsToken(TOKEN_START_PROGRAM))
-            {
-                src.prompt = ">> ";
-                ProgramPtr pptr;
-                pptr.reset(new Program());
-                enclosingProgram = pptr;
-                ParseProgram(machine, pptr, src);
-                enclosingProgram.reset();
-                src.prompt = "> ";
-                optr = pptr;
-            }
-
-            if (optr->IsToken(TOKEN_FOR))
-            {
-                src.prompt = "FOR: ";
-                ForPtr forptr;
-                forptr.reset(new For());
-                ParseFor(machine, forptr, src);
-                src.prompt = "> ";
-                try
-                {
-                    Execute(machine, forptr);
-                }
-                catch (std::exception& e)
-                {
-                    std::cout << e.what() << std::endl;
-                }
-            }
-            if (optr->IsToken(TOKEN_WHILE))
-            {
-                src.prompt = "WHILE: ";
-                WhilePtr whileptr;
-                whileptr.reset(new While());
-                ParseWhile(machine, whileptr, src);
-                src.prompt = "> ";
-                try
-                {
-                    Execute(machine, whileptr);
-                }
-                catch (std::exception& e)
-                {
-                    std::cout << e.what() << std::endl;
-                }
-            }
-
-            else if (optr->IsToken(TOKEN_IF))
-            {
-                src.prompt = "IF: ";
-                IfPtr ifptr;
-                ifptr.reset(new If());
-                ParseIf(machine, ifptr, src);
-                src.prompt = "> ";
-                try
-                {
-                    Execute(machine, ifptr);
-                }
-                catch (std::exception& e)
-                {
-                    std::cout << e.what() << std::endl;
-                }
-            }
-            else if (optr->type == OBJECT_COMMAND)
-            {
-                try
-                {
-                    Execute(machine, optr);
-                }
-                catch (std::exception& e)
-                {
-                    std::cout << e.what() << std::endl;
-                }
-            }
-            else if (optr->IsToken(TOKEN_EOL))
-            {
-                if (src.interactive )
-                {
-                    VIEW(machine, 4);
-                }
-            }
-            else if (optr->type == OBJECT_STRING)
-            {
-                String *sp = (String *)optr.get();
-                if (sp->get()[0] == '&')
-                {
-                    sp->set(sp->get().substr(1));
-                }
-                machine.push(optr);           
-            }
-            else if (optr->IsToken(TOKEN_COMMENT))
-            {
-                ;
-            }
-            else
-            {
-                machine.push(optr);           
-            }
-            bInterrupt = false;
+            if (bInterrupt)
+                record = nullptr;       // the item may be cut short
+            else if (record && !optr->IsToken(TOKEN_EOL) && !RecordItem(*record, optr))
+                record = nullptr;
+            Dispatch(machine, optr, src.interactive);
         }
     }
 }
 
-RPNParser::RPNParser(Machine& machine)
+// The builtin commands are registered once by the Machine
+RPNParser::RPNParser(Machine&)
+: record(nullptr)
 {
-    // Stack commands
-    AddCommand(machine, "CLRSTK", &CLRSTK);
-    Category(machine, "Stack", "CLRSTK");
-    AddCommand(machine, "DROP", &DROP);
-    Category(machine, "Stack", "DROP");
-    AddCommand(machine, "DROPN", &DROPN);
-    Category(machine, "Stack", "DROPN");
-    AddCommand(machine, "SWAP", &SWAP);
-    Category(machine, "Stack", "SWAP");
-    AddCommand(machine, "DUP", &DUP);
-    Category(machine, "Stack", "DUP");
-    AddCommand(machine, "PICK", &PICK);
-    Category(machine, "Stack", "PICK");
-    AddCommand(machine, "ROLL", &ROLL);
-    Category(machine, "Stack", "ROLL");
-    AddCommand(machine, "ROLLD", &ROLLD);
-    Category(machine, "Stack", "ROLLD");
-    AddCommand(machine, "DEPTH", &DEPTH);
-    Category(machine, "Stack", "DEPTH");
-    AddCommand(machine, "VIEW", &VIEW);
-    Category(machine, "Stack", "VIEW");
-
-    // Logical operators
-    AddCommand(machine, "EQ", &EQ);
-    Category(machine, "Logical", "EQ");
-    AddCommand(machine, "NEQ", &NEQ);
-    Category(machine, "Logical", "NEQ");
-    AddCommand(machine, "LT", &LT);
-    Category(machine, "Logical", "LT");
-    AddCommand(machine, "LTEQ", &LTEQ);
-    Category(machine, "Logical", "LTEQ");
-    AddCommand(machine, "GT", &GT);
-    Category(machine, "Logical", "GT");
-    AddCommand(machine, "GTEQ", &GTEQ);
-    Category(machine, "Logical", "GTEQ");
-    AddCommand(machine, "AND", &AND);
-    Category(machine, "Logical", "AND");
-    AddCommand(machine, "OR", &OR);
-    Category(machine, "Logical", "OR");
-    AddCommand(machine, "NOT", &NOT);
-    Category(machine, "Logical", "NOT");
-
-    // Variable commands
-    AddCommand(machine, "STO", &STO);
-    Category(machine, "Variable", "STO");
-    AddCommand(machine, "RCL", &RCL);
-    Category(machine, "Variable", "RCL");
-    AddCommand(machine, "STOL", &STOL);
-    Category(machine, "Variable", "STOL");
-    AddCommand(machine, "RCLL", &RCLL);
-    Category(machine, "Variable", "RCLL");
-    AddCommand(machine, "RCLA", &RCLA);
-    AddCommand(machine, "%", &RCLA);
-    Category(machine, "Variable", "RCLA");
-    AddCommand(machine, "VARNAMES", &VARNAMES);
-    Category(machine, "Variable", "VARNAMES");
-    AddCommand(machine, "VARS", &VARS);
-    Category(machine, "Variable", "VARS");
-    AddCommand(machine, "VARTYPES", &VARTYPES);
-    Category(machine, "Variable", "VARTYPES");
-    AddCommand(machine, "REGISTER", &REGISTER);
-    Category(machine, "Variable", "REGISTER");
-    AddCommand(machine, "UNREGISTER", &UNREGISTER);
-    Category(machine, "Variable", "UNREGISTER");
-
-    // Math commands
-    AddCommand(machine, "ADD", &ADD);
-    Category(machine, "Math", "ADD");
-    AddCommand(machine, "SUB", &SUB);
-    Category(machine, "Math", "SUB");
-    AddCommand(machine, "MUL", &MUL);
-    Category(machine, "Math", "MUL");
-    AddCommand(machine, "DIV", &DIV);
-    Category(machine, "Math", "DIV");
-    AddCommand(machine, "INC", &INC);
-    Category(machine, "Math", "INC");
-    AddCommand(machine, "DEC", &DEC);
-    Category(machine, "Math", "DEC");
-
-    // Control commands
-    AddCommand(machine, "IFT", &IFT);
-    Category(machine, "Control", "IFT");
-    AddCommand(machine, "IFTE", &IFTE);
-    Category(machine, "Control", "IFTE");
-    AddCommand(machine, "TRYCATCH", &TRYCATCH);
-    Category(machine, "Control", "TRYCATCH");
-
-    // List commands
-    AddCommand(machine, "GET", &GET);
-    Category(machine, "List", "GET");
-    AddCommand(machine, "SUBLIST", &SUBLIST);
-    Category(machine, "List", "SUBLIST");
-    AddCommand(machine, "APPEND", &APPEND);
-    Category(machine, "List", "APPEND");
-    AddCommand(machine, "ERASE", &ERASE);
-    Category(machine, "List", "ERASE");
-    AddCommand(machine, "CLEAR", &CLEAR);
-    Category(machine, "List", "CLEAR");
-    AddCommand(machine, "LINSERT", &LINSERT);
-    Category(machine, "List", "LINSERT");
-    AddCommand(machine, "INSERT", &INSERT);
-    AddCommand(machine, "SIZE", &SIZE);
-    Category(machine, "List", "SIZE");
-    AddCommand(machine, "FIRST", &FIRST);
-    Category(machine, "List", "FIRST");
-    AddCommand(machine, "SECOND", &SECOND);
-    Category(machine, "List", "SECOND");
-    AddCommand(machine, "TOLIST", &TOLIST);
-    Category(machine, "List", "TOLIST");
-    AddCommand(machine, "FROMLIST", &FROMLIST);
-    Category(machine, "List", "FROMLIST");
-    AddCommand(machine, "CREATELIST", &CREATELIST);
-    Category(machine, "List", "CREATELIST");
-    AddCommand(machine, "HEAD", &HEAD);
-    Category(machine, "List", "HEAD");
-    AddCommand(machine, "UNIQUE", &UNIQUE);
-    Category(machine, "List", "UNIQUE");
-    AddCommand(machine, "REVERSE", &REVERSE);
-    Category(machine, "List", "REVERSE");
-    AddCommand(machine, "ZIP", &ZIP);
-    Category(machine, "List", "ZIP");
-    AddCommand(machine, "UNZIP", &UNZIP);
-    Category(machine, "List", "UNZIP");
-
-    // Map commands
-    Category(machine, "Map", "ERASE");
-    Category(machine, "Map", "CLEAR");
-    AddCommand(machine, "MINSERT", &MINSERT);
-    Category(machine, "Map", "MINSERT");
-    Category(machine, "Map", "SIZE");
-    AddCommand(machine, "FIND", &FIND);
-    Category(machine, "Map", "FIND");
-    AddCommand(machine, "TOMAP", &TOMAP);
-    Category(machine, "Map", "TOMAP");
-    AddCommand(machine, "FROMMAP", &FROMMAP);
-    Category(machine, "Map", "FROMMAP");
-    AddCommand(machine, "CREATEMAP", &CREATEMAP);
-    Category(machine, "Map", "CREATEMAP");
-    AddCommand(machine, "KEYS", &KEYS);
-    Category(machine, "Map", "KEYS");
-    AddCommand(machine, "VALUES", &VALUES);
-    Category(machine, "Map", "VALUES");
-
-    // Functional
-    AddCommand(machine, "APPLY", &APPLY);
-    Category(machine, "Functional", "APPLY");
-    AddCommand(machine, "APPLY1", &APPLY1);
-    Category(machine, "Functional", "APPLY1");
-    AddCommand(machine, "FILTER", &FILTER);
-    Category(machine, "Functional", "FILTER");
-    AddCommand(machine, "FILTER1", &FILTER1);
-    Category(machine, "Functional", "FILTER1");
-    AddCommand(machine, "MAP", &MAP);
-    Category(machine, "Functional", "MAP");
-    AddCommand(machine, "MAP1", &MAP1);
-    Category(machine, "Functional", "MAP1");
-    AddCommand(machine, "REDUCE", &REDUCE);
-    Category(machine, "Functional", "REDUCE");
-
-    // Execution commands
-    AddCommand(machine, "EVAL", &EVAL);
-    Category(machine, "Execution", "EVAL");
-    AddCommand(machine, "CALL", &CALL);
-    AddCommand(machine, "()", &CALL);
-    Category(machine, "Execution", "CALL");
-    AddCommand(machine, "SYSTEM", &SYSTEM);
-    Category(machine, "Execution", "SYSTEM");
-    AddCommand(machine, "INTERRUPT", &INTERRUPT);
-    Category(machine, "Execution", "INTERRUPT");
-    AddCommand(machine, "ALIAS", &ALIAS);
-    Category(machine, "Execution", "ALIAS");
-
-
-    // Environment
-    AddCommand(machine, "NAMESPACES", &NAMESPACES);
-    Category(machine, "Environment", "NAMESPACES");
-    AddCommand(machine, "SETNS", &SETNS);
-    Category(machine, "Environment", "SETNS");
-    AddCommand(machine, "GETNS", &GETNS);
-    Category(machine, "Environment", "GETNS");
-    AddCommand(machine, "CD", &CD);
-    Category(machine, "Environment", "CD");
-    AddCommand(machine, "PWD", &PWD);
-    Category(machine, "Environment", "PWD");
-    AddCommand(machine, "HELP", &HELP);
-    Category(machine, "Environment", "HELP");
-    AddCommand(machine, "GETPROPERTY", &GETPROPERTY);
-    Category(machine, "Environment", "GETPROPERTY");
-    AddCommand(machine, "SETPROPERTY", &SETPROPERTY);
-    Category(machine, "Environment", "SETPROPERTY");
-    AddCommand(machine, "LISTPROPERTIES", &LISTPROPERTIES);
-    Category(machine, "Environment", "LISTPROPERTIES");
-    AddCommand(machine, "IMPORT", &IMPORT);
-    Category(machine, "Environment", "IMPORT");
-
-    // String
-    AddCommand(machine, "FORMAT", &FORMAT);
-    Category(machine, "String", "FORMAT");
-    AddCommand(machine, "CAT", &CAT);
-    Category(machine, "String", "CAT");
-    AddCommand(machine, "JOIN", &JOIN);
-    Category(machine, "String", "JOIN");
-    AddCommand(machine, "SUBSTR", &SUBSTR);
-    Category(machine, "String", "SUBSTR");
-    AddCommand(machine, "SUBSTRPOS", &SUBSTRPOS);
-    Category(machine, "String", "SUBSTRPOS");
-    AddCommand(machine, "STRFIND", &STRFIND);
-    Category(machine, "String", "STRFIND");
-    AddCommand(machine, "STRFINDEND", &STRFINDEND);
-    Category(machine, "String", "STRFINDEND");
-    AddCommand(machine, "STRCMP", &STRCMP);
-    Category(machine, "String", "STRCMP");
-    AddCommand(machine, "STRNCMP", &STRNCMP);
-    Category(machine, "String", "STRNCMP");
-    AddCommand(machine, "SPLIT", &SPLIT);
-    Category(machine, "String", "SPLIT");
-    Category(machine, "String", "SIZE");
-    AddCommand(machine, "STRBEGIN", &STRBEGIN);
-    Category(machine, "String", "STRBEGIN");
-    AddCommand(machine, "STREND", &STREND);
-    Category(machine, "String", "STREND");
-    AddCommand(machine, "STRHAS", &STRHAS);
-    Category(machine, "String", "STRHAS");
-    AddCommand(machine, "STRCSPN", &STRCSPN);
-    Category(machine, "String", "STRCSPN");
-    Category(machine, "String", "CLEAR");
-
-    // Types
-    AddCommand(machine, "TOINT", &TOINT);
-    Category(machine, "Types", "TOINT");
-    AddCommand(machine, "TOSTR", &TOSTR);
-    Category(machine, "Types", "TOSTR");
-    AddCommand(machine, "TYPE", &TYPE);
-    Category(machine, "Types", "TYPE");
-    AddCommand(machine, "CLONE",  &CLONE);
-    Category(machine, "Types", "CLONE");
-
-    // IO
-    AddCommand(machine, "PRINT", &PRINT);
-    Category(machine, "IO", "PRINT");
-    AddCommand(machine, "PROMPT", &PROMPT);
-    Category(machine, "IO", "PROMPT");
-    AddCommand(machine, "PREAD", &PREAD);
-    Category(machine, "IO", "PREAD");
-    AddCommand(machine, "FREAD", &FREAD);
-    Category(machine, "IO", "FREAD");
-    AddCommand(machine, "PWRITE", &PWRITE);
-    Category(machine, "IO", "PWRITE");
-    AddCommand(machine, "FWRITE", &FWRITE);
-    Category(machine, "IO", "FWRITE");
-    AddCommand(machine, "FSAVE", &FSAVE);
-    Category(machine, "IO", "FSAVE");
-    AddCommand(machine, "FRESTORE", &FRESTORE);
-    Category(machine, "IO", "FRESTORE");
 }
 
 /********************************************************/
 Source::Source(std::istream& is)
-:istrm(is)
-, it(line.end())
+: it(nullptr)
+, end(nullptr)
+, istrm(&is)
+, interactive(false)
+, lineno(0)
+{
+}
+
+Source::Source(std::string&& data)
+: buffer(std::move(data))
+, istrm(nullptr)
 , interactive(false)
 , lineno(0)
 {
+    if (buffer.empty() || buffer.back() != '\n')
+        buffer.push_back('\n');
+    it = buffer.data();
+    end = buffer.data() + buffer.size();
 }
 
 bool Source::iseof()
 {
-    return istrm.eof();
+    if (istrm)
+        return istrm->eof();
+    return it == end;
+}
+
+// Skip the rest of the current line, including the '\n'
+void Source::SkipLine()
+{
+    if (istrm)
+    {
+        it = end;
+        return;
+    }
+    const char *p = (const char *)memchr(it, '\n', end - it);
+    it = p ? p + 1 : end;
+}
+
+// The next whole line, including the '\n'
+void Source::GetLine(std::string& out)
+{
+    if (istrm)
+    {
+        it = end;
+        Read();
+        out.assign(it, end);
+        it = end;
+        return;
+    }
+    const char *p = it;
+    SkipLine();
+    out.assign(p, it);
 }
 
 void Source::Read()
 {
+    if (istrm == nullptr)
+        return;
     if (interactive)
     {
-        if (it == line.end())
+        if (it == end)
         {
             char *pLine = readline(prompt.c_str());
             add_history(pLine);
-            line = pLine;
+            buffer = pLine;
             free(pLine);
-            line += "\n";
+            buffer += "\n";
             ++lineno;
-            it = line.begin();
+            it = buffer.data();
+            end = buffer.data() + buffer.size();
         }
     }
     else
     {
-        if (istrm.eof())
+        if (istrm->eof())
         {
-            it = line.end();
+            it = end;
             return;
         }
-        if (it == line.end())
+        if (it == end)
         {
-            if (interactive)
-            {
-                std::cout << prompt << std::flush;
-            }
-            getline(istrm, line);
-            line += "\n";
+            getline(*istrm, buffer);
+            buffer += "\n";
             ++lineno;
-            it = line.begin();
+            it = buffer.data();
+            end = buffer.data() + buffer.size();
         }
     }
 }
 
 } // namespace rps
-
@@ -0,0 +1,106 @@
+#include <cstring>
+#include "search.h"
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace rps
+{
+
+const char *Finder::Find(const char *p, const char *end) const
+{
+    const size_t n = needle_.size();
+    if (n == 0)
+        return p;
+    if ((size_t)(end - p) < n)
+        return nullptr;
+    const char *needle = needle_.data();
+    if (n == 1)
+        return (const char *)memchr(p, needle[0], end - p);
+#ifdef __SSE2__
+    // the last position a match can start at is stop - 1
+    const char *stop = end - n + 1;
+    const __m128i first = _mm_set1_epi8(needle[0]);
+    const __m128i last = _mm_set1_epi8(needle[n - 1]);
+    for (; p + 16 <= stop; p += 16)
+    {
+        __m128i bf = _mm_loadu_si128((const __m128i *)p);
+        __m128i bl = _mm_loadu_si128((const __m128i *)(p + n - 1));
+        unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(first, bf),
+                                                        _mm_cmpeq_epi8(last, bl)));
+        while (mask)
+        {
+            int bit = __builtin_ctz(mask);
+            if (memcmp(p + bit + 1, needle + 1, n - 2) == 0)
+                return p + bit;
+            mask &= mask - 1;
+        }
+    }
+    while (p < stop)
+    {
+        p = (const char *)memchr(p, needle[0], stop - p);
+        if (p == nullptr)
+            return nullptr;
+        if (memcmp(p + 1, needle + 1, n - 1) == 0)
+            return p;
+        ++p;
+    }
+    return nullptr;
+#else
+    return (const char *)memmem(p, end - p, needle, n);
+#endif
+}
+
+ByteSet::ByteSet(const std::string& bytes)
+{
+    memset(table_, 0, sizeof(table_));
+    for (char ch : bytes)
+    {
+        if (!table_[(unsigned char)ch])
+            bytes_.push_back(ch);
+        table_[(unsigned char)ch] = true;
+    }
+}
+
+const char *ByteSet::Find(const char *p, const char *end) const
+{
+    const size_t n = bytes_.size();
+    if (n == 0)
+        return end;
+    if (n == 1)
+    {
+        const char *m = (const char *)memchr(p, bytes_[0], end - p);
+        return m ? m : end;
+    }
+#ifdef __SSE2__
+    if (n <= SIMD_BYTES)
+    {
+        __m128i set[SIMD_BYTES];
+        for (size_t i = 0; i < SIMD_BYTES; ++i)
+            set[i] = _mm_set1_epi8(bytes_[i < n ? i : 0]);
+        for (; p + 16 <= end; p += 16)
+        {
+            __m128i b = _mm_loadu_si128((const __m128i *)p);
+            __m128i eq = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(b, set[0]),
+                                                   _mm_cmpeq_epi8(b, set[1])),
+                                      _mm_or_si128(_mm_cmpeq_epi8(b, set[2]),
+                                                   _mm_cmpeq_epi8(b, set[3])));
+            unsigned mask = _mm_movemask_epi8(eq);
+            if (mask)
+                return p + __builtin_ctz(mask);
+        }
+    }
+#endif
+    while (p < end && !table_[(unsigned char)*p])
+        ++p;
+    return p;
+}
+
+const char *ByteSet::Skip(const char *p, const char *end) const
+{
+    while (p < end && table_[(unsigned char)*p])
+        ++p;
+    return p;
+}
+
+} // namespace rps
@@ -0,0 +1,50 @@
+#pragma once
+#include <string>
+
+namespace rps
+{
+
+/*
+ * Fixed string search. Candidates are found 16 bytes at a time by
+ * comparing the first and last byte of the needle with SSE2, and only
+ * those are compared in full. Falls back to memmem without SSE2.
+ */
+class Finder
+{
+public:
+    explicit Finder(const std::string& needle) : needle_(needle) {}
+
+    // The first occurrence of the needle in [begin, end), nullptr if none
+    const char *Find(const char *begin, const char *end) const;
+
+    size_t size() const { return needle_.size(); }
+
+private:
+    std::string needle_;
+};
+
+/*
+ * A set of bytes, such as the delimiters of SPLIT, held as a 256 entry
+ * table. With SSE2 and at most SIMD_BYTES distinct bytes, Find compares
+ * 16 bytes at a time against each of them.
+ */
+class ByteSet
+{
+public:
+    explicit ByteSet(const std::string& bytes);
+
+    // The first byte of [begin, end) in the set, end if there is none
+    const char *Find(const char *begin, const char *end) const;
+    // The first byte of [begin, end) not in the set, end if there is none
+    const char *Skip(const char *begin, const char *end) const;
+
+    bool test(unsigned char ch) const { return table_[ch]; }
+
+private:
+    static const size_t SIMD_BYTES = 4;
+
+    bool table_[256];
+    std::string bytes_;     // each byte of the set once
+};
+
+} // namespace rps
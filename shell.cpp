@@ -312,7 +312,7 @@ namespace rps
                         //std::cout << "=== cmd[" << n << "]: " << cmd.args[n] << std::endl;
                         argv[n] = cmd.args[n].c_str();
                     }
-                    argv[cmd.args.size()] = '\0';
+                    argv[cmd.args.size()] = nullptr;
                     const char *cmdname = strrchr(argv[0], '/');
                     if (cmdname == nullptr)
                         cmdname = argv[0];
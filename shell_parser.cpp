@@ -14,18 +14,19 @@
 #include "commands.h"
 #include "utilities.h"
 #include "shell.h"
+#include "module_cache.h"
 
 namespace rps
 {
 
-std::string word(Source& src)
+std::string word(const std::string& line)
 {
     std::string s;
-    auto it = src.it;
-    while (*it == ' ') 
+    auto it = line.begin();
+    while (it != line.end() && *it == ' ')
         ++it;
 
-    while (*it != ' ' && *it != '\n') 
+    while (it != line.end() && *it != ' ' && *it != '\n')
     {
         s.push_back(*it);
         ++it;
@@ -34,6 +35,7 @@ std::string word(Source& src)
 }
 
 ShellParser::ShellParser(Machine&)
+: record(nullptr)
 {
 }
 
@@ -42,12 +44,11 @@ void ShellParser::Parse(Machine& machine, Source& src, std::string& status)
     std::string savePrompt = src.prompt;
     src.prompt = "$ ";
     status.clear();
-    while (!src.istrm.eof())
+    std::string line;
+    while (!src.iseof())
     {
-        src.it = src.line.end();
-        src.Read();
-        std::string w = word(src);
-        src.it = src.line.end();
+        src.GetLine(line);
+        std::string w = word(line);
         if (w == "rpn")
         {
             status = "rpn";
@@ -58,7 +59,9 @@ void ShellParser::Parse(Machine& machine, Source& src, std::string& status)
             status.clear();
             return;
         }
-        Parse(machine, src.line);
+        if (record)
+            RecordShellLine(*record, line);
+        Parse(machine, line);
     }
     src.prompt = savePrompt;
 }
@@ -103,15 +106,10 @@ void ShellParser::Parse(Machine& machine, const std::string& commandLine)
             else 
             {
                 ObjectPtr optr;
-                try 
-                {
-                    RCL(machine, spec, optr);
+                if (FindGlobal(machine, spec, optr))
                     strm << ToStr(machine, optr);
-                }
-                catch(std::exception&)
-                {
+                else
                     strm << spec;
-                }
             }
             word += strm.str();
             //std::cout << "=== word: " << word <<std::endl;
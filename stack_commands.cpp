@@ -16,26 +16,12 @@ namespace rps
 
 void DROP(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "DROP: Pop the item at L0";
-        machine.helpstrm() << "obj DROP => ";
-        return;
-    }
-
     stack_required(machine, "DROP", 1);
     machine.pop();
 }
 
 void DROPN(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "DROPN: Pop n items from the stack";
-        machine.helpstrm() << "obj1 obj2 obj3... nitems DROPN =>";
-        return;
-    }
-
     stack_required(machine, "DROPN", 1);
 
     int64_t n;
@@ -47,13 +33,6 @@ void DROPN(Machine& machine)
 
 void SWAP(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "SWAP: Swap the top two objects on the stack";
-        machine.helpstrm() << "obj1 obj2 SWAP => obj2 obj1";
-        return;
-    }
-
     stack_required(machine, "SWAP", 2);
 
     ObjectPtr o1, o2;
@@ -65,13 +44,6 @@ void SWAP(Machine& machine)
 
 void DUP(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "DUP: Duplicate the toptwo objects on the stack";
-        machine.helpstrm() << "obj DUP => obj obj";
-        return;
-    }
-
     stack_required(machine, "DUP", 1);
 
     ObjectPtr optr = machine.peek(0);
@@ -80,13 +52,6 @@ void DUP(Machine& machine)
 
 void PICK(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "PICK: Copy the nth item from the stack and copy to L0";
-        machine.helpstrm() << "obj1 obj2 level PICK => obj";
-        return;
-    }
-
     int64_t level;
     machine.pop(level);
 
@@ -98,13 +63,6 @@ void PICK(Machine& machine)
 
 void ROLL(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "ROLL: Move the nth item from the stack to L0";
-        machine.helpstrm() << "obj1 obj2 obj3... nitem ROLL => obj2 obj3 obj1";
-        return;
-    }
-
     int64_t level;
     machine.pop(level);
 
@@ -118,13 +76,6 @@ void ROLL(Machine& machine)
 
 void ROLLD(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "ROLLD: Move L0 item from the stack to nth level";
-        machine.helpstrm() << "obj1 obj2 obj3... nitem ROLLD => obj3 obj2 obj1";
-        return;
-    }
-
     int64_t level;
     machine.pop(level);
     ObjectPtr optr;
@@ -154,37 +105,16 @@ void VIEW(Machine& machine, size_t depth)
 
 void VIEW(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "VIEW: View the items in the stack";
-        machine.helpstrm() << "obj1 obj2... VIEW => obj1 obj2...";
-        return;
-    }
-
     VIEW(machine, 20);
 }
 
 void CLRSTK(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "CLRSTK: Clear the stack";
-        machine.helpstrm() << "obj1 obj2 obj3... CLRSTK =>";
-        return;
-    }
-
     machine.stack_.clear();
 }
 
 void DEPTH(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "DEPTH: Pushes the number of items on the stack";
-        machine.helpstrm() << "obj1 obj2 ob3... DEPTH => obj1 obj2 obj3... int";
-        return;
-    }
-
     machine.push(machine.stack_.size());
 }
 
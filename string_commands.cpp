@@ -11,20 +11,15 @@
 #include "machine.h"
 #include "commands.h"
 #include "utilities.h"
+#include "search.h"
+#include "regex.h"
+#include "fields.h"
 
 namespace rps
 {
 
 void FORMAT(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "FORMAT: Format a string";
-        machine.helpstrm() << "\"str\" FORMAT => \"str\"";
-        machine.helpstrm() << "todo: Format description...";
-        return;
-    }
-
     stack_required(machine, "FORMAT", 1);
     throw_required(machine, "FORMAT", 0, OBJECT_STRING);
 
@@ -73,23 +68,10 @@ std::string FORMAT(Machine& machine, const std::string& fmt)
             else 
             {
                 ObjectPtr optr;
-                try
-                {
-                    RCLL(machine, spec, optr);
+                if (FindLocal(machine, spec, optr) || FindGlobal(machine, spec, optr))
                     strm << ToStr(machine, optr);
-                }
-                catch(std::exception&)
-                {
-                    try 
-                    {
-                        RCL(machine, spec, optr);
-                        strm << ToStr(machine, optr);
-                    }
-                    catch(std::exception&)
-                    {
-                        strm << spec;
-                    }
-                }
+                else
+                    strm << spec;
             }
         }
         else
@@ -103,13 +85,6 @@ std::string FORMAT(Machine& machine, const std::string& fmt)
 
 void CAT(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "CAT: Concatenate two strings";
-        machine.helpstrm() << "\"str1\" \"str2\" CAT => \"str1str2\"";
-        return;
-    }
-
     stack_required(machine, "CAT", 2);
     throw_required(machine, "CAT", 0, OBJECT_STRING);
     throw_required(machine, "CAT", 1, OBJECT_STRING);
@@ -122,14 +97,6 @@ void CAT(Machine& machine)
 
 void JOIN(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "JOIN: Joins a list into a string";
-        machine.helpstrm() << "[list] \"delim\" JOIN =>\"str\"";
-        machine.helpstrm() << "delim: The string to join with";
-        return;
-    }
-
     stack_required(machine, "JOIN", 2);
     throw_required(machine, "JOIN", 1, OBJECT_LIST);
     throw_required(machine, "JOIN", 0, OBJECT_STRING);
@@ -138,28 +105,38 @@ void JOIN(Machine& machine)
     ListPtr lp;
     machine.pop(delim);
     machine.pop(lp);
-    std::stringstream strm;
-    void *last = lp->items.back().get();
-    for (ObjectPtr op : lp->items)
+
+    // work out the size first so the result is allocated once, only
+    // the items that are not strings need converting
+    std::vector<ObjectPtr>& items = lp->items;
+    std::vector<std::string> texts(items.size());
+    size_t size = items.empty() ? 0 : delim.size() * (items.size() - 1);
+    for (size_t i = 0; i < items.size(); ++i)
     {
-        std::string s = ToStr(machine, op);
-        strm << s;
-        if (op.get() != last)
-            strm << delim;
+        if (items[i]->type == OBJECT_STRING)
+            size += ((String *)items[i].get())->get().size();
+        else
+        {
+            texts[i] = ToStr(machine, items[i]);
+            size += texts[i].size();
+        }
     }
-    machine.push(strm.str());
+    std::string result;
+    result.reserve(size);
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        if (i)
+            result += delim;
+        if (items[i]->type == OBJECT_STRING)
+            result += ((String *)items[i].get())->get();
+        else
+            result += texts[i];
+    }
+    machine.push(result);
 }
 
 void SUBSTR(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "SUBSTR: Return substring given startpos and length";
-        machine.helpstrm() << "\"str\" startpos length SUBSTR => \"str\"";
-        machine.helpstrm() << "If length is <= 0, return substr to end of string";
-        return;
-    }
-
     stack_required(machine, "SUBSTR", 3);
     throw_required(machine, "SUBSTR", 0, OBJECT_INTEGER);
     throw_required(machine, "SUBSTR", 1, OBJECT_INTEGER);
@@ -179,14 +156,6 @@ void SUBSTR(Machine& machine)
 
 void SUBSTRPOS(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "SUBSTRPOS: Return substr given startpos and endpos";
-        machine.helpstrm() << "\"str\" startpos endpos SUBSTRPOS => \"str\"";
-        machine.helpstrm() << "If endpos is <= startpos, return substr to end of string";
-        return;
-    }
-
     stack_required(machine, "SUBSTRPOS", 3);
     throw_required(machine, "SUBSTRPOS", 0, OBJECT_INTEGER);
     throw_required(machine, "SUBSTRPOS", 1, OBJECT_INTEGER);
@@ -207,13 +176,6 @@ void SUBSTRPOS(Machine& machine)
 
 void STRBEGIN(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "STRBEGIN: Does string begin with the given str";
-        machine.helpstrm() << "\"str\" \"str\" STRBEGIN => int";
-        return;
-    }
-
     stack_required(machine, "STRBEGIN", 2);
     throw_required(machine, "STRBEGIN", 0, OBJECT_STRING);
     throw_required(machine, "STRBEGIN", 1, OBJECT_STRING);
@@ -235,13 +197,6 @@ void STRBEGIN(Machine& machine)
 
 void STREND(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "STREND: Does string end with the given str";
-        machine.helpstrm() << "\"str\" \"str\" STREND => int";
-        return;
-    }
-
     stack_required(machine, "STREND", 2);
     throw_required(machine, "STREND", 0, OBJECT_STRING);
     throw_required(machine, "STREND", 1, OBJECT_STRING);
@@ -262,42 +217,33 @@ void STREND(Machine& machine)
         machine.push(0);
 }
 
-void STRHAS(Machine& machine)
+// The position of find_str in str at or after startpos, -1 if it is not there
+int64_t FindString(const std::string& str, int64_t startpos, const std::string& find_str)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "STRHAS: Does string contain the given str";
-        machine.helpstrm() << "\"str\" \"str\" STRHAS => int";
-        return;
-    }
+    if (startpos < 0 || (size_t)startpos > str.size())
+        return -1;
+    Finder finder(find_str);
+    const char *pos = finder.Find(str.data() + startpos, str.data() + str.size());
+    return pos ? pos - str.data() : -1;
+}
 
+void STRHAS(Machine& machine)
+{
     stack_required(machine, "STRHAS", 2);
     throw_required(machine, "STRHAS", 0, OBJECT_STRING);
     throw_required(machine, "STRHAS", 1, OBJECT_STRING);
 
-    std::string str;
     std::string find_str;
+    ObjectPtr optr;
     machine.pop(find_str);
-    machine.pop(str);
-
-    size_t pos = str.find(find_str, 0);
-    if (pos == std::string::npos)
-        machine.push(0);
-    else
-        machine.push(1);
+    machine.pop(optr);
 
+    const std::string& str = ((String *)optr.get())->get();
+    machine.push(FindString(str, 0, find_str) >= 0 ? 1 : 0);
 }
 
 void STRFIND(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "STRFIND: Find a string";
-        machine.helpstrm() << "\"str\" startpos \"str to find\" STRFIND => pos";
-        machine.helpstrm() << "Pushes -1 if the string is not found";
-        return;
-    }
-
     stack_required(machine, "STRFIND", 3);
     throw_required(machine, "STRFIND", 0, OBJECT_STRING);
     throw_required(machine, "STRFIND", 1, OBJECT_INTEGER);
@@ -305,29 +251,17 @@ void STRFIND(Machine& machine)
 
     int64_t startpos;
     std::string find_str;
-    std::string str;
+    ObjectPtr optr;
     machine.pop(find_str);
     machine.pop(startpos);
-    machine.pop(str);
+    machine.pop(optr);
 
-    size_t pos = str.find(find_str, startpos);
-    if (pos == std::string::npos)
-        machine.push(-1);
-    else
-        machine.push(pos);
+    const std::string& str = ((String *)optr.get())->get();
+    machine.push(FindString(str, startpos, find_str));
 }
 
 void STRFINDEND(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "STRFINDEND: Find the end of a string";
-        machine.helpstrm() << "\"str\" startpos \"str to find\" STRFINDEND => pos";
-        machine.helpstrm() << "Pushes -1 if the string is not found";
-        machine.helpstrm() << "This function returns the position of the end of the found string";
-        return;
-    }
-
     stack_required(machine, "STRFINDEND", 3);
     throw_required(machine, "STRFINDEND", 0, OBJECT_STRING);
     throw_required(machine, "STRFINDEND", 1, OBJECT_INTEGER);
@@ -335,28 +269,21 @@ void STRFINDEND(Machine& machine)
 
     int64_t startpos;
     std::string find_str;
-    std::string str;
+    ObjectPtr optr;
     machine.pop(find_str);
     machine.pop(startpos);
-    machine.pop(str);
+    machine.pop(optr);
 
-    size_t pos = str.find(find_str, startpos);
-    if (pos == std::string::npos)
+    const std::string& str = ((String *)optr.get())->get();
+    int64_t pos = FindString(str, startpos, find_str);
+    if (pos < 0)
         machine.push(-1);
     else
-        machine.push(pos+find_str.size());
+        machine.push(pos + find_str.size());
 }
 
 void STRCMP(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "STRCMP: Compare two strings";
-        machine.helpstrm() << "\"str1\" \"str2\" STRCMP => int";
-        machine.helpstrm() << "Pushes <0, 0 or >0";
-        return;
-    }
-
     stack_required(machine, "STRCMP", 2);
     throw_required(machine, "STRCMP", 0, OBJECT_STRING);
     throw_required(machine, "STRCMP", 1, OBJECT_STRING);
@@ -371,14 +298,6 @@ void STRCMP(Machine& machine)
 
 void STRNCMP(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "STRNCMP: Compare two strings for the given length";
-        machine.helpstrm() << "\"str1\" \"str2\" length STRNCMP => int";
-        machine.helpstrm() << "Pushes <0, 0 or >0";
-        return;
-    }
-
     stack_required(machine, "STRNCMP", 3);
     throw_required(machine, "STRNCMP", 0, OBJECT_INTEGER);
     throw_required(machine, "STRNCMP", 1, OBJECT_STRING);
@@ -394,22 +313,30 @@ void STRNCMP(Machine& machine)
     machine.push(n);
 }
 
-void SPLIT(Machine& machine)
+// The text of the String optr, and the file it is a slice of if it is one
+void GetText(const ObjectPtr& optr, const char *& begin, const char *& end, MappedFilePtr& file)
 {
-    if (machine.GetProperty("help", 0))
+    String *str = (String *)optr.get();
+    if (!str->Slice(begin, end, file))
     {
-        machine.helpstrm() << "SPLIT: Split a string";
-        machine.helpstrm() << "\"str\" \"delim\" opts SPLIT => [list]";
-        machine.helpstrm() << "delims: Set of delimiter chars to split with";
-        machine.helpstrm() << "opts: Optional arguments";
-        machine.helpstrm() << "     --collapse: Merge empty strings";
-        machine.helpstrm() << "     --n: Max number of splits";
-        return;
+        begin = str->get().data();
+        end = begin + str->get().size();
     }
+}
+
+// A field of a string split by SPLIT, a slice of file if there is one
+ObjectPtr MakeField(const char *begin, const char *end, const MappedFilePtr& file)
+{
+    if (file)
+        return ObjectPtr(new String(begin, end, file));
+    return ObjectPtr(new String(begin, end));
+}
 
+void SPLIT(Machine& machine)
+{
     stack_required(machine, "SPLIT", 2);
 
-    std::string str,  delims;
+    std::string delims;
     ListPtr result = MakeList();
     bool bCollapse(false);
     int max = 10000;
@@ -429,74 +356,448 @@ void SPLIT(Machine& machine)
     }
     throw_required(machine, "SPLIT", 0, OBJECT_STRING); // delim
     throw_required(machine, "SPLIT", 1, OBJECT_STRING); // string to split
+    ObjectPtr optr;
     machine.pop(delims);
-    machine.pop(str);
-    std::string s;
+    machine.pop(optr);
+
+    // the fields of a line read by FREAD stay slices of its file
+    const char *begin;
+    const char *end;
+    MappedFilePtr file;
+    GetText(optr, begin, end, file);
+
+    ByteSet delimset(delims);
     int nmatch = 0;
-    for (auto it = str.begin(); it != str.end(); ++it)
+    const char *p = begin;
+    for (;;)
     {
-        if (delims.find_first_of(*it) != std::string::npos)
+        const char *delim = delimset.Find(p, end);
+        if (delim == end)
         {
-            StringPtr sp = MakeString();
-            sp->set(s);
-            result->items.push_back(sp);
-            s = "";
-            ++nmatch;
-            if (nmatch == max)
-            {
-                StringPtr sp = MakeString();
-                ++it;
-                sp->set(&*it);
-                result->items.push_back(sp);
-                break;
-            }
-            if (bCollapse)
-            {
-                while (delims.find_first_of(*it) != std::string::npos)
-                    ++it;
-                --it;
-            }
+            if (p < end)
+                result->items.push_back(MakeField(p, end, file));
+            break;
         }
-        else
+        result->items.push_back(MakeField(p, delim, file));
+        p = delim + 1;
+        ++nmatch;
+        if (nmatch == max)
         {
-            s.push_back(*it);
+            result->items.push_back(MakeField(p, end, file));
+            break;
         }
+        if (bCollapse)
+            p = delimset.Skip(p, end);
     }
-    if (s.size())
-    {
-        StringPtr sp = MakeString();
-        sp->set(s);
-        result->items.push_back(sp);
-    }
-    ObjectPtr optr = result;
-    machine.push(optr);
+    machine.push(result);
 }
 
 void STRCSPN(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "STRCSPN: Returns pos of delimiter";
-        machine.helpstrm() << "\"str\" startpos \"delims\" STRCSPN => int";
-        return;
-    }
     stack_required(machine, "STRCSPN", 3);
     throw_required(machine, "STRCSPN", 0, OBJECT_STRING);
     throw_required(machine, "STRCSPN", 1, OBJECT_INTEGER);
     throw_required(machine, "STRCSPN", 2, OBJECT_STRING);
 
     std::string delims;
-    std::string str;
+    ObjectPtr optr;
     int64_t startpos;
     machine.pop(delims);
     machine.pop(startpos);
-    machine.pop(str);
+    machine.pop(optr);
+    const std::string& str = ((String *)optr.get())->get();
     if (startpos >= str.size())
          throw std::runtime_error("STRCSPN: startpos out of range");
-    int64_t pos = strcspn(str.c_str()+startpos, delims.c_str());
+    const char *begin = str.data() + startpos;
+    ByteSet delimset(delims);
+    int64_t pos = delimset.Find(begin, str.data() + str.size()) - begin;
     machine.push(pos);
 }
 
+// Compile the pattern at level before anything is popped, so a bad
+// pattern leaves the stack as it was
+RegexPtr PeekRegex(Machine& machine, size_t level)
+{
+    return GetRegex(machine, ((String *)machine.peek(level).get())->get());
+}
 
-} // namespace rps
+void RMATCH(Machine& machine)
+{
+    stack_required(machine, "RMATCH", 2);
+    throw_required(machine, "RMATCH", 0, OBJECT_STRING);
+    throw_required(machine, "RMATCH", 1, OBJECT_STRING);
+
+    RegexPtr re = PeekRegex(machine, 0);
+    ObjectPtr optr;
+    machine.pop();
+    machine.pop(optr);
+    const std::string& str = ((String *)optr.get())->get();
+    machine.push(re->Search(str.data(), str.data() + str.size()) ? 1 : 0);
+}
 
+void RSEARCH(Machine& machine)
+{
+    stack_required(machine, "RSEARCH", 3);
+    throw_required(machine, "RSEARCH", 0, OBJECT_STRING);
+    throw_required(machine, "RSEARCH", 1, OBJECT_INTEGER);
+    throw_required(machine, "RSEARCH", 2, OBJECT_STRING);
+
+    RegexPtr re = PeekRegex(machine, 0);
+    int64_t startpos;
+    ObjectPtr optr;
+    machine.pop();
+    machine.pop(startpos);
+    machine.pop(optr);
+    const std::string& str = ((String *)optr.get())->get();
+    if (startpos < 0 || startpos > (int64_t)str.size())
+        throw std::runtime_error("RSEARCH: startpos out of range");
+    std::vector<const char *> caps;
+    const char *begin = str.data();
+    if (re->Search(begin, begin + str.size(), begin + startpos, caps))
+        machine.push(caps[0] - begin);
+    else
+        machine.push(-1);
+}
+
+void RREPLACE(Machine& machine)
+{
+    stack_required(machine, "RREPLACE", 3);
+    throw_required(machine, "RREPLACE", 0, OBJECT_STRING);
+    throw_required(machine, "RREPLACE", 1, OBJECT_STRING);
+    throw_required(machine, "RREPLACE", 2, OBJECT_STRING);
+
+    RegexPtr re = PeekRegex(machine, 1);
+    std::string replacement;
+    ObjectPtr optr;
+    machine.pop(replacement);
+    machine.pop();
+    machine.pop(optr);
+    const std::string& str = ((String *)optr.get())->get();
+
+    std::string result;
+    std::vector<const char *> caps;
+    const char *begin = str.data();
+    const char *end = begin + str.size();
+    const char *pos = begin;
+    while (pos <= end && re->Search(begin, end, pos, caps))
+    {
+        result.append(pos, caps[0]);
+        // \0 is the match and \1 to \9 the groups
+        for (size_t i = 0; i < replacement.size(); ++i)
+        {
+            char ch = replacement[i];
+            if (ch == '\\' && i + 1 < replacement.size())
+            {
+                ch = replacement[++i];
+                size_t group = ch - '0';
+                if (isdigit((unsigned char)ch) && group <= re->groups())
+                {
+                    if (caps[2*group])
+                        result.append(caps[2*group], caps[2*group+1]);
+                    continue;
+                }
+            }
+            result.push_back(ch);
+        }
+        if (caps[1] == caps[0])
+        {
+            // step over an empty match
+            if (caps[0] != end)
+                result.push_back(*caps[0]);
+            pos = caps[0] + 1;
+        }
+        else
+            pos = caps[1];
+    }
+    if (pos < end)
+        result.append(pos, end);
+    machine.push(result);
+}
+
+void RCAPTURE(Machine& machine)
+{
+    stack_required(machine, "RCAPTURE", 2);
+    throw_required(machine, "RCAPTURE", 0, OBJECT_STRING);
+    throw_required(machine, "RCAPTURE", 1, OBJECT_STRING);
+
+    RegexPtr re = PeekRegex(machine, 0);
+    ObjectPtr optr;
+    machine.pop();
+    machine.pop(optr);
+    const std::string& str = ((String *)optr.get())->get();
+
+    ListPtr result = MakeList();
+    std::vector<const char *> caps;
+    if (re->Search(str.data(), str.data() + str.size(), str.data(), caps))
+    {
+        for (size_t i = 0; i < caps.size(); i += 2)
+        {
+            if (caps[i])
+                result->items.push_back(ObjectPtr(new String(caps[i], caps[i+1])));
+            else
+                result->items.push_back(ObjectPtr(new String("")));
+        }
+    }
+    machine.push(result);
+}
+
+// Add a field to a record parsed by PBPARSE or KVPARSE. A name seen more
+// than once is a repeated field, its values are gathered into a List.
+void AddField(Map& map, ObjectPtr& key, ObjectPtr value)
+{
+    auto inserted = map.items.emplace(key, value);
+    if (inserted.second)
+        return;
+    ObjectPtr& slot = inserted.first->second;
+    if (slot->type != OBJECT_LIST)
+    {
+        ListPtr lp = MakeList();
+        lp->items.push_back(slot);
+        slot = lp;
+    }
+    ((List *)slot.get())->items.push_back(value);
+}
+
+ObjectPtr PbValue(const PbReader& reader, const MappedFilePtr& file)
+{
+    if (reader.quoted())
+        return ObjectPtr(new String(reader.value()));
+    return MakeField(reader.value_begin(), reader.value_end(), file);
+}
+
+ObjectPtr KvValue(const KvReader& reader, const MappedFilePtr& file)
+{
+    if (reader.quoted())
+        return ObjectPtr(new String(reader.value()));
+    return MakeField(reader.value_begin(), reader.value_end(), file);
+}
+
+// The separators of KVPARSE and KVFIELDS, --sep=chars or blanks. Only
+// --sep= strings above the other arguments are taken, a record can start
+// with -- too.
+std::string KvSeparators(Machine& machine, size_t required)
+{
+    std::string seps(" \t\r\n");
+    while (machine.stack_.size() > required && machine.peek(0)->type == OBJECT_STRING)
+    {
+        const std::string& arg = ((String *)machine.peek(0).get())->get();
+        if (arg.compare(0, 6, "--sep=") != 0)
+            break;
+        if (arg.size() > 6)
+            seps = arg.substr(6);
+        machine.pop();
+    }
+    return seps;
+}
+
+void PBPARSE(Machine& machine)
+{
+    stack_required(machine, "PBPARSE", 1);
+    throw_required(machine, "PBPARSE", 0, OBJECT_STRING);
+
+    // the string stays on the stack if it does not parse
+    ObjectPtr optr = machine.peek(0);
+    const char *begin;
+    const char *end;
+    MappedFilePtr file;
+    GetText(optr, begin, end, file);
+
+    TrimKeys(machine);
+    PbReader reader("PBPARSE", begin, end);
+    MapPtr result = MakeMap();
+    std::vector<Map *> maps(1, result.get());
+    for (;;)
+    {
+        PbReader::Event event = reader.Next();
+        if (event == PbReader::PB_DONE)
+            break;
+        if (event == PbReader::PB_END)
+        {
+            maps.pop_back();
+            continue;
+        }
+        ObjectPtr key = InternKey(machine, reader.name_begin(), reader.name_end());
+        if (event == PbReader::PB_FIELD)
+        {
+            AddField(*maps.back(), key, PbValue(reader, file));
+            continue;
+        }
+        MapPtr mp = MakeMap();
+        AddField(*maps.back(), key, mp);
+        maps.push_back(mp.get());
+    }
+    machine.pop();
+    machine.push(result);
+}
+
+void PBFIELDS(Machine& machine)
+{
+    stack_required(machine, "PBFIELDS", 2);
+    throw_required(machine, "PBFIELDS", 0, OBJECT_LIST);
+    throw_required(machine, "PBFIELDS", 1, OBJECT_STRING);
+
+    ListPtr paths = static_pointer_cast<List>(machine.peek(0));
+    std::vector<const std::string *> wanted;
+    for (auto& item: paths->items)
+    {
+        if (item->type != OBJECT_STRING)
+            throw std::runtime_error("PBFIELDS: field paths must be strings");
+        wanted.push_back(&((String *)item.get())->get());
+    }
+    ObjectPtr optr = machine.peek(1);
+    const char *begin;
+    const char *end;
+    MappedFilePtr file;
+    GetText(optr, begin, end, file);
+
+    TrimKeys(machine);
+    ListPtr result = MakeList();
+    result->items.assign(wanted.size(), ObjectPtr());
+    size_t found = 0;
+    size_t building = 0;            // open messages being read into a Map
+    std::string path;               // dotted path of the current field
+    std::vector<size_t> lengths;    // length of path at each open message
+    std::vector<Map *> maps;        // the Map of each open message, or nullptr
+
+    PbReader reader("PBFIELDS", begin, end);
+    while (found < wanted.size() || building)
+    {
+        PbReader::Event event = reader.Next();
+        if (event == PbReader::PB_DONE)
+            break;
+        if (event == PbReader::PB_END)
+        {
+            path.resize(lengths.back());
+            lengths.pop_back();
+            if (maps.back())
+                --building;
+            maps.pop_back();
+            continue;
+        }
+
+        size_t length = path.size();
+        if (length)
+            path += '.';
+        path.append(reader.name_begin(), reader.name_end());
+        // the value is only made if it is kept
+        ObjectPtr value;
+        auto make_value = [&]() {
+            if (!value)
+                value = event == PbReader::PB_FIELD ? PbValue(reader, file) : ObjectPtr(MakeMap());
+        };
+        Map *parent = maps.empty() ? nullptr : maps.back();
+        bool keep = parent != nullptr;
+        for (size_t i = 0; i < wanted.size(); ++i)
+        {
+            if (!result->items[i] && *wanted[i] == path)
+            {
+                make_value();
+                result->items[i] = value;
+                ++found;
+                keep = true;
+            }
+        }
+        if (parent)
+        {
+            make_value();
+            ObjectPtr key = InternKey(machine, reader.name_begin(), reader.name_end());
+            AddField(*parent, key, value);
+        }
+
+        if (event == PbReader::PB_FIELD)
+            path.resize(length);
+        else
+        {
+            lengths.push_back(length);
+            maps.push_back(keep ? (Map *)value.get() : nullptr);
+            if (keep)
+                ++building;
+        }
+    }
+
+    for (auto& item: result->items)
+    {
+        if (!item)
+            item = MakeNone();
+    }
+    machine.pop();
+    machine.pop();
+    machine.push(result);
+}
+
+void KVPARSE(Machine& machine)
+{
+    stack_required(machine, "KVPARSE", 1);
+    std::string seps = KvSeparators(machine, 1);
+    throw_required(machine, "KVPARSE", 0, OBJECT_STRING);
+
+    ObjectPtr optr;
+    machine.pop(optr);
+    const char *begin;
+    const char *end;
+    MappedFilePtr file;
+    GetText(optr, begin, end, file);
+
+    TrimKeys(machine);
+    MapPtr result = MakeMap();
+    KvReader reader(begin, end, seps);
+    while (reader.Next())
+    {
+        ObjectPtr key = InternKey(machine, reader.key_begin(), reader.key_end());
+        AddField(*result, key, KvValue(reader, file));
+    }
+    machine.push(result);
+}
+
+void KVFIELDS(Machine& machine)
+{
+    stack_required(machine, "KVFIELDS", 2);
+    std::string seps = KvSeparators(machine, 2);
+    throw_required(machine, "KVFIELDS", 0, OBJECT_LIST);
+    throw_required(machine, "KVFIELDS", 1, OBJECT_STRING);
+
+    ListPtr keys = static_pointer_cast<List>(machine.peek(0));
+    std::vector<const std::string *> wanted;
+    for (auto& item: keys->items)
+    {
+        if (item->type != OBJECT_STRING)
+            throw std::runtime_error("KVFIELDS: keys must be strings");
+        wanted.push_back(&((String *)item.get())->get());
+    }
+    ObjectPtr optr;
+    machine.pop();
+    machine.pop(optr);
+    const char *begin;
+    const char *end;
+    MappedFilePtr file;
+    GetText(optr, begin, end, file);
+
+    ListPtr result = MakeList();
+    result->items.assign(wanted.size(), ObjectPtr());
+    size_t found = 0;
+    KvReader reader(begin, end, seps);
+    while (found < wanted.size() && reader.Next())
+    {
+        size_t length = reader.key_end() - reader.key_begin();
+        for (size_t i = 0; i < wanted.size(); ++i)
+        {
+            if (!result->items[i] && wanted[i]->size() == length &&
+                memcmp(wanted[i]->data(), reader.key_begin(), length) == 0)
+            {
+                result->items[i] = KvValue(reader, file);
+                ++found;
+            }
+        }
+    }
+
+    for (auto& item: result->items)
+    {
+        if (!item)
+            item = MakeNone();
+    }
+    machine.push(result);
+}
+
+
+
+} // namespace rps
@@ -0,0 +1,388 @@
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include "token.h"
+#include "object.h"
+#include "module.h"
+#include "machine.h"
+#include "utilities.h"
+#include "table.h"
+
+namespace rps
+{
+
+namespace
+{
+
+size_t Words(size_t rows)
+{
+    return (rows + 63) / 64;
+}
+
+void SetBit(Bitmap& bits, size_t i)
+{
+    bits[i >> 6] |= uint64_t(1) << (i & 63);
+}
+
+// Clear the bits past the last row
+void ClearTail(Bitmap& bits, size_t rows)
+{
+    if (rows & 63)
+        bits.back() &= (uint64_t(1) << (rows & 63)) - 1;
+}
+
+// Cell c of a row, None past the end of the row
+const Object *Cell(const ObjectPtr& row, size_t c)
+{
+    const List *lp = (const List *)row.get();
+    return c < lp->items.size() ? lp->items[c].get() : nullptr;
+}
+
+ColumnPtr BuildColumn(const char *cmd, const std::vector<ObjectPtr>& rows, size_t c)
+{
+    std::shared_ptr<Column> col = std::make_shared<Column>();
+    size_t count = rows.size();
+    bool ints = true;
+    bool numbers = false;
+    bool nones = false;
+    for (auto& row: rows)
+    {
+        const Object *cell = Cell(row, c);
+        if (cell == nullptr || cell->type == OBJECT_NONE)
+            nones = true;
+        else if (cell->type == OBJECT_STRING)
+            ints = false;
+        else if (cell->type == OBJECT_INTEGER)
+            numbers = true;
+        else
+        {
+            std::stringstream ss;
+            ss << cmd << ": cells must be strings, integers or None, got " << ObjectNames[cell->type];
+            throw std::runtime_error(ss.str());
+        }
+    }
+    if (nones)
+        col->nones.assign(Words(count), 0);
+
+    if (ints)
+    {
+        col->ints.assign(count, 0);
+        for (size_t r = 0; r < count; ++r)
+        {
+            const Object *cell = Cell(rows[r], c);
+            if (cell == nullptr || cell->type == OBJECT_NONE)
+                SetBit(col->nones, r);
+            else
+                col->ints[r] = ((const Integer *)cell)->value;
+        }
+        return col;
+    }
+
+    col->kind = Column::COLUMN_STRING;
+    col->codes.assign(count, 0);
+    if (numbers)
+        col->integers.assign(Words(count), 0);
+    col->offsets.push_back(0);
+    std::unordered_map<std::string, uint32_t> dict;
+    std::string number;
+    for (size_t r = 0; r < count; ++r)
+    {
+        const Object *cell = Cell(rows[r], c);
+        if (cell == nullptr || cell->type == OBJECT_NONE)
+        {
+            SetBit(col->nones, r);
+            continue;
+        }
+        const std::string *text;
+        if (cell->type == OBJECT_STRING)
+            text = &((const String *)cell)->get();
+        else
+        {
+            number = std::to_string(((const Integer *)cell)->value);
+            text = &number;
+            SetBit(col->integers, r);
+        }
+        auto it = dict.find(*text);
+        if (it == dict.end())
+        {
+            it = dict.emplace(*text, (uint32_t)dict.size()).first;
+            col->chars += *text;
+            col->offsets.push_back((uint32_t)col->chars.size());
+        }
+        col->codes[r] = it->second;
+    }
+    // code 0 of the rows that are None must be a valid code
+    if (col->offsets.size() == 1)
+        col->offsets.push_back(0);
+    return col;
+}
+
+// Set out to the rows where cmp(v[row], x) holds, 64 rows to a word
+template <class T, class Cmp>
+void MatchValues(const T *v, size_t rows, T x, uint64_t *out)
+{
+    Cmp cmp;
+    for (size_t base = 0, w = 0; base < rows; base += 64, ++w)
+    {
+        size_t n = std::min<size_t>(64, rows - base);
+        const T *p = v + base;
+        uint64_t bits = 0;
+        for (size_t j = 0; j < n; ++j)
+            bits |= uint64_t(cmp(p[j], x)) << j;
+        out[w] = bits;
+    }
+}
+
+// Set out to the rows whose code has hit set
+void MatchCodes(const uint32_t *codes, size_t rows, const std::vector<uint8_t>& hit, uint64_t *out)
+{
+    const uint8_t *h = hit.data();
+    for (size_t base = 0, w = 0; base < rows; base += 64, ++w)
+    {
+        size_t n = std::min<size_t>(64, rows - base);
+        const uint32_t *p = codes + base;
+        uint64_t bits = 0;
+        for (size_t j = 0; j < n; ++j)
+            bits |= uint64_t(h[p[j]]) << j;
+        out[w] = bits;
+    }
+}
+
+template <class T>
+void Match(const T *v, size_t rows, CompareOp op, T x, uint64_t *out)
+{
+    switch (op)
+    {
+    case CMP_EQ: MatchValues<T, std::equal_to<T>>(v, rows, x, out); break;
+    case CMP_NE: MatchValues<T, std::not_equal_to<T>>(v, rows, x, out); break;
+    case CMP_LT: MatchValues<T, std::less<T>>(v, rows, x, out); break;
+    case CMP_LE: MatchValues<T, std::less_equal<T>>(v, rows, x, out); break;
+    case CMP_GT: MatchValues<T, std::greater<T>>(v, rows, x, out); break;
+    case CMP_GE: MatchValues<T, std::greater_equal<T>>(v, rows, x, out); break;
+    }
+}
+
+// Whether a comparison that came out as r, <0, 0 or >0, satisfies op
+bool Holds(CompareOp op, int r)
+{
+    switch (op)
+    {
+    case CMP_EQ: return r == 0;
+    case CMP_NE: return r != 0;
+    case CMP_LT: return r < 0;
+    case CMP_LE: return r <= 0;
+    case CMP_GT: return r > 0;
+    case CMP_GE: return r >= 0;
+    }
+    return false;
+}
+
+int Compare(const char *a, size_t alen, const std::string& b)
+{
+    int r = memcmp(a, b.data(), std::min(alen, b.size()));
+    if (r == 0)
+        r = alen < b.size() ? -1 : (alen > b.size() ? 1 : 0);
+    return r;
+}
+
+int64_t IntValue(const char *cmd, const ObjectPtr& value)
+{
+    if (value->type == OBJECT_INTEGER)
+        return ((Integer *)value.get())->value;
+    const std::string& s = ((String *)value.get())->get();
+    size_t end = 0;
+    int64_t n = 0;
+    try
+    {
+        n = std::stoll(s, &end);
+    }
+    catch (std::exception&)
+    {
+        end = 0;
+    }
+    if (end == 0 || end != s.size())
+    {
+        std::stringstream ss;
+        ss << cmd << ": \"" << s << "\" is compared with an Integer column";
+        throw std::runtime_error(ss.str());
+    }
+    return n;
+}
+
+} // namespace
+
+int64_t Column::number(uint32_t c) const
+{
+    const char *p = text(c);
+    const char *end = p + length(c);
+    bool negative = p != end && *p == '-';
+    uint64_t n = 0;
+    for (p += negative; p != end; ++p)
+        n = n * 10 + (*p - '0');
+    return negative ? (int64_t)(0 - n) : (int64_t)n;
+}
+
+size_t Table::Selected() const
+{
+    if (selection.empty())
+        return rows;
+    size_t count = 0;
+    for (uint64_t word: selection)
+        count += __builtin_popcountll(word);
+    return count;
+}
+
+size_t Table::ColumnIndex(const char *cmd, const ObjectPtr& col) const
+{
+    if (col->type == OBJECT_INTEGER)
+    {
+        int64_t idx = ((Integer *)col.get())->value;
+        if (idx >= 0 && idx < (int64_t)columns.size())
+            return idx;
+    }
+    else if (col->type == OBJECT_STRING)
+    {
+        auto it = std::find(names.begin(), names.end(), ((String *)col.get())->get());
+        if (it != names.end())
+            return it - names.begin();
+    }
+    std::stringstream ss;
+    ss << cmd << ": no column ";
+    if (col->type == OBJECT_INTEGER)
+        ss << ((Integer *)col.get())->value;
+    else if (col->type == OBJECT_STRING)
+        ss << "\"" << ((String *)col.get())->get() << "\"";
+    else
+        ss << "given by a " << ObjectNames[col->type];
+    throw std::runtime_error(ss.str());
+}
+
+TablePtr MakeTable(const char *cmd, const std::vector<ObjectPtr>& rows,
+                   const std::vector<std::string>& names)
+{
+    size_t width = names.size();
+    for (auto& row: rows)
+    {
+        if (row->type != OBJECT_LIST)
+        {
+            std::stringstream ss;
+            ss << cmd << ": rows must be lists, got " << ObjectNames[row->type];
+            throw std::runtime_error(ss.str());
+        }
+        width = std::max(width, ((List *)row.get())->items.size());
+    }
+
+    TablePtr table(new Table);
+    table->rows = rows.size();
+    for (size_t c = 0; c < width; ++c)
+    {
+        // columns without a name are known by their number
+        table->names.push_back(c < names.size() ? names[c] : std::to_string(c));
+        table->columns.push_back(BuildColumn(cmd, rows, c));
+    }
+    return table;
+}
+
+TablePtr FilterTable(const char *cmd, const Table& table, size_t column,
+                     CompareOp op, const ObjectPtr& value)
+{
+    const Column& col = *table.columns[column];
+    size_t rows = table.rows;
+    Bitmap match(Words(rows), 0);
+
+    if (value->type == OBJECT_NONE)
+    {
+        if (op != CMP_EQ && op != CMP_NE)
+        {
+            std::stringstream ss;
+            ss << cmd << ": None can only be compared for equality";
+            throw std::runtime_error(ss.str());
+        }
+        if (!col.nones.empty())
+            match = col.nones;
+        if (op == CMP_NE)
+        {
+            for (auto& word: match)
+                word = ~word;
+            ClearTail(match, rows);
+        }
+    }
+    else if (value->type != OBJECT_INTEGER && value->type != OBJECT_STRING)
+    {
+        std::stringstream ss;
+        ss << cmd << ": requires a String, Integer or None value";
+        throw std::runtime_error(ss.str());
+    }
+    else
+    {
+        if (col.kind == Column::COLUMN_INT)
+            Match<int64_t>(col.ints.data(), rows, op, IntValue(cmd, value), match.data());
+        else
+        {
+            std::string text = value->type == OBJECT_STRING
+                ? ((String *)value.get())->get()
+                : std::to_string(((Integer *)value.get())->value);
+            if (op == CMP_EQ || op == CMP_NE)
+            {
+                // at most one code is equal to the value
+                uint32_t code = 0;
+                while (code < col.entries() && Compare(col.text(code), col.length(code), text) != 0)
+                    ++code;
+                Match<uint32_t>(col.codes.data(), rows, op, code, match.data());
+            }
+            else
+            {
+                std::vector<uint8_t> hit(col.entries());
+                for (uint32_t code = 0; code < hit.size(); ++code)
+                    hit[code] = Holds(op, Compare(col.text(code), col.length(code), text));
+                MatchCodes(col.codes.data(), rows, hit, match.data());
+            }
+        }
+        // a None is neither equal nor unequal to a value
+        for (size_t w = 0; w < col.nones.size(); ++w)
+            match[w] &= ~col.nones[w];
+    }
+
+    if (!table.selection.empty())
+    {
+        for (size_t w = 0; w < match.size(); ++w)
+            match[w] &= table.selection[w];
+    }
+
+    TablePtr result(new Table);
+    result->names = table.names;
+    result->columns = table.columns;
+    result->rows = rows;
+    result->selection = std::move(match);
+    return result;
+}
+
+void ColumnCells(const Table& table, size_t column, std::vector<ObjectPtr>& cells)
+{
+    const Column& col = *table.columns[column];
+    std::vector<ObjectPtr> strings(col.kind == Column::COLUMN_STRING ? col.entries() : 0);
+    cells.reserve(cells.size() + table.Selected());
+    for (size_t r = 0; r < table.rows; ++r)
+    {
+        if (!table.IsSelected(r))
+            continue;
+        if (col.none(r))
+            cells.push_back(MakeNone());
+        else if (col.kind == Column::COLUMN_INT)
+            cells.push_back(MakeInteger(col.ints[r]));
+        else if (col.integer(r))
+            cells.push_back(MakeInteger(col.number(col.codes[r])));
+        else
+        {
+            ObjectPtr& s = strings[col.codes[r]];
+            if (!s)
+                s.reset(new String(col.text(col.codes[r]), col.text(col.codes[r]) + col.length(col.codes[r])));
+            cells.push_back(s);
+        }
+    }
+}
+
+} // namespace rps
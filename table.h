@@ -0,0 +1,115 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdint>
+
+namespace rps
+{
+
+class Machine;
+
+// A bit for each row of a table, row i is bit i % 64 of word i / 64
+typedef std::vector<uint64_t> Bitmap;
+
+/*
+ * A column of a Table. An Integer column holds the values in a vector of
+ * int64, a String column holds each distinct string once in a dictionary
+ * and a code into the dictionary for each row. Comparing a column with a
+ * value reads only the ints or the codes, never an Object. The Integers
+ * of a column that also has Strings are held as their text, a bitmap
+ * tells which rows they are so they come back as Integers.
+ */
+class Column
+{
+public:
+    enum Kind
+    {
+        COLUMN_INT
+        , COLUMN_STRING
+    };
+
+    Column() : kind(COLUMN_INT) {}
+
+    // The string with code c of a String column
+    const char *text(uint32_t c) const { return chars.data() + offsets[c]; }
+    size_t length(uint32_t c) const { return offsets[c + 1] - offsets[c]; }
+    size_t entries() const { return offsets.empty() ? 0 : offsets.size() - 1; }
+    bool none(size_t row) const
+    {
+        return !nones.empty() && ((nones[row >> 6] >> (row & 63)) & 1);
+    }
+    // true if the cell of a String column was an Integer
+    bool integer(size_t row) const
+    {
+        return !integers.empty() && ((integers[row >> 6] >> (row & 63)) & 1);
+    }
+    // The value of code c of a String column, for a row that was an Integer
+    int64_t number(uint32_t c) const;
+
+    Kind kind;
+    std::vector<int64_t> ints;      // COLUMN_INT, the value of each row
+    std::vector<uint32_t> codes;    // COLUMN_STRING, the code of each row
+    std::string chars;              // the dictionary, code c is chars[offsets[c], offsets[c+1])
+    std::vector<uint32_t> offsets;
+    Bitmap nones;                   // the rows that are None, empty if there are none
+    Bitmap integers;                // COLUMN_STRING, the rows that were Integers, empty if there are none
+};
+
+typedef std::shared_ptr<const Column> ColumnPtr;
+
+/*
+ * Records stored by column, built by TABLE from a List of field lists.
+ * A Table is never changed: selecting columns or filtering rows makes a
+ * new Table that shares the columns. Filters do not move any rows, they
+ * narrow down the selection, a bitmap of the rows that are kept.
+ */
+class Table : public Object
+{
+public:
+    Table() : Object(OBJECT_TABLE), rows(0) {}
+
+    // The number of selected rows
+    size_t Selected() const;
+    bool IsSelected(size_t row) const
+    {
+        return selection.empty() || ((selection[row >> 6] >> (row & 63)) & 1);
+    }
+    // The column named by col, a String name or an Integer index. Throws
+    // naming cmd if there is no such column.
+    size_t ColumnIndex(const char *cmd, const ObjectPtr& col) const;
+
+    std::vector<std::string> names;
+    std::vector<ColumnPtr> columns;
+    size_t rows;                    // the rows of each column, selected or not
+    Bitmap selection;               // empty if all rows are selected
+};
+
+typedef Ref<Table> TablePtr;
+
+enum CompareOp
+{
+    CMP_EQ
+    , CMP_NE
+    , CMP_LT
+    , CMP_LE
+    , CMP_GT
+    , CMP_GE
+};
+
+// A Table with a column for each name and for each field of the longest
+// row. Cells must be Strings, Integers or None. A column is an Integer
+// column if all its cells are Integers or None.
+TablePtr MakeTable(const char *cmd, const std::vector<ObjectPtr>& rows,
+                   const std::vector<std::string>& names);
+
+// The rows of table whose cell in column compares to value with op.
+// Cells that are None only match EQ and NE with None.
+TablePtr FilterTable(const char *cmd, const Table& table, size_t column,
+                     CompareOp op, const ObjectPtr& value);
+
+// The Objects for the selected cells of a column, strings that are equal
+// share one String and Integers stay Integers
+void ColumnCells(const Table& table, size_t column, std::vector<ObjectPtr>& cells);
+
+} // namespace rps
@@ -0,0 +1,172 @@
+#include <vector>
+#include <exception>
+#include <iostream>
+#include <sstream>
+#include <memory>
+#include "token.h"
+#include "object.h"
+#include "module.h"
+#include "machine.h"
+#include "commands.h"
+#include "utilities.h"
+#include "table.h"
+
+namespace rps
+{
+
+void TABLE(Machine& machine)
+{
+    stack_required(machine, "TABLE", 2);
+    throw_required(machine, "TABLE", 0, OBJECT_LIST);
+    items_required(machine, "TABLE", 1);
+
+    ListPtr names = static_pointer_cast<List>(machine.peek(0));
+    std::vector<std::string> columns;
+    for (auto& name: names->items)
+    {
+        if (name->type != OBJECT_STRING)
+            throw std::runtime_error("TABLE: column names must be strings");
+        columns.push_back(((String *)name.get())->get());
+    }
+
+    ObjectPtr src = machine.peek(1);
+    std::vector<ObjectPtr> rows;
+    if (src->type == OBJECT_LIST)
+        rows = ((List *)src.get())->items;
+    else
+    {
+        ItemReader items(src);
+        ObjectPtr row;
+        while (items.Next(machine, row))
+            rows.push_back(row);
+    }
+    ObjectPtr table = MakeTable("TABLE", rows, columns);
+    machine.pop();
+    machine.pop();
+    machine.push(table);
+}
+
+void TSELECT(Machine& machine)
+{
+    stack_required(machine, "TSELECT", 2);
+    throw_required(machine, "TSELECT", 0, OBJECT_LIST);
+    throw_required(machine, "TSELECT", 1, OBJECT_TABLE);
+
+    ListPtr cols = static_pointer_cast<List>(machine.peek(0));
+    TablePtr table = static_pointer_cast<Table>(machine.peek(1));
+    TablePtr result(new Table);
+    result->rows = table->rows;
+    result->selection = table->selection;
+    for (auto& col: cols->items)
+    {
+        size_t c = table->ColumnIndex("TSELECT", col);
+        result->names.push_back(table->names[c]);
+        result->columns.push_back(table->columns[c]);
+    }
+    machine.pop();
+    machine.pop();
+    ObjectPtr optr = result;
+    machine.push(optr);
+}
+
+// table col value CMP
+void CompareColumn(Machine& machine, const char *cmd, CompareOp op)
+{
+    stack_required(machine, cmd, 3);
+    throw_required(machine, cmd, 2, OBJECT_TABLE);
+
+    TablePtr table = static_pointer_cast<Table>(machine.peek(2));
+    size_t c = table->ColumnIndex(cmd, machine.peek(1));
+    ObjectPtr result = FilterTable(cmd, *table, c, op, machine.peek(0));
+    machine.pop();
+    machine.pop();
+    machine.pop();
+    machine.push(result);
+}
+
+void TEQ(Machine& machine)
+{
+    CompareColumn(machine, "TEQ", CMP_EQ);
+}
+
+void TNE(Machine& machine)
+{
+    CompareColumn(machine, "TNE", CMP_NE);
+}
+
+void TLT(Machine& machine)
+{
+    CompareColumn(machine, "TLT", CMP_LT);
+}
+
+void TLE(Machine& machine)
+{
+    CompareColumn(machine, "TLE", CMP_LE);
+}
+
+void TGT(Machine& machine)
+{
+    CompareColumn(machine, "TGT", CMP_GT);
+}
+
+void TGE(Machine& machine)
+{
+    CompareColumn(machine, "TGE", CMP_GE);
+}
+
+void TROWS(Machine& machine)
+{
+    stack_required(machine, "TROWS", 1);
+    throw_required(machine, "TROWS", 0, OBJECT_TABLE);
+
+    TablePtr table = static_pointer_cast<Table>(machine.peek(0));
+    size_t count = table->Selected();
+    ListPtr result = MakeList();
+    result->items.reserve(count);
+    for (size_t r = 0; r < count; ++r)
+    {
+        ListPtr row = MakeList();
+        row->items.reserve(table->columns.size());
+        result->items.push_back(row);
+    }
+    // a column at a time, the strings of a column are made once
+    std::vector<ObjectPtr> cells;
+    for (size_t c = 0; c < table->columns.size(); ++c)
+    {
+        cells.clear();
+        ColumnCells(*table, c, cells);
+        for (size_t r = 0; r < count; ++r)
+            ((List *)result->items[r].get())->items.push_back(cells[r]);
+    }
+    machine.pop();
+    machine.push(result);
+}
+
+void TCOLUMN(Machine& machine)
+{
+    stack_required(machine, "TCOLUMN", 2);
+    throw_required(machine, "TCOLUMN", 1, OBJECT_TABLE);
+
+    TablePtr table = static_pointer_cast<Table>(machine.peek(1));
+    size_t c = table->ColumnIndex("TCOLUMN", machine.peek(0));
+    ListPtr result = MakeList();
+    ColumnCells(*table, c, result->items);
+    machine.pop();
+    machine.pop();
+    machine.push(result);
+}
+
+void TNAMES(Machine& machine)
+{
+    stack_required(machine, "TNAMES", 1);
+    throw_required(machine, "TNAMES", 0, OBJECT_TABLE);
+
+    TablePtr table = static_pointer_cast<Table>(machine.peek(0));
+    ListPtr result = MakeList();
+    for (auto& name: table->names)
+        result->items.push_back(ObjectPtr(new String(name)));
+    machine.pop();
+    machine.push(result);
+}
+
+} // namespace rps
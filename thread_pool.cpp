@@ -0,0 +1,155 @@
+#include <stdexcept>
+#include <algorithm>
+#include <cstdlib>
+#include "thread_pool.h"
+
+namespace rps
+{
+
+// One worker per core, or $RPS_THREADS
+size_t DefaultWorkers()
+{
+    const char *p = getenv("RPS_THREADS");
+    if (p && atoi(p) > 0)
+        return atoi(p);
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+ThreadPool& ThreadPool::Instance()
+{
+    static ThreadPool pool(DefaultWorkers());
+    return pool;
+}
+
+ThreadPool::ThreadPool(size_t workers)
+: task_(nullptr)
+, round_(0)
+, running_(0)
+, stop_(false)
+, failed_(false)
+{
+    for (size_t i = 0; i < workers; ++i)
+        queues_.emplace_back(new Queue());
+    for (size_t i = 0; i + 1 < workers; ++i)
+        threads_.emplace_back(&ThreadPool::Worker, this, i);
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    wake_.notify_all();
+    for (std::thread& t : threads_)
+        t.join();
+}
+
+void ThreadPool::Run(size_t count, const std::function<void(size_t, size_t)>& task)
+{
+    for (size_t i = 0; i < count; ++i)
+        queues_[i % queues_.size()]->tasks.push_back(i);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        task_ = &task;
+        failed_ = false;
+        error_.clear();
+        running_ = threads_.size();
+        ++round_;
+    }
+    wake_.notify_all();
+
+    Drain(queues_.size() - 1);
+
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_.wait(lock, [this] { return running_ == 0; });
+    task_ = nullptr;
+    if (failed_)
+        throw std::runtime_error(error_);
+}
+
+void ThreadPool::Worker(size_t id)
+{
+    uint64_t seen = 0;
+    while (true)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.wait(lock, [this, seen] { return stop_ || round_ != seen; });
+            if (stop_)
+                return;
+            seen = round_;
+        }
+        Drain(id);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--running_ == 0)
+                done_.notify_one();
+        }
+    }
+}
+
+void ThreadPool::Drain(size_t id)
+{
+    size_t task;
+    while (Pop(id, task) || Steal(id, task))
+    {
+        try
+        {
+            (*task_)(id, task);
+        }
+        catch (std::exception& e)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!failed_)
+            {
+                failed_ = true;
+                error_ = e.what();
+            }
+        }
+        // after a failure the remaining tasks are dropped
+        bool failed;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            failed = failed_;
+        }
+        if (failed)
+        {
+            for (auto& q : queues_)
+            {
+                std::lock_guard<std::mutex> lock(q->mutex);
+                q->tasks.clear();
+            }
+            return;
+        }
+    }
+}
+
+bool ThreadPool::Pop(size_t id, size_t& task)
+{
+    Queue& q = *queues_[id];
+    std::lock_guard<std::mutex> lock(q.mutex);
+    if (q.tasks.empty())
+        return false;
+    task = q.tasks.front();
+    q.tasks.pop_front();
+    return true;
+}
+
+bool ThreadPool::Steal(size_t id, size_t& task)
+{
+    for (size_t n = 1; n < queues_.size(); ++n)
+    {
+        Queue& q = *queues_[(id + n) % queues_.size()];
+        std::lock_guard<std::mutex> lock(q.mutex);
+        if (!q.tasks.empty())
+        {
+            task = q.tasks.back();
+            q.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+} // namespace rps
@@ -0,0 +1,61 @@
+#pragma once
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <string>
+
+namespace rps
+{
+
+/*
+ * Worker threads for PAPPLY, PFILTER and PREDUCE. Run hands out task
+ * indexes round robin to a queue per worker, a worker that runs out of
+ * tasks steals from the back of the other queues. The calling thread
+ * works as the last worker, so a pool of size() workers has size() - 1
+ * threads.
+ */
+class ThreadPool
+{
+public:
+    static ThreadPool& Instance();
+
+    explicit ThreadPool(size_t workers);
+    ~ThreadPool();
+
+    size_t size() const { return queues_.size(); }
+
+    // Call task(worker, index) for every index in [0, count). Stops
+    // handing out tasks after the first exception and rethrows its
+    // message as a runtime_error.
+    void Run(size_t count, const std::function<void(size_t, size_t)>& task);
+
+private:
+    struct Queue
+    {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    void Worker(size_t id);
+    void Drain(size_t id);
+    bool Pop(size_t id, size_t& task);
+    bool Steal(size_t id, size_t& task);
+
+    std::vector<std::thread> threads_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    const std::function<void(size_t, size_t)> *task_;
+    uint64_t round_;
+    size_t running_;            // threads still working on the round
+    bool stop_;
+    bool failed_;
+    std::string error_;
+};
+
+} // namespace rps
@@ -49,6 +49,8 @@ enum ObjectType
     ,OBJECT_IF
     ,OBJECT_FOR
     ,OBJECT_WHILE
+    ,OBJECT_STREAM
+    ,OBJECT_TABLE
 };
 
 static const char *ObjectNames[] = {
@@ -63,6 +65,8 @@ static const char *ObjectNames[] = {
     , "If"
     , "For"
     , "While"
+    , "Stream"
+    , "Table"
 };
 
 } // namespace rps
@@ -5,10 +5,16 @@
 #include <fstream>
 #include <unordered_map>
 #include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "object.h"
 #include "module.h"
 #include "machine.h"
 #include "parser.h"
+#include "module_cache.h"
+#include "utilities.h"
+#include "table.h"
 
 namespace rps
 {
@@ -20,18 +26,40 @@ StringPtr MakeString()
     return sp;
 }
 
-IntegerPtr MakeInteger()
+// Integers are immutable, so the small values that make up most
+// counters, indexes and comparison results are allocated once and
+// shared instead of being created for every push.
+const int64_t SMALL_INTEGER_MIN = -256;
+const int64_t SMALL_INTEGER_MAX = 4095;
+
+// Filled in one go by the first call, so worker threads never race to
+// create an entry
+struct SmallIntegers
+{
+    SmallIntegers()
+    {
+        for (int64_t n = SMALL_INTEGER_MIN; n <= SMALL_INTEGER_MAX; ++n)
+            values[n - SMALL_INTEGER_MIN].reset(new Integer(n));
+    }
+    IntegerPtr values[SMALL_INTEGER_MAX - SMALL_INTEGER_MIN + 1];
+};
+
+IntegerPtr MakeInteger(int64_t n)
 {
+    static SmallIntegers small;
     IntegerPtr ip;
-    ip.reset(new Integer(0));
-    return ip;
+    if (n < SMALL_INTEGER_MIN || n > SMALL_INTEGER_MAX)
+    {
+        ip.reset(new Integer(n));
+        return ip;
+    }
+    return small.values[n - SMALL_INTEGER_MIN];
 }
 
 NonePtr MakeNone()
 {
-    NonePtr np;
-    np.reset(new None());
-    return np;
+    static NonePtr none(new None());
+    return none;
 }
 
 ProgramPtr MakeProgram()
@@ -61,16 +89,13 @@ ObjectPtr Clone(ObjectPtr optr)
     {
     case OBJECT_STRING:
         {
-            StringPtr sp = MakeString();
-            sp->set(((String *)optr.get())->get());
+            StringPtr sp(new String(*(String *)optr.get()));
             return sp;
         }
         break;
     case OBJECT_INTEGER:
         {
-            IntegerPtr ip = MakeInteger();
-            ip->value = ((Integer *)optr.get())->value;
-            return ip;
+            return MakeInteger(((Integer *)optr.get())->value);
         }
         break;
     case OBJECT_LIST:
@@ -100,6 +125,10 @@ ObjectPtr Clone(ObjectPtr optr)
             return np;
         }
         break;
+    case OBJECT_STREAM:
+        return optr;        // a stream is read once, copies would share it
+    case OBJECT_TABLE:
+        return optr;        // a table is never changed
     default:
         assert(false);
         throw std::runtime_error("Clone: Unknown type");
@@ -108,242 +137,177 @@ ObjectPtr Clone(ObjectPtr optr)
 }
 
 std::string ToStr(Machine& machine, ObjectPtr optr)
+{
+    if (optr->type == OBJECT_STRING)
+        return ((String *)optr.get())->get();
+    TextWriter out;
+    out.Write(machine, optr);
+    return std::move(out.str());
+}
+
+TextWriter::~TextWriter()
+{
+    Flush();
+}
+
+void TextWriter::Flush()
+{
+    if (file_ && !buf_.empty())
+    {
+        fwrite(buf_.data(), 1, buf_.size(), file_);
+        buf_.clear();
+    }
+}
+
+// A slice of a mapped file is copied straight from the file
+void TextWriter::Text(const String *sp)
+{
+    const char *begin, *end;
+    MappedFilePtr file;
+    if (sp->Slice(begin, end, file))
+        buf_.append(begin, end - begin);
+    else
+        buf_.append(sp->get());
+}
+
+// An item of a List, Map or Program. Strings are quoted unless they
+// start with a space.
+void TextWriter::Element(Machine& machine, const ObjectPtr& optr)
+{
+    if (optr->type != OBJECT_STRING)
+    {
+        buf_ += ' ';
+        Write(machine, optr);
+        return;
+    }
+    const String *sp = (const String *)optr.get();
+    const char *begin, *end;
+    MappedFilePtr file;
+    bool space;
+    if (sp->Slice(begin, end, file))
+        space = begin != end && *begin == ' ';
+    else
+        space = !sp->get().empty() && sp->get()[0] == ' ';
+    if (space)
+    {
+        buf_ += ' ';
+        Text(sp);
+    }
+    else
+    {
+        buf_ += " \"";
+        Text(sp);
+        buf_ += '"';
+    }
+}
+
+void TextWriter::Elements(Machine& machine, const std::vector<ObjectPtr>& items)
+{
+    for (auto& item : items)
+    {
+        Element(machine, item);
+        Spill();
+    }
+}
+
+void TextWriter::Write(Machine& machine, const ObjectPtr& optr)
 {
     switch (optr->type)
     {
     case OBJECT_STRING:
-        return ((String *)optr.get())->get();
+        Text((String *)optr.get());
+        break;
     case OBJECT_INTEGER:
-        return std::to_string(((Integer *)optr.get())->value);
-    case OBJECT_COMMAND:
-        return ((Command *)optr.get())->value;
-    case OBJECT_LIST:
         {
-            List *lp = (List *)optr.get();
-            std::stringstream strm;
-            strm << " [";
-            for (auto it = lp->items.begin(); it != lp->items.end(); ++it)
-            {
-                if ((*it)->type == OBJECT_STRING)
-                {
-                    std::string s = ToStr(machine, *it);
-                    if (s.find_first_of(' '))
-                        strm << " \"" << s << "\"";
-                    else
-                        strm << " " << s;
-                }
-                else
-                {
-                    strm << " " << ToStr(machine, *it);
-                }
-            }
-            strm << " ]";
-            return strm.str();
+            char digits[24];
+            int n = snprintf(digits, sizeof(digits), "%lld", (long long)((Integer *)optr.get())->value);
+            buf_.append(digits, n);
         }
         break;
+    case OBJECT_COMMAND:
+        buf_ += ((Command *)optr.get())->value;
+        break;
+    case OBJECT_LIST:
+        buf_ += " [";
+        Elements(machine, ((List *)optr.get())->items);
+        buf_ += " ]";
+        break;
     case OBJECT_MAP:
+        buf_ += " {";
+        for (auto& pr : ((Map *)optr.get())->items)
         {
-            Map *mp = (Map *)optr.get();
-            std::stringstream strm;
-            strm << " {";
-            auto it = mp->items.begin();
-            while (it != mp->items.end())
-            {
-                strm << " [";
-                if (it->first->type == OBJECT_STRING)
-                {
-                    std::string s = ToStr(machine, it->first);
-                    if (s.find_first_of(' '))
-                        strm << " \"" << s << "\"";
-                    else
-                        strm << " " << s;
-                }
-                else
-                {
-                    strm << ToStr(machine, it->first);
-                }
-                if (it->second->type == OBJECT_STRING)
-                {
-                    std::string s = ToStr(machine, it->second);
-                    if (s.find_first_of(' '))
-                        strm << " \"" << s << "\"";
-                    else
-                        strm << " " << s;
-                }
-                else
-                {
-                    strm << " " << ToStr(machine, it->second);
-                }
-                strm << " ]";
-                ++it;
-            }
-            strm << " }";
-            return strm.str();
+            buf_ += " [";
+            if (pr.first->type == OBJECT_STRING)
+                Element(machine, pr.first);
+            else
+                Write(machine, pr.first);
+            Element(machine, pr.second);
+            buf_ += " ]";
+            Spill();
         }
+        buf_ += " }";
         break;
     case OBJECT_PROGRAM:
-        {
-            Program *pp = (Program *)optr.get();
-            std::stringstream strm;
-            strm << " <<";
-            for (ObjectPtr& op : pp->program)
-            {
-                if (op->type == OBJECT_STRING)
-                {
-                    std::string s = ToStr(machine, op);
-                    if (s.find_first_of(' '))
-                        strm << " \"" << s << "\"";
-                    else
-                        strm << " " << s;
-                }
-                else
-                {
-                    strm << " " << ToStr(machine, op);
-                }
-            }
-            strm << " >>";
-            return strm.str();
-        }
+        buf_ += " <<";
+        Elements(machine, ((Program *)optr.get())->program);
+        buf_ += " >>";
         break;
     case OBJECT_IF:
         {
             If *pif = (If *)optr.get();
-            std::stringstream strm;
-            strm << " IF";
-            for (ObjectPtr op : pif->cond)
-            {
-                if (op->type == OBJECT_STRING)
-                {
-                    std::string s = ToStr(machine, op);
-                    if (s.find_first_of(' '))
-                        strm << " " << "\"" << s << "\"";
-                    else
-                        strm << " " << s;
-                }
-                else
-                {
-                    strm << " " << ToStr(machine, op);
-                }
-            }
-            strm << " THEN";
-            for (ObjectPtr op : pif->then)
-            {
-                if (op->type == OBJECT_STRING)
-                {
-                    std::string s = ToStr(machine, op);
-                    if (s.find_first_of(' '))
-                        strm << " \"" << s << "\"";
-                    else
-                        strm << " " << s;
-                }
-                else
-                {
-                    strm << " " << ToStr(machine, op);
-                }
-            }
+            buf_ += " IF";
+            Elements(machine, pif->cond);
+            buf_ += " THEN";
+            Elements(machine, pif->then);
             if (pif->els.size())
             {
-                strm << " ELSE";
-                for (ObjectPtr op : pif->els)
-                {
-                    if (op->type == OBJECT_STRING)
-                    {
-                        std::string s = ToStr(machine, op);
-                        if (s.find_first_of(' '))
-                            strm << " \"" << s << "\"";
-                        else
-                            strm << " " << s;
-                    }
-                    else
-                    {
-                        strm << " " << ToStr(machine, op);
-                    }
-                }
+                buf_ += " ELSE";
+                Elements(machine, pif->els);
             }
-            strm << " ENDIF";
-            return strm.str();
+            buf_ += " ENDIF";
         }
         break;
     case OBJECT_FOR:
-        {
-            std::stringstream strm;
-            strm << " FOR";
-            For *pfor = (For *)optr.get();
-            for (ObjectPtr op : pfor->program)
-            {
-                if (op->type == OBJECT_STRING)
-                {
-                    std::string s = ToStr(machine, op);
-                    if (s.find_first_of(' '))
-                        strm << " \"" << s << "\"";
-                    else
-                        strm << " " << s;
-                }
-                else
-                {
-                    strm << " " << ToStr(machine, op);
-                }
-            }
-            strm << " ENDFOR";
-            return strm.str();
-        }
+        buf_ += " FOR";
+        Elements(machine, ((For *)optr.get())->program);
+        buf_ += " ENDFOR";
         break;
     case OBJECT_WHILE:
         {
-            std::stringstream strm;
-            strm << " WHILE";
             While *pwhile = (While *)optr.get();
-            for (ObjectPtr op : pwhile->cond)
-            {
-                if (op->type == OBJECT_STRING)
-                {
-                    std::string s = ToStr(machine, op);
-                    if (s.find_first_of(' '))
-                        strm << " \"" << s << "\"";
-                    else
-                        strm << " " << s;
-                }
-                else
-                {
-                    strm << " " << ToStr(machine, op);
-                }
-            }
-            strm << " REPEAT";
-            for (ObjectPtr op : pwhile->program)
-            {
-                if (op->type == OBJECT_STRING)
-                {
-                    std::string s = ToStr(machine, op);
-                    if (s.find_first_of(' '))
-                        strm << " \"" << s << "\"";
-                    else
-                        strm << " " << s;
-                }
-                else
-                {
-                    strm << " " << ToStr(machine, op);
-                }
-            }
-            strm << " ENDWHILE";
-            return strm.str();
+            buf_ += " WHILE";
+            Elements(machine, pwhile->cond);
+            buf_ += " REPEAT";
+            Elements(machine, pwhile->program);
+            buf_ += " ENDWHILE";
         }
         break;
     case OBJECT_TOKEN:
-        {
-            if (optr->IsToken(TOKEN_EOL))
-                return "\n";
-            else
-            {
-                std::stringstream strm;
-                Token *pTok = (Token *)optr.get();
-                strm << "TOKEN: " << pTok->value;
-                strm.str();
-            }
-        }
+        if (optr->IsToken(TOKEN_EOL))
+            buf_ += '\n';
+        else
+            buf_ += ((Token *)optr.get())->value;
         break;
     case OBJECT_NONE:
+        buf_ += "None";
+        break;
+    case OBJECT_STREAM:
+        buf_ += "Stream(";
+        buf_ += ((Stream *)optr.get())->Describe();
+        buf_ += ')';
+        break;
+    case OBJECT_TABLE:
         {
-            return "None";
+            Table *tp = (Table *)optr.get();
+            std::stringstream strm;
+            strm << "Table(" << tp->Selected();
+            if (!tp->selection.empty())
+                strm << " of " << tp->rows;
+            strm << " rows:";
+            for (auto& name: tp->names)
+                strm << " " << name;
+            strm << ")";
+            buf_ += strm.str();
         }
         break;
     default:
@@ -372,6 +336,10 @@ std::string ToType(Machine&, ObjectPtr optr)
         return "P";
     case OBJECT_NONE:
         return "N";
+    case OBJECT_STREAM:
+        return "T";
+    case OBJECT_TABLE:
+        return "B";
     default:
         assert(false);
         throw std::runtime_error("Clone: Unknown type");
@@ -398,6 +366,10 @@ bool ToBool(Machine&, ObjectPtr optr)
         break;
     case OBJECT_NONE:
         return false;
+    case OBJECT_STREAM:
+        return true;
+    case OBJECT_TABLE:
+        return ((Table *)optr.get())->Selected() != 0;
     }
     assert(false);
 }
@@ -421,6 +393,10 @@ int64_t ToInt(Machine& machine, ObjectPtr optr)
         throw std::runtime_error("Invalid Program to Int conversion");
     case OBJECT_NONE:
         throw std::runtime_error("Invalid None to Int conversion");
+    case OBJECT_STREAM:
+        throw std::runtime_error("Invalid Stream to Int conversion");
+    case OBJECT_TABLE:
+        throw std::runtime_error("Invalid Table to Int conversion");
     case OBJECT_COMMAND:
         assert(false);
         break;
@@ -455,6 +431,39 @@ void split(const std::string& str, std::vector<std::string>& out, const std::str
     }
 }
 
+// Read a whole file into data, false if it can not be opened
+bool ReadFile(const std::string& filename, std::string& data)
+{
+    FILE *fp = fopen(filename.c_str(), "r");
+    if (fp == nullptr)
+        return false;
+    data.clear();
+    char buf[65536];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        data.append(buf, n);
+    fclose(fp);
+    return true;
+}
+
+// Map a regular file read only. Returns nullptr if it can not be opened,
+// is empty or is not a regular file, the caller falls back to stdio.
+MappedFilePtr MapFile(const std::string& filename)
+{
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return MappedFilePtr();
+    struct stat st;
+    void *data = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+        data = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED)
+        return MappedFilePtr();
+    madvise(data, st.st_size, MADV_SEQUENTIAL);
+    return std::make_shared<MappedFile>((const char *)data, st.st_size);
+}
+
 void Import(Machine& machine, const std::string& modname)
 {
     const char *rps_path = getenv("RPS_PATH");
@@ -464,26 +473,42 @@ void Import(Machine& machine, const std::string& modname)
         split(rps_path, dirs, ":", false);
 
     std::string filename;
-    std::ifstream ifs;
+    struct stat st;
+    bool found = false;
     for (auto& dir : dirs)
     {
         filename = dir + "/" + modname + ".rps";
-        ifs.open(filename);
-        if (ifs.is_open())
+        if ((found = (stat(filename.c_str(), &st) == 0)))
             break;
     }
-    if (!ifs.is_open())
+    std::string data;
+    if (!found || !ReadModuleCache(filename, st, data))
     {
-        std::stringstream strm;
-        strm << "import: cannot find " << modname << ".rps";
-        throw std::runtime_error(strm.str());
+        if (!found || !ReadFile(filename, data))
+        {
+            std::stringstream strm;
+            strm << "import: cannot find " << modname << ".rps";
+            throw std::runtime_error(strm.str());
+        }
+        found = false;      // no cache, parse the source
     }
-    Source srcImport(ifs);
     std::string savename = machine.current_module_;
     machine.current_module_ = modname;
     machine.CreateModule(modname);
+    ++machine.generation_;
     RPNParser rparser(machine);
     ShellParser sparser(machine);
+    if (found)
+    {
+        RunModuleCache(machine, rparser, sparser, data);
+        return;
+    }
+
+    Source srcImport(std::move(data));
+    std::string items;
+    rparser.record = &items;
+    sparser.record = &items;
+    bool ok = true;
     std::string mode("rpn");
     while (true)
     {
@@ -494,11 +519,16 @@ void Import(Machine& machine, const std::string& modname)
             else if (mode == "rpn")
                 rparser.Parse(machine, srcImport, mode);
             else if (mode == "")
+            {
+                if (ok && rparser.record)
+                    WriteModuleCache(filename, st, items);
                 return;
+            }
         }
         catch (std::runtime_error& e)
         {
             std::cout << e.what() << std::endl;
+            ok = false;
         }
     }
     machine.current_module_ = savename;
@@ -1,30 +1,10 @@
 #pragma once
 #include <functional>
 #include <cassert>
+#include <cstdio>
 
 namespace std
 {
-    template<>
-    struct hash<rps::Object *>
-    {
-        size_t operator()(const rps::Object* obj) const
-        {
-            if (obj->type == rps::OBJECT_INTEGER)
-            {
-                int64_t v = ((const rps::Integer *)obj)->value;
-                std::hash<int64_t> h;
-                return h(v);
-            }
-            if (obj->type == rps::OBJECT_STRING)
-            {
-                std::string s = ((const rps::String *)obj)->get();
-                std::hash<std::string> h;
-                return h(s);
-            }
-            assert(false);
-        }
-    };
-
     template<>
     struct less<rps::Object *>
     {
@@ -41,23 +21,6 @@ namespace std
             return obj1 < obj2;
         }
     };
-
-    template<>
-    struct equal_to<rps::Object *>
-    {
-        bool operator()(const rps::Object* obj1, const rps::Object* obj2) const
-        {
-            if (obj1->type == rps::OBJECT_INTEGER && obj2->type == rps::OBJECT_INTEGER)
-            {
-                return ((rps::Integer *)obj1)->value == ((rps::Integer *)obj2)->value;
-            }
-            if (obj1->type == rps::OBJECT_STRING && obj2->type == rps::OBJECT_STRING)
-            {
-                return ((rps::String *)obj1)->get() == ((rps::String *)obj2)->get();
-            }
-            return obj1 == obj2;
-        }
-    };
 }
 
 namespace rps
@@ -67,7 +30,7 @@ class Machine;
 class RPNParser;
 
 StringPtr MakeString();
-IntegerPtr MakeInteger();
+IntegerPtr MakeInteger(int64_t);
 ProgramPtr MakeProgram();
 NonePtr MakeNone();
 ListPtr MakeList();
@@ -81,8 +44,68 @@ std::string ToStr(Machine&, ObjectPtr);
 int64_t ToInt(Machine&, ObjectPtr);
 std::string ToType(Machine&, ObjectPtr);
 
+/*
+ * Appends the text of objects, as ToStr makes it, to one buffer instead
+ * of making a string for each nested object. A writer with a FILE hands
+ * the buffer to it whenever it has grown past FLUSH_BYTES, so a large
+ * list goes out in one pass.
+ */
+class TextWriter
+{
+public:
+    explicit TextWriter(FILE *file = nullptr) : file_(file) {}
+    ~TextWriter();
+
+    void Write(Machine&, const ObjectPtr&);
+    void Put(const char *s, size_t n) { buf_.append(s, n); }
+    void Put(char c) { buf_ += c; }
+    // Write the buffer to the file, if there is one
+    void Flush();
+    // Flush if the buffer is full
+    void Spill()
+    {
+        if (file_ && buf_.size() >= FLUSH_BYTES)
+            Flush();
+    }
+    // The text so far of a writer without a file
+    std::string& str() { return buf_; }
+
+private:
+    static const size_t FLUSH_BYTES = 64 * 1024;
+
+    void Text(const String *);
+    void Element(Machine&, const ObjectPtr&);
+    void Elements(Machine&, const std::vector<ObjectPtr>&);
+
+    FILE *file_;
+    std::string buf_;
+};
+
+
+// Reads the items of a List or a Stream in order
+class ItemReader
+{
+public:
+    ItemReader(ObjectPtr src) : src_(src), idx_(0) {}
+    bool Next(Machine& machine, ObjectPtr& out)
+    {
+        if (src_->type == OBJECT_STREAM)
+            return ((Stream *)src_.get())->Next(machine, out);
+        List *lp = (List *)src_.get();
+        if (idx_ == lp->items.size())
+            return false;
+        out = lp->items[idx_++];
+        return true;
+    }
+
+private:
+    ObjectPtr src_;
+    size_t idx_;
+};
 
 void split(const std::string& str, std::vector<std::string>& out, const std::string& delim, bool bCollapse = false);
+bool ReadFile(const std::string& filename, std::string& data);
+MappedFilePtr MapFile(const std::string& filename);
 void Import(Machine& machine, const std::string& modname);
 
 } // namespace rps
@@ -14,135 +14,222 @@ namespace rps
 {
 
 
-ObjectPtr find_local(Machine& machine, const std::string& name)
+// The closest active frame of the program enclosing the one running in
+// frame. A worker goes on into the frames of its parent, owner is set to
+// the Machine holding the frame.
+Frame *EnclosingFrame(Machine *& owner, Frame *frame)
 {
-    ProgramPtr pp = machine.current_program;
-    ObjectPtr optr;
-
-    auto itVar = pp->pLocals->find(name);
-    if (itVar == pp->pLocals->end())
+    Program *enclosing = frame->program->enclosingProgram.get();
+    if (enclosing == nullptr)
+        return nullptr;
+    for (;;)
     {
-        return optr;
+        while (frame != owner->frames_.data())
+        {
+            --frame;
+            if (frame->program == enclosing)
+                return frame;
+        }
+        owner = owner->parent_;
+        if (owner == nullptr)
+            return nullptr;
+        frame = owner->frames_.data() + owner->frames_.size();
     }
-    return itVar->second;
 }
 
-void STO(Machine& machine)
+// Search the enclosing programs for a local variable that has been set,
+// owner is set to the Machine holding it
+ObjectPtr *FindEnclosingLocal(Machine& machine, const std::string& name, Machine *& owner)
 {
-    if (machine.GetProperty("help", 0))
+    owner = &machine;
+    Frame *frame = &machine.frames_.back();
+    while ((frame = EnclosingFrame(owner, frame)) != nullptr)
     {
-        machine.helpstrm() << "STO: Store object";
-        machine.helpstrm() << "obj \"name\" STO =>";
-        machine.helpstrm() << "obj \"namespace.name\" STO =>";
-        machine.helpstrm() << "Store an object in the given variable name.";
-        machine.helpstrm() << "By default objects are stored in the current namespace which";
-        machine.helpstrm() << "is usually the module name or set by SETNS";
+        size_t slot = frame->program->FindLocal(name);
+        if (slot < frame->count && owner->locals_[frame->base + slot])
+            return &owner->locals_[frame->base + slot];
+    }
+    return nullptr;
+}
+
+ObjectPtr *FindEnclosingLocal(Machine& machine, const std::string& name)
+{
+    Machine *owner;
+    return FindEnclosingLocal(machine, name, owner);
+}
+
+// Store a local of an enclosing program if one has been set. The locals
+// of the program that started a parallel run are read by all workers,
+// they can not be stored.
+bool StoreEnclosingLocal(Machine& machine, const std::string& name, ObjectPtr& optr)
+{
+    Machine *owner;
+    ObjectPtr *outer = FindEnclosingLocal(machine, name, owner);
+    if (outer == nullptr)
+        return false;
+    if (owner != &machine)
+        throw std::runtime_error("STOL: A program run in parallel can not store locals of the calling program");
+    *outer = optr;
+    return true;
+}
+
+void StoreLocal(Machine& machine, size_t slot, const std::string& name, ObjectPtr& optr)
+{
+    ObjectPtr& local = machine.locals_[machine.frames_.back().base + slot];
+    if (!local && StoreEnclosingLocal(machine, name, optr))
         return;
+    local = optr;
+}
+
+bool RecallLocal(Machine& machine, size_t slot, const std::string& name, ObjectPtr& out)
+{
+    ObjectPtr& local = machine.locals_[machine.frames_.back().base + slot];
+    if (local)
+    {
+        out = local;
+        return true;
     }
+    ObjectPtr *outer = FindEnclosingLocal(machine, name);
+    if (outer)
+    {
+        out = *outer;
+        return true;
+    }
+    return false;
+}
+
+Module *FindModule(Machine& machine, const Symbol& sym)
+{
+    auto it = machine.modules_.find(sym.qualified ? sym.module : machine.current_module_);
+    if (it == machine.modules_.end())
+        return nullptr;
+    return &it->second;
+}
+
+// Worker threads share the compiled code of the parent but have their
+// own modules, they neither use nor update the caches.
+bool CacheValid(Machine& machine, GlobalCache& cache)
+{
+    return machine.parent_ == nullptr
+        && cache.module && cache.generation == machine.generation_
+        && (cache.symbol->qualified || cache.module->module_name_ == machine.current_module_);
+}
 
+ObjectPtr *LookupGlobal(Machine& machine, GlobalCache& cache)
+{
+    if (CacheValid(machine, cache))
+        return &cache.module->values_[cache.slot];
+    Module *module = FindModule(machine, *cache.symbol);
+    if (module == nullptr)
+        return nullptr;
+    auto it = module->slots_.find(cache.symbol->name);
+    if (it == module->slots_.end())
+        return nullptr;
+    if (machine.parent_)
+        return &module->values_[it->second];
+    cache.module = module;
+    cache.slot = it->second;
+    cache.generation = machine.generation_;
+    return &module->values_[cache.slot];
+}
+
+void RecallGlobal(Machine& machine, GlobalCache& cache, const std::string& name, ObjectPtr& out)
+{
+    ObjectPtr *optr = LookupGlobal(machine, cache);
+    if (optr == nullptr)
+        RCL(machine, name, out);    // throws the not found error
+    else
+        out = *optr;
+}
+
+void StoreGlobal(Machine& machine, GlobalCache& cache, ObjectPtr& optr)
+{
+    if (!CacheValid(machine, cache))
+    {
+        const Symbol& sym = *cache.symbol;
+        machine.Shared("STO");
+        Module& module = machine.modules_[sym.qualified ? sym.module : machine.current_module_];
+        cache.module = &module;
+        cache.slot = module.Slot(sym.name);
+        cache.generation = machine.generation_;
+    }
+    cache.module->values_[cache.slot] = optr;
+}
+
+void STO(Machine& machine)
+{
     std::string s;
     ObjectPtr optr;
     stack_required(machine, "STO", 2);
     throw_required(machine, "STO", 0, OBJECT_STRING);
 
+    machine.Shared("STO");
     machine.pop(s);
-    std::string modname = machine.current_module_;
-    std::string varname = s;
-    size_t n = s.find_first_of('.');
-    if (n != std::string::npos)
-    {
-        modname = s.substr(0, n);
-        ++n;
-        varname = s.substr(n);
-    }
+    const Symbol& sym = machine.Intern(s);
     machine.pop(optr);
-    Module& module = machine.modules_[modname];
-    module.variables_[varname] = optr;
+    Module& module = machine.modules_[sym.qualified ? sym.module : machine.current_module_];
+    module.values_[module.Slot(sym.name)] = optr;
 }
 
 void STOL(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "STOL: Store object into local storage";
-        machine.helpstrm() << "obj \"name\" STOL =>";
-        machine.helpstrm() << "obj \"name\" STOL* => obj";
-        machine.helpstrm() << "Store an object in the given variable name in the local context.";
-        machine.helpstrm() << "Local variables are only available in the current program.";
-        machine.helpstrm() << "Programs defined within a program have access to local variables of the";
-        machine.helpstrm() << "enclosing program";
-        return;
-    }
-
     std::string name;
     ObjectPtr optr;
     stack_required(machine, "STOL", 2);
     throw_required(machine, "STOL", 0, OBJECT_STRING);
-    if (machine.current_program.get() == nullptr)
+    if (machine.frames_.empty())
     {
         throw std::runtime_error("STOL: Requires current program context");
     }
     machine.pop(name);
     machine.pop(optr);
 
-    ProgramPtr pp = machine.current_program;
-
-    while (pp)
+    // Names that were not resolved when the program was compiled get a
+    // slot at the end of the running frame.
+    Frame& frame = machine.frames_.back();
+    size_t slot = frame.program->FindLocal(name);
+    if (slot >= frame.count)
     {
-        assert(pp->pLocals);
-        auto itVar = pp->pLocals->find(name);
-        if (itVar != pp->pLocals->end())
-        {
-            (*pp->pLocals)[name] = optr;
+        if (StoreEnclosingLocal(machine, name, optr))
             return;
-        }
-        pp = pp->enclosingProgram;
+        if (machine.parent_)
+            throw std::runtime_error("STOL: A program run in parallel can only store locals named in the program");
+        slot = frame.program->AddLocal(name);
+        frame.count = slot + 1;
+        machine.locals_.resize(frame.base + frame.count);
     }
-    (*machine.current_program->pLocals)[name] = optr;
+    StoreLocal(machine, slot, name, optr);
+}
+
+bool FindGlobal(Machine& machine, const std::string& name, ObjectPtr& out)
+{
+    const Symbol& sym = machine.Intern(name);
+    Module *module = FindModule(machine, sym);
+    if (module == nullptr)
+        return false;
+    ObjectPtr *optr = module->Find(sym.name);
+    if (optr == nullptr)
+        return false;
+    out = *optr;
+    return true;
 }
 
 void RCL(Machine& machine, const std::string& name, ObjectPtr& out)
 {
-    std::string modname = machine.current_module_;
-    std::string varname = name;
-    size_t n = name.find_first_of('.');
-    if (n != std::string::npos)
-    {
-        modname = name.substr(0, n);
-        ++n;
-        varname = name.substr(n);
-    }
-    auto itModule = machine.modules_.find(modname);
-    if (itModule == machine.modules_.end())
-    {
-        std::stringstream strm;
+    if (FindGlobal(machine, name, out))
+        return;
+    const Symbol& sym = machine.Intern(name);
+    const std::string& modname = sym.qualified ? sym.module : machine.current_module_;
+    std::stringstream strm;
+    if (machine.modules_.find(modname) == machine.modules_.end())
         strm << "RCL Module " << modname << " not found";
-        throw std::runtime_error(strm.str().c_str());
-    }
-    auto itVar = itModule->second.variables_.find(varname);
-    if (itVar == itModule->second.variables_.end())
-    {
-        std::stringstream strm;
-        strm << "RCL Variable " << modname << "." << varname << " not found";
-        throw std::runtime_error(strm.str().c_str());
-    }
-    out = itVar->second;
+    else
+        strm << "RCL Variable " << modname << "." << sym.name << " not found";
+    throw std::runtime_error(strm.str().c_str());
 }
 
 void RCL(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "RCL: Recall object";
-        machine.helpstrm() << "\"name\" RCL => obj";
-        machine.helpstrm() << "\"namespace.name\" RCL => obj";
-        machine.helpstrm() << "Recall an object from the given variable name.";
-        machine.helpstrm() << "By default objects are recalled from the current namespace which";
-        machine.helpstrm() << "is usually the module name or set by SETNS";
-        machine.helpstrm() << "See also RCLL, RCLA";
-        return;
-    }
-
     std::string s;
     stack_required(machine, "RCL", 1);
     throw_required(machine, "RCL", 0, OBJECT_STRING);
@@ -155,16 +242,6 @@ void RCL(Machine& machine)
 
 void RCLL(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "RCLL: Recall a local object";
-        machine.helpstrm() << "\"name\" RCLL =>";
-        machine.helpstrm() << "Local variables can be recalled from the current program";
-        machine.helpstrm() << "or local variables of enclosing programs";
-        machine.helpstrm() << "See also RCL, RCLA";
-        return;
-    }
-
     stack_required(machine, "RCLL", 1);
     throw_required(machine, "RCLL", 0, OBJECT_STRING);
 
@@ -175,25 +252,30 @@ void RCLL(Machine& machine)
     machine.push(optr);
 }
 
+bool FindLocal(Machine& machine, const std::string& name, ObjectPtr& out)
+{
+    if (machine.frames_.empty())
+        return false;
+
+    Frame& frame = machine.frames_.back();
+    size_t slot = frame.program->FindLocal(name);
+    if (slot < frame.count)
+        return RecallLocal(machine, slot, name, out);
+    ObjectPtr *outer = FindEnclosingLocal(machine, name);
+    if (outer == nullptr)
+        return false;
+    out = *outer;
+    return true;
+}
+
 void RCLL(Machine& machine, const std::string& name, ObjectPtr& out)
 {
-    if (machine.current_program.get() == nullptr)
+    if (machine.frames_.empty())
     {
         throw std::runtime_error("RCCL: Requires current program context");
     }
-
-    ProgramPtr pp = machine.current_program;
-
-    while (pp)
-    {
-        auto itVar = pp->pLocals->find(name);
-        if (itVar != pp->pLocals->end())
-        {
-            out = itVar->second;
-            return;
-        }
-        pp = pp->enclosingProgram;
-    }
+    if (FindLocal(machine, name, out))
+        return;
     std::stringstream strm;
     strm << "RCLL local Variable " << name << " not found";
     throw std::runtime_error(strm.str().c_str());
@@ -201,43 +283,19 @@ void RCLL(Machine& machine, const std::string& name, ObjectPtr& out)
 
 void RCLA(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "RCLA: Recall an object, first look in local storage, then global";
-        machine.helpstrm() << "\"name\" RCLA => obj";
-        machine.helpstrm() << "Local variables can be recalled from the current program";
-        machine.helpstrm() << "or local variables of enclosing programs";
-        machine.helpstrm() << "\'%\' is a synonym for RCLA";
-        return;
-    }
-
     stack_required(machine, "RCLA", 1);
     throw_required(machine, "RCLA", 0, OBJECT_STRING);
 
     std::string varname;
     ObjectPtr optr;
     machine.pop(varname);
-    try
-    {
-        RCLL(machine, varname, optr);
-        machine.push(optr);
-    }
-    catch(std::exception&)
-    {
+    if (!FindLocal(machine, varname, optr))
         RCL(machine, varname, optr);
-        machine.push(optr);
-    }
+    machine.push(optr);
 }
 
 void VARS(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "VARS: Print variables and thier contents";
-        machine.helpstrm() << "\"namespace\" VARS =>";
-        return;
-    }
-
     stack_required(machine, "VARS", 1);
     throw_required(machine, "VARS", 0, OBJECT_STRING);
     std::string modname;
@@ -249,15 +307,13 @@ void VARS(Machine& machine)
         strm << "VARNAMES: Module " << modname << " not found";
         throw std::runtime_error(strm.str().c_str());
     }
-    auto itVars = it->second.variables_.begin();
-    auto itEnd = it->second.variables_.end();
-    ListPtr lp = MakeList();
-    for (; itVars != itEnd; ++itVars)
+    Module& module = it->second;
+    for (size_t slot = 0; slot < module.names_.size(); ++slot)
     {
-        std::cout << modname << "." << itVars->first 
-            << "[" << ToType(machine,itVars->second )
+        std::cout << modname << "." << module.names_[slot]
+            << "[" << ToType(machine, module.values_[slot])
             << "] = " ;
-        std::string s = ToStr(machine, itVars->second);
+        std::string s = ToStr(machine, module.values_[slot]);
         for (size_t idx = 0; s[idx] && idx < 80; ++idx)
         {
             if (s[idx] == '\n')
@@ -271,13 +327,6 @@ void VARS(Machine& machine)
 
 void VARNAMES(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "VARNAMES: List variables";
-        machine.helpstrm() << "\"namespace\" VARNAMES => [list]";
-        return;
-    }
-
     stack_required(machine, "VARNAMES", 1);
     throw_required(machine, "VARNAMES", 0, OBJECT_STRING);
     std::string modname;
@@ -289,13 +338,12 @@ void VARNAMES(Machine& machine)
         strm << "VARNAMES: Module " << modname << " not found";
         throw std::runtime_error(strm.str().c_str());
     }
-    auto itVars = it->second.variables_.begin();
-    auto itEnd = it->second.variables_.end();
+    Module& module = it->second;
     ListPtr lp = MakeList();
-    for (; itVars != itEnd; ++itVars)
+    for (size_t slot = 0; slot < module.names_.size(); ++slot)
     {
         StringPtr sp = MakeString();
-        sp->set(modname + "." + itVars->first);
+        sp->set(modname + "." + module.names_[slot]);
         lp->items.push_back(sp);
     }
     machine.push(lp);
@@ -303,13 +351,6 @@ void VARNAMES(Machine& machine)
 
 void VARTYPES(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "VARTYPES: List variable types";
-        machine.helpstrm() << "\"namespace\" VARTYPES => [list]";
-        return;
-    }
-
     stack_required(machine, "VARTYPES", 1);
     throw_required(machine, "VARTYPES", 0, OBJECT_STRING);
 
@@ -322,13 +363,12 @@ void VARTYPES(Machine& machine)
         strm << "TYPES: Module " << modname << " not found";
         throw std::runtime_error(strm.str().c_str());
     }
-    auto itVars = it->second.variables_.begin();
-    auto itEnd = it->second.variables_.end();
+    Module& module = it->second;
     ListPtr lp = MakeList();
-    for (; itVars != itEnd; ++itVars)
+    for (size_t slot = 0; slot < module.names_.size(); ++slot)
     {
         StringPtr sp = MakeString();
-        sp->set(ToType(machine, itVars->second) + ":" + modname + "." + itVars->first);
+        sp->set(ToType(machine, module.values_[slot]) + ":" + modname + "." + module.names_[slot]);
         lp->items.push_back(sp);
     }
     machine.push(lp);
@@ -336,16 +376,6 @@ void VARTYPES(Machine& machine)
 
 void REGISTER(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "REGISTER: Register a user defined program";
-        machine.helpstrm() << "<<prog>> \"name\" REGISTER => ";
-        machine.helpstrm() << "Registering a program allows the user invoke the program by name";
-        machine.helpstrm() << "rather than having to issue a CALL statement.";
-        machine.helpstrm() << "name should always be in quotes to force interpretation as a string,";
-        machine.helpstrm() << "otherwise calling REGISTER again could invoke the command rather then setting it.";
-        return;
-    }
     stack_required(machine, "REGISTER", 2);
     throw_required(machine, "REGISTER", 0, OBJECT_STRING);
     throw_required(machine, "REGISTER", 1, OBJECT_PROGRAM);
@@ -354,20 +384,13 @@ void REGISTER(Machine& machine)
 
     machine.pop(name);
     machine.pop(prog);
-    ProgramPtr pptr = std::static_pointer_cast<Program>(prog);
+    ProgramPtr pptr = static_pointer_cast<Program>(prog);
 
     AddCommand(machine, name, pptr);
 }
 
 void UNREGISTER(Machine& machine)
 {
-    if (machine.GetProperty("help", 0))
-    {
-        machine.helpstrm() << "UNREGISTER: Unregister a user defined program";
-        machine.helpstrm() << "\"name\" UNREGISTER => ";
-        machine.helpstrm() << "Unregisters a previous registered program";
-        return;
-    }
     stack_required(machine, "UNREGISTER", 1);
     throw_required(machine, "UNREGISTER", 0, OBJECT_STRING);
     std::string name;